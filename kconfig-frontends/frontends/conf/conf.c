@@ -14,6 +14,7 @@
 #include <getopt.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <errno.h>
 
 #include "lkc.h"
@@ -35,6 +36,7 @@ enum input_mode {
 	savedefconfig,
 	listnewconfig,
 	olddefconfig,
+	batchdefconfig,
 } input_mode = oldaskconfig;
 
 static int indent = 1;
@@ -447,6 +449,136 @@ static void check_conf(struct menu *menu)
 		check_conf(child);
 }
 
+/*
+ * Batch mode: the tree is parsed once and olddefconfig (and optionally
+ * savedefconfig) is run for every line of a list file.  The symbols are
+ * reset to their state after parsing before each line, so the result is
+ * the same as that of a separate run.
+ */
+struct batch_entry {
+	char *defconfig;
+	char *config;
+	char *savedefconfig;
+};
+
+static struct batch_entry *batch;
+static int batch_cnt;
+
+static void batch_read(const char *name)
+{
+	char buf[3 * PATH_MAX + 8], *p, *field[3];
+	int n, lineno = 0;
+	FILE *in;
+
+	in = fopen(name, "r");
+	if (!in) {
+		fprintf(stderr, _("*** Can't open batch list \"%s\"!\n"), name);
+		exit(1);
+	}
+	while (fgets(buf, sizeof(buf), in)) {
+		lineno++;
+		n = 0;
+		for (p = strtok(buf, " \t\r\n"); p; p = strtok(NULL, " \t\r\n")) {
+			if (n == 3 || (!n && *p == '#'))
+				break;
+			field[n++] = p;
+		}
+		if (!n)
+			continue;
+		if (n < 2 || p) {
+			fprintf(stderr, _("%s:%d: expected \"<defconfig> <config> [<savedefconfig>]\"\n"),
+				name, lineno);
+			exit(1);
+		}
+		batch = xrealloc(batch, (batch_cnt + 1) * sizeof(*batch));
+		batch[batch_cnt].defconfig = strdup(field[0]);
+		batch[batch_cnt].config = strdup(field[1]);
+		batch[batch_cnt].savedefconfig = n > 2 ? strdup(field[2]) : NULL;
+		batch_cnt++;
+	}
+	fclose(in);
+}
+
+static int batch_one(struct batch_entry *b)
+{
+	conf_reset();
+	if (conf_read(b->defconfig)) {
+		fprintf(stderr, _("*** Can't find configuration \"%s\"!\n"),
+			b->defconfig);
+		return 1;
+	}
+	conf_cnt = 0;
+	check_conf(&rootmenu);
+	if (conf_write(b->config)) {
+		fprintf(stderr, _("*** Error while writing the configuration to %s\n"),
+			b->config);
+		return 1;
+	}
+	if (!b->savedefconfig)
+		return 0;
+
+	/* start from what was written, like a separate savedefconfig run */
+	if (conf_read(b->config) || conf_write_defconfig(b->savedefconfig)) {
+		fprintf(stderr, _("*** Error while saving defconfig to: %s\n"),
+			b->savedefconfig);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * With more than one job, the lines are shared out among worker processes
+ * forked after parsing, so the parsed tree needn't be rebuilt by them.
+ */
+static int conf_batch(const char *list, int jobs)
+{
+	int i, job, status, ret = 0;
+	pid_t *pids, pid;
+
+	batch_read(list);
+	input_mode = olddefconfig;
+	if (jobs > batch_cnt)
+		jobs = batch_cnt;
+	if (jobs <= 1) {
+		for (i = 0; i < batch_cnt; i++)
+			ret |= batch_one(&batch[i]);
+		return ret;
+	}
+
+	pids = xmalloc(jobs * sizeof(*pids));
+	fflush(stdout);
+	fflush(stderr);
+	for (job = 0; job < jobs; job++) {
+		pids[job] = fork();
+		if (pids[job] < 0) {
+			perror("fork");
+			ret = 1;
+			break;
+		}
+		if (!pids[job]) {
+			for (i = job; i < batch_cnt; i += jobs)
+				ret |= batch_one(&batch[i]);
+			fflush(stdout);
+			_exit(ret);
+		}
+	}
+	/* reap only our own workers, any other child is the caller's */
+	for (i = 0; i < job; i++) {
+		do
+			pid = waitpid(pids[i], &status, 0);
+		while (pid < 0 && errno == EINTR);
+		if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+			ret = 1;
+	}
+	free(pids);
+	/* lines of workers that couldn't be started */
+	for (; job < jobs; job++) {
+		for (i = job; i < batch_cnt; i += jobs)
+			ret |= batch_one(&batch[i]);
+	}
+	return ret;
+}
+
 static struct option long_opts[] = {
 	{"oldaskconfig",    no_argument,       NULL, oldaskconfig},
 	{"oldconfig",       no_argument,       NULL, oldconfig},
@@ -460,6 +592,7 @@ static struct option long_opts[] = {
 	{"randconfig",      no_argument,       NULL, randconfig},
 	{"listnewconfig",   no_argument,       NULL, listnewconfig},
 	{"olddefconfig",    no_argument,       NULL, olddefconfig},
+	{"batchdefconfig",  required_argument, NULL, batchdefconfig},
 	/*
 	 * oldnoconfig is an alias of olddefconfig, because people already
 	 * are dependent on its behavior(sets new symbols to their default
@@ -472,7 +605,7 @@ static struct option long_opts[] = {
 static void conf_usage(const char *progname)
 {
 
-	printf("Usage: %s [-s] [option] <kconfig-file>\n", progname);
+	printf("Usage: %s [-s] [-j jobs] [option] <kconfig-file>\n", progname);
 	printf("[option] is _one_ of the following:\n");
 	printf("  --listnewconfig         List new options\n");
 	printf("  --oldaskconfig          Start a new configuration using a line-oriented program\n");
@@ -487,6 +620,9 @@ static void conf_usage(const char *progname)
 	printf("  --allmodconfig          New config where all options are answered with mod\n");
 	printf("  --alldefconfig          New config with all symbols set to default\n");
 	printf("  --randconfig            New config with random answer to all options\n");
+	printf("  --batchdefconfig <list> Run olddefconfig for each \"<defconfig> <config>\n");
+	printf("                          [<savedefconfig>]\" line of <list>, with -j jobs\n");
+	printf("                          in parallel\n");
 }
 
 int main(int ac, char **av)
@@ -495,6 +631,7 @@ int main(int ac, char **av)
 	int opt;
 	const char *name, *defconfig_file = NULL /* gcc uninit */;
 	struct stat tmpstat;
+	int jobs = 1;
 
 	setlocale(LC_ALL, "");
 	bindtextdomain(PACKAGE, LOCALEDIR);
@@ -502,11 +639,26 @@ int main(int ac, char **av)
 
 	tty_stdio = isatty(0) && isatty(1) && isatty(2);
 
-	while ((opt = getopt_long(ac, av, "s", long_opts, NULL)) != -1) {
+	while ((opt = getopt_long(ac, av, "sj:", long_opts, NULL)) != -1) {
 		if (opt == 's') {
 			conf_set_message_callback(NULL);
 			continue;
 		}
+		if (opt == 'j') {
+			char *endp;
+			long n;
+
+			errno = 0;
+			n = strtol(optarg, &endp, 10);
+			if (errno || endp == optarg || *endp || n < 1 || n > INT_MAX) {
+				fprintf(stderr, _("%s: invalid number of jobs \"%s\"\n"),
+					progname, optarg);
+				conf_usage(progname);
+				exit(1);
+			}
+			jobs = n;
+			continue;
+		}
 		input_mode = (enum input_mode)opt;
 		switch (opt) {
 		case silentoldconfig:
@@ -514,6 +666,7 @@ int main(int ac, char **av)
 			break;
 		case defconfig:
 		case savedefconfig:
+		case batchdefconfig:
 			defconfig_file = optarg;
 			break;
 		case randconfig:
@@ -564,6 +717,8 @@ int main(int ac, char **av)
 	name = av[optind];
 	conf_parse(name);
 	//zconfdump(stdout);
+	if (input_mode == batchdefconfig)
+		return conf_batch(defconfig_file, jobs);
 	if (sync_kconfig) {
 		name = conf_get_configname();
 		if (stat(name, &tmpstat)) {
@@ -666,6 +821,7 @@ int main(int ac, char **av)
 		conf_set_all_new_symbols(def_default);
 		break;
 	case savedefconfig:
+	case batchdefconfig:
 		break;
 	case oldaskconfig:
 		rootEntry = &rootmenu;
@@ -0,0 +1,911 @@
+/*
+ * Snapshot of the finalized Kconfig tree.
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ * When KCONFIG_CACHE names a file, conf_parse() saves the symbols,
+ * properties, expressions and menus there after parsing, and later runs
+ * load them from it instead of parsing again.  The snapshot is only used
+ * while every file in file_list still has the same content and every
+ * environment symbol still has the same value.
+ *
+ * The header carries a format id and a hash of everything after the
+ * header.  A snapshot in another format, or one that is damaged, is never
+ * used; the files are parsed instead.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+
+#include "lkc.h"
+
+#define CACHE_MAGIC	"KCCACHE2"
+/*
+ * Bump CACHE_FORMAT_VERSION whenever the meaning of a saved record
+ * changes: what a field holds, how the parser's structures are rebuilt
+ * from it, or which flags are kept.
+ */
+#define CACHE_FORMAT_VERSION	1
+#define CACHE_ENV	"KCONFIG_CACHE"
+
+/*
+ * All references are 32-bit indexes, 0 standing for NULL.  Symbol
+ * indexes below CACHE_SYM_FIRST are the constant symbols that are not in
+ * symbol_hash, and menu index 1 is the root menu.  Strings are offsets
+ * into the string table.
+ */
+enum {
+	CACHE_SYM_YES = 1,
+	CACHE_SYM_MOD,
+	CACHE_SYM_NO,
+	CACHE_SYM_EMPTY,
+	CACHE_SYM_FIRST
+};
+
+struct cache_header {
+	char magic[8];
+	uint32_t format;
+	uint32_t size;
+	uint32_t body_hash[2];
+	uint32_t root;
+	uint32_t uname;
+	uint32_t nfile, nenv, nsym, nprop, nexpr, nmenu, nstr;
+	uint32_t modules, defconfig_list, env_list;
+};
+
+struct cache_file {
+	uint32_t name, parent, lineno;
+	uint32_t hash[2];
+};
+
+struct cache_env {
+	uint32_t name, value;
+};
+
+struct cache_sym {
+	uint32_t name, bucket, type, flags, prop;
+	uint32_t dir_dep, rev_dep, implied;
+};
+
+struct cache_prop {
+	uint32_t next, sym, type, text, visible, expr, menu, file, lineno;
+};
+
+struct cache_expr {
+	uint32_t type, left, right;
+};
+
+struct cache_menu {
+	uint32_t next, parent, list, sym, prompt, visibility, dep;
+	uint32_t flags, help, file, lineno;
+};
+
+struct cache_buf {
+	char *data;
+	size_t len, size;
+};
+
+/* maps the objects of the tree to their indexes while saving */
+struct cache_map {
+	const void **key;
+	uint32_t *val;
+	size_t size, count;
+};
+
+enum { C_FILE, C_SYM, C_PROP, C_EXPR, C_MENU, C_NR };
+
+struct cache_writer {
+	struct cache_map map;
+	const void **obj[C_NR];
+	uint32_t nobj[C_NR];
+	struct cache_buf str;
+	bool failed;
+};
+
+#define FNV_BASIS	14695981039346656037ULL
+#define FNV_PRIME	1099511628211ULL
+
+static uint64_t cache_fnv(uint64_t h, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	while (len--)
+		h = (h ^ *p++) * FNV_PRIME;
+	return h;
+}
+
+/* FNV-1a taking eight bytes a step, the snapshot body is large */
+static void cache_hash_body(const void *data, size_t len, uint32_t hash[2])
+{
+	const char *p = data;
+	uint64_t h = FNV_BASIS, w;
+
+	for (; len >= sizeof(w); p += sizeof(w), len -= sizeof(w)) {
+		memcpy(&w, p, sizeof(w));
+		h = (h ^ w) * FNV_PRIME;
+	}
+	h = cache_fnv(h, p, len);
+	hash[0] = (uint32_t)h;
+	hash[1] = (uint32_t)(h >> 32);
+}
+
+static void cache_hash_file(const char *name, uint32_t hash[2])
+{
+	uint64_t h = FNV_BASIS;
+	unsigned char buf[4096];
+	size_t n;
+	FILE *f;
+
+	hash[0] = hash[1] = 0;
+	f = zconf_fopen(name);
+	if (!f)
+		return;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		h = cache_fnv(h, buf, n);
+	fclose(f);
+	/* a hash of 0 is never used for an existing file */
+	h |= 1;
+	hash[0] = (uint32_t)h;
+	hash[1] = (uint32_t)(h >> 32);
+}
+
+/*
+ * Identifies the format of a snapshot: CACHE_FORMAT_VERSION, and the
+ * record layout and enum ranges, which also catch a change of byte order.
+ * A change to the parser that alters what is saved must bump the version.
+ */
+static uint32_t cache_format_id(void)
+{
+	const uint32_t layout[] = {
+		CACHE_FORMAT_VERSION,
+		sizeof(struct cache_header), sizeof(struct cache_file),
+		sizeof(struct cache_env), sizeof(struct cache_sym),
+		sizeof(struct cache_prop), sizeof(struct cache_expr),
+		sizeof(struct cache_menu), SYMBOL_HASHSIZE,
+		E_RANGE, S_OTHER, P_SYMBOL,
+	};
+	uint64_t h;
+
+	h = cache_fnv(FNV_BASIS, layout, sizeof(layout));
+	return (uint32_t)(h ^ (h >> 32));
+}
+
+static const char *cache_uname(void)
+{
+	static struct utsname uts;
+
+	uname(&uts);
+	return uts.release;
+}
+
+/*
+ * Saving
+ */
+
+static void buf_add(struct cache_buf *buf, const void *data, size_t len)
+{
+	if (buf->len + len > buf->size) {
+		buf->size = (buf->len + len) * 2 + 256;
+		buf->data = xrealloc(buf->data, buf->size);
+	}
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+}
+
+static uint32_t cache_str(struct cache_writer *w, const char *s)
+{
+	uint32_t off;
+
+	if (!s)
+		return 0;
+	off = w->str.len;
+	buf_add(&w->str, s, strlen(s) + 1);
+	return off;
+}
+
+static size_t map_slot(struct cache_map *map, const void *p)
+{
+	size_t i = ((uintptr_t)p >> 3) * 2654435761U % map->size;
+
+	while (map->key[i] && map->key[i] != p)
+		i = (i + 1) % map->size;
+	return i;
+}
+
+static uint32_t map_get(struct cache_map *map, const void *p)
+{
+	size_t i;
+
+	if (!p || !map->size)
+		return 0;
+	i = map_slot(map, p);
+	return map->key[i] ? map->val[i] : 0;
+}
+
+static void map_put(struct cache_map *map, const void *p, uint32_t val)
+{
+	struct cache_map old = *map;
+	size_t i;
+
+	if ((map->count + 1) * 2 > map->size) {
+		map->size = map->size ? map->size * 2 : 1024;
+		map->key = xcalloc(map->size, sizeof(*map->key));
+		map->val = xcalloc(map->size, sizeof(*map->val));
+		map->count = 0;
+		for (i = 0; i < old.size; i++) {
+			if (old.key[i])
+				map_put(map, old.key[i], old.val[i]);
+		}
+		free(old.key);
+		free(old.val);
+	}
+	i = map_slot(map, p);
+	map->key[i] = p;
+	map->val[i] = val;
+	map->count++;
+}
+
+/* Give an object its index the first time it is referenced */
+static void cache_ref(struct cache_writer *w, int type, const void *p)
+{
+	uint32_t n;
+
+	if (!p || map_get(&w->map, p))
+		return;
+	n = w->nobj[type]++;
+	if (!(n % 256))
+		w->obj[type] = xrealloc(w->obj[type],
+					(n + 256) * sizeof(*w->obj[type]));
+	w->obj[type][n] = p;
+	map_put(&w->map, p, type == C_SYM ? n + CACHE_SYM_FIRST : n + 1);
+}
+
+static void cache_ref_sym(struct cache_writer *w, struct symbol *sym)
+{
+	if (sym == &symbol_yes || sym == &symbol_mod ||
+	    sym == &symbol_no || sym == &symbol_empty)
+		return;
+	/* every other symbol is in symbol_hash and already known */
+	if (sym && !map_get(&w->map, sym))
+		w->failed = true;
+}
+
+static uint32_t cache_sym_idx(struct cache_writer *w, struct symbol *sym)
+{
+	if (sym == &symbol_yes)
+		return CACHE_SYM_YES;
+	if (sym == &symbol_mod)
+		return CACHE_SYM_MOD;
+	if (sym == &symbol_no)
+		return CACHE_SYM_NO;
+	if (sym == &symbol_empty)
+		return CACHE_SYM_EMPTY;
+	return map_get(&w->map, sym);
+}
+
+static void cache_ref_expr(struct cache_writer *w, struct expr *e)
+{
+	if (!e || map_get(&w->map, e))
+		return;
+	cache_ref(w, C_EXPR, e);
+	switch (e->type) {
+	case E_SYMBOL:
+		cache_ref_sym(w, e->left.sym);
+		break;
+	case E_NOT:
+		cache_ref_expr(w, e->left.expr);
+		break;
+	case E_AND:
+	case E_OR:
+		cache_ref_expr(w, e->left.expr);
+		cache_ref_expr(w, e->right.expr);
+		break;
+	case E_LIST:
+		cache_ref_expr(w, e->left.expr);
+		cache_ref_sym(w, e->right.sym);
+		break;
+	case E_EQUAL:
+	case E_UNEQUAL:
+	case E_LTH:
+	case E_LEQ:
+	case E_GTH:
+	case E_GEQ:
+	case E_RANGE:
+		cache_ref_sym(w, e->left.sym);
+		cache_ref_sym(w, e->right.sym);
+		break;
+	default:
+		w->failed = true;
+	}
+}
+
+static uint32_t cache_expr_child(struct cache_writer *w, struct expr *e,
+				 union expr_data *data, bool left)
+{
+	switch (e->type) {
+	case E_SYMBOL:
+		return left ? cache_sym_idx(w, data->sym) : 0;
+	case E_NOT:
+		return left ? map_get(&w->map, data->expr) : 0;
+	case E_AND:
+	case E_OR:
+		return map_get(&w->map, data->expr);
+	case E_LIST:
+		return left ? map_get(&w->map, data->expr)
+			    : cache_sym_idx(w, data->sym);
+	default:
+		return cache_sym_idx(w, data->sym);
+	}
+}
+
+/* Find every object of the tree */
+static void cache_collect(struct cache_writer *w)
+{
+	struct symbol *sym;
+	struct property *prop;
+	struct menu *menu;
+	struct file *file;
+	uint32_t i;
+
+	for (file = file_list; file; file = file->next)
+		cache_ref(w, C_FILE, file);
+	for (i = 0; i < SYMBOL_HASHSIZE; i++) {
+		for (sym = symbol_hash[i]; sym; sym = sym->next)
+			cache_ref(w, C_SYM, sym);
+	}
+	cache_ref(w, C_MENU, &rootmenu);
+
+	/* referencing an object may add more of them, so go on until done */
+	for (i = 0; i < w->nobj[C_SYM]; i++) {
+		sym = (struct symbol *)w->obj[C_SYM][i];
+		cache_ref(w, C_PROP, sym->prop);
+		cache_ref_expr(w, sym->dir_dep.expr);
+		cache_ref_expr(w, sym->rev_dep.expr);
+		cache_ref_expr(w, sym->implied.expr);
+	}
+	cache_ref_expr(w, sym_env_list);
+	for (i = 0; i < w->nobj[C_MENU]; i++) {
+		menu = (struct menu *)w->obj[C_MENU][i];
+		cache_ref(w, C_MENU, menu->next);
+		cache_ref(w, C_MENU, menu->parent);
+		cache_ref(w, C_MENU, menu->list);
+		cache_ref_sym(w, menu->sym);
+		cache_ref(w, C_PROP, menu->prompt);
+		cache_ref_expr(w, menu->visibility);
+		cache_ref_expr(w, menu->dep);
+		if (menu->file && !map_get(&w->map, menu->file))
+			w->failed = true;
+	}
+	for (i = 0; i < w->nobj[C_PROP]; i++) {
+		prop = (struct property *)w->obj[C_PROP][i];
+		cache_ref(w, C_PROP, prop->next);
+		cache_ref_sym(w, prop->sym);
+		cache_ref_expr(w, prop->visible.expr);
+		cache_ref_expr(w, prop->expr);
+		if (prop->menu && !map_get(&w->map, prop->menu))
+			w->failed = true;
+		if (prop->file && !map_get(&w->map, prop->file))
+			w->failed = true;
+	}
+}
+
+void conf_cache_save(const char *name)
+{
+	const char *path = getenv(CACHE_ENV);
+	struct cache_writer w;
+	struct cache_header hdr;
+	struct cache_buf out;
+	struct symbol *sym;
+	struct property *prop;
+	struct expr *e;
+	char tmpname[PATH_MAX];
+	uint32_t i, nenv;
+	FILE *f;
+
+	if (!path || !*path)
+		return;
+
+	memset(&w, 0, sizeof(w));
+	memset(&out, 0, sizeof(out));
+	buf_add(&w.str, "", 1);
+	cache_collect(&w);
+	if (w.failed)
+		goto out;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic));
+	hdr.format = cache_format_id();
+	hdr.root = cache_str(&w, name);
+	hdr.uname = cache_str(&w, cache_uname());
+	hdr.nfile = w.nobj[C_FILE];
+	hdr.nsym = w.nobj[C_SYM];
+	hdr.nprop = w.nobj[C_PROP];
+	hdr.nexpr = w.nobj[C_EXPR];
+	hdr.nmenu = w.nobj[C_MENU];
+	hdr.modules = cache_sym_idx(&w, modules_sym);
+	hdr.defconfig_list = cache_sym_idx(&w, sym_defconfig_list);
+	hdr.env_list = map_get(&w.map, sym_env_list);
+	buf_add(&out, &hdr, sizeof(hdr));
+
+	for (i = 0; i < w.nobj[C_FILE]; i++) {
+		const struct file *file = w.obj[C_FILE][i];
+		struct cache_file rec;
+
+		rec.name = cache_str(&w, file->name);
+		rec.parent = map_get(&w.map, file->parent);
+		rec.lineno = file->lineno;
+		cache_hash_file(file->name, rec.hash);
+		buf_add(&out, &rec, sizeof(rec));
+	}
+
+	/* the values of the environment symbols are part of the tree */
+	nenv = 0;
+	expr_list_for_each_sym(sym_env_list, e, sym) {
+		struct cache_env rec;
+
+		for_all_properties(sym, prop, P_ENV) {
+			const char *env = prop_get_symbol(prop)->name;
+
+			rec.name = cache_str(&w, env);
+			rec.value = cache_str(&w, getenv(env));
+			buf_add(&out, &rec, sizeof(rec));
+			nenv++;
+		}
+	}
+	((struct cache_header *)out.data)->nenv = nenv;
+
+	for (i = 0; i < w.nobj[C_SYM]; i++) {
+		struct cache_sym rec;
+
+		sym = (struct symbol *)w.obj[C_SYM][i];
+		rec.name = cache_str(&w, sym->name);
+		rec.bucket = sym->name ? strhash(sym->name) % SYMBOL_HASHSIZE : 0;
+		rec.type = sym->type;
+		rec.flags = sym->flags;
+		rec.prop = map_get(&w.map, sym->prop);
+		rec.dir_dep = map_get(&w.map, sym->dir_dep.expr);
+		rec.rev_dep = map_get(&w.map, sym->rev_dep.expr);
+		rec.implied = map_get(&w.map, sym->implied.expr);
+		buf_add(&out, &rec, sizeof(rec));
+	}
+
+	for (i = 0; i < w.nobj[C_PROP]; i++) {
+		struct cache_prop rec;
+
+		prop = (struct property *)w.obj[C_PROP][i];
+		rec.next = map_get(&w.map, prop->next);
+		rec.sym = cache_sym_idx(&w, prop->sym);
+		rec.type = prop->type;
+		rec.text = cache_str(&w, prop->text);
+		rec.visible = map_get(&w.map, prop->visible.expr);
+		rec.expr = map_get(&w.map, prop->expr);
+		rec.menu = map_get(&w.map, prop->menu);
+		rec.file = map_get(&w.map, prop->file);
+		rec.lineno = prop->lineno;
+		buf_add(&out, &rec, sizeof(rec));
+	}
+
+	for (i = 0; i < w.nobj[C_EXPR]; i++) {
+		struct cache_expr rec;
+
+		e = (struct expr *)w.obj[C_EXPR][i];
+		rec.type = e->type;
+		rec.left = cache_expr_child(&w, e, &e->left, true);
+		rec.right = cache_expr_child(&w, e, &e->right, false);
+		buf_add(&out, &rec, sizeof(rec));
+	}
+
+	for (i = 0; i < w.nobj[C_MENU]; i++) {
+		const struct menu *menu = w.obj[C_MENU][i];
+		struct cache_menu rec;
+
+		rec.next = map_get(&w.map, menu->next);
+		rec.parent = map_get(&w.map, menu->parent);
+		rec.list = map_get(&w.map, menu->list);
+		rec.sym = cache_sym_idx(&w, menu->sym);
+		rec.prompt = map_get(&w.map, menu->prompt);
+		rec.visibility = map_get(&w.map, menu->visibility);
+		rec.dep = map_get(&w.map, menu->dep);
+		rec.flags = menu->flags;
+		rec.help = cache_str(&w, menu->help);
+		rec.file = map_get(&w.map, menu->file);
+		rec.lineno = menu->lineno;
+		buf_add(&out, &rec, sizeof(rec));
+	}
+
+	((struct cache_header *)out.data)->nstr = w.str.len;
+	buf_add(&out, w.str.data, w.str.len);
+	((struct cache_header *)out.data)->size = out.len;
+	cache_hash_body(out.data + sizeof(hdr), out.len - sizeof(hdr),
+			((struct cache_header *)out.data)->body_hash);
+
+	/* write a new file and rename it, another run may be reading it */
+	snprintf(tmpname, sizeof(tmpname), "%s.%d", path, (int)getpid());
+	f = fopen(tmpname, "w");
+	if (!f)
+		goto out;
+	if (fwrite(out.data, 1, out.len, f) != out.len) {
+		fclose(f);
+		unlink(tmpname);
+		goto out;
+	}
+	if (fclose(f) || rename(tmpname, path))
+		unlink(tmpname);
+
+out:
+	free(w.map.key);
+	free(w.map.val);
+	for (i = 0; i < C_NR; i++)
+		free(w.obj[i]);
+	free(w.str.data);
+	free(out.data);
+}
+
+/*
+ * Loading
+ */
+
+struct cache_reader {
+	const struct cache_header *hdr;
+	const struct cache_file *files;
+	const struct cache_env *envs;
+	const struct cache_sym *syms;
+	const struct cache_prop *props;
+	const struct cache_expr *exprs;
+	const struct cache_menu *menus;
+	char *str;
+	struct file *file;
+	struct symbol *sym;
+	struct property *prop;
+	struct expr *expr;
+	struct menu *menu;
+};
+
+static bool cache_str_ok(const struct cache_reader *r, uint32_t s)
+{
+	return s < r->hdr->nstr;
+}
+
+static bool cache_sym_ok(const struct cache_reader *r, uint32_t i)
+{
+	return i < CACHE_SYM_FIRST + r->hdr->nsym;
+}
+
+static const char *rd_str(const struct cache_reader *r, uint32_t s)
+{
+	return s ? r->str + s : NULL;
+}
+
+static struct symbol *rd_sym(const struct cache_reader *r, uint32_t i)
+{
+	switch (i) {
+	case 0:
+		return NULL;
+	case CACHE_SYM_YES:
+		return &symbol_yes;
+	case CACHE_SYM_MOD:
+		return &symbol_mod;
+	case CACHE_SYM_NO:
+		return &symbol_no;
+	case CACHE_SYM_EMPTY:
+		return &symbol_empty;
+	}
+	return &r->sym[i - CACHE_SYM_FIRST];
+}
+
+#define rd_obj(r, field, i)	((i) ? &(r)->field[(i) - 1] : NULL)
+
+/* menu 1 is the root menu, which is not allocated */
+static struct menu *rd_menu(const struct cache_reader *r, uint32_t i)
+{
+	return i == 1 ? &rootmenu : rd_obj(r, menu, i);
+}
+
+static bool cache_expr_ok(const struct cache_reader *r,
+			  const struct cache_expr *rec)
+{
+	uint32_t n = r->hdr->nexpr;
+
+	switch (rec->type) {
+	case E_SYMBOL:
+		return cache_sym_ok(r, rec->left) && rec->left;
+	case E_NOT:
+		return rec->left && rec->left <= n;
+	case E_AND:
+	case E_OR:
+		return rec->left && rec->left <= n &&
+		       rec->right && rec->right <= n;
+	case E_LIST:
+		return rec->left <= n && cache_sym_ok(r, rec->right);
+	case E_EQUAL:
+	case E_UNEQUAL:
+	case E_LTH:
+	case E_LEQ:
+	case E_GTH:
+	case E_GEQ:
+	case E_RANGE:
+		return rec->left && cache_sym_ok(r, rec->left) &&
+		       rec->right && cache_sym_ok(r, rec->right);
+	}
+	return false;
+}
+
+/* Check that every reference is in range before anything is built */
+static bool cache_check(const struct cache_reader *r)
+{
+	const struct cache_header *hdr = r->hdr;
+	uint32_t i;
+
+	if (!cache_str_ok(r, hdr->root) || !cache_str_ok(r, hdr->uname) ||
+	    !cache_sym_ok(r, hdr->modules) ||
+	    !cache_sym_ok(r, hdr->defconfig_list) ||
+	    hdr->env_list > hdr->nexpr || !hdr->nmenu)
+		return false;
+	for (i = 0; i < hdr->nfile; i++) {
+		if (!cache_str_ok(r, r->files[i].name) || !r->files[i].name ||
+		    r->files[i].parent > hdr->nfile)
+			return false;
+	}
+	for (i = 0; i < hdr->nenv; i++) {
+		if (!r->envs[i].name || !cache_str_ok(r, r->envs[i].name) ||
+		    !cache_str_ok(r, r->envs[i].value))
+			return false;
+	}
+	for (i = 0; i < hdr->nsym; i++) {
+		const struct cache_sym *rec = &r->syms[i];
+
+		if (!cache_str_ok(r, rec->name) ||
+		    rec->bucket >= SYMBOL_HASHSIZE || rec->prop > hdr->nprop ||
+		    rec->dir_dep > hdr->nexpr || rec->rev_dep > hdr->nexpr ||
+		    rec->implied > hdr->nexpr)
+			return false;
+	}
+	for (i = 0; i < hdr->nprop; i++) {
+		const struct cache_prop *rec = &r->props[i];
+
+		if (rec->next > hdr->nprop || !cache_sym_ok(r, rec->sym) ||
+		    !cache_str_ok(r, rec->text) || rec->visible > hdr->nexpr ||
+		    rec->expr > hdr->nexpr || rec->menu > hdr->nmenu ||
+		    rec->file > hdr->nfile)
+			return false;
+	}
+	for (i = 0; i < hdr->nexpr; i++) {
+		if (!cache_expr_ok(r, &r->exprs[i]))
+			return false;
+	}
+	for (i = 0; i < hdr->nmenu; i++) {
+		const struct cache_menu *rec = &r->menus[i];
+
+		if (rec->next > hdr->nmenu || rec->parent > hdr->nmenu ||
+		    rec->list > hdr->nmenu || !cache_sym_ok(r, rec->sym) ||
+		    rec->prompt > hdr->nprop || rec->visibility > hdr->nexpr ||
+		    rec->dep > hdr->nexpr || !cache_str_ok(r, rec->help) ||
+		    rec->file > hdr->nfile)
+			return false;
+	}
+	return true;
+}
+
+/* Is the snapshot still what parsing the Kconfig files would give? */
+static bool cache_current(const struct cache_reader *r, const char *name)
+{
+	const char *value;
+	uint32_t hash[2];
+	uint32_t i;
+
+	if (strcmp(rd_str(r, r->hdr->root), name) ||
+	    strcmp(rd_str(r, r->hdr->uname), cache_uname()))
+		return false;
+	for (i = 0; i < r->hdr->nenv; i++) {
+		value = getenv(rd_str(r, r->envs[i].name));
+		if (!value != !r->envs[i].value)
+			return false;
+		if (value && strcmp(value, rd_str(r, r->envs[i].value)))
+			return false;
+	}
+	for (i = 0; i < r->hdr->nfile; i++) {
+		cache_hash_file(rd_str(r, r->files[i].name), hash);
+		if (hash[0] != r->files[i].hash[0] ||
+		    hash[1] != r->files[i].hash[1])
+			return false;
+	}
+	return true;
+}
+
+static void cache_build(struct cache_reader *r)
+{
+	const struct cache_header *hdr = r->hdr;
+	struct symbol **tail[SYMBOL_HASHSIZE];
+	struct menu *menu;
+	uint32_t i;
+
+	r->file = xcalloc(hdr->nfile + 1, sizeof(*r->file));
+	r->sym = xcalloc(hdr->nsym + 1, sizeof(*r->sym));
+	r->prop = xcalloc(hdr->nprop + 1, sizeof(*r->prop));
+	r->expr = xcalloc(hdr->nexpr + 1, sizeof(*r->expr));
+	r->menu = xcalloc(hdr->nmenu, sizeof(*r->menu));
+
+	for (i = 0; i < hdr->nfile; i++) {
+		const struct cache_file *rec = &r->files[i];
+		struct file *file = &r->file[i];
+
+		file->next = i + 1 < hdr->nfile ? &r->file[i + 1] : NULL;
+		file->parent = rd_obj(r, file, rec->parent);
+		file->name = rd_str(r, rec->name);
+		file->lineno = rec->lineno;
+	}
+	file_list = hdr->nfile ? r->file : NULL;
+
+	/* keep the symbols in the same order as parsing would */
+	for (i = 0; i < SYMBOL_HASHSIZE; i++)
+		tail[i] = &symbol_hash[i];
+	for (i = 0; i < hdr->nsym; i++) {
+		const struct cache_sym *rec = &r->syms[i];
+		struct symbol *sym = &r->sym[i];
+
+		sym->name = (char *)rd_str(r, rec->name);
+		sym->type = rec->type;
+		sym->flags = rec->flags;
+		sym->prop = rd_obj(r, prop, rec->prop);
+		sym->dir_dep.expr = rd_obj(r, expr, rec->dir_dep);
+		sym->rev_dep.expr = rd_obj(r, expr, rec->rev_dep);
+		sym->implied.expr = rd_obj(r, expr, rec->implied);
+		*tail[rec->bucket] = sym;
+		tail[rec->bucket] = &sym->next;
+	}
+
+	for (i = 0; i < hdr->nprop; i++) {
+		const struct cache_prop *rec = &r->props[i];
+		struct property *prop = &r->prop[i];
+
+		prop->next = rd_obj(r, prop, rec->next);
+		prop->sym = rd_sym(r, rec->sym);
+		prop->type = rec->type;
+		prop->text = rd_str(r, rec->text);
+		prop->visible.expr = rd_obj(r, expr, rec->visible);
+		prop->expr = rd_obj(r, expr, rec->expr);
+		prop->menu = rd_menu(r, rec->menu);
+		prop->file = rd_obj(r, file, rec->file);
+		prop->lineno = rec->lineno;
+	}
+
+	for (i = 0; i < hdr->nexpr; i++) {
+		const struct cache_expr *rec = &r->exprs[i];
+		struct expr *e = &r->expr[i];
+
+		e->type = rec->type;
+		switch (e->type) {
+		case E_SYMBOL:
+			e->left.sym = rd_sym(r, rec->left);
+			break;
+		case E_NOT:
+			e->left.expr = rd_obj(r, expr, rec->left);
+			break;
+		case E_AND:
+		case E_OR:
+			e->left.expr = rd_obj(r, expr, rec->left);
+			e->right.expr = rd_obj(r, expr, rec->right);
+			break;
+		case E_LIST:
+			e->left.expr = rd_obj(r, expr, rec->left);
+			e->right.sym = rd_sym(r, rec->right);
+			break;
+		default:
+			e->left.sym = rd_sym(r, rec->left);
+			e->right.sym = rd_sym(r, rec->right);
+		}
+	}
+
+	for (i = 0; i < hdr->nmenu; i++) {
+		const struct cache_menu *rec = &r->menus[i];
+
+		menu = rd_menu(r, i + 1);
+		menu->next = rd_menu(r, rec->next);
+		menu->parent = rd_menu(r, rec->parent);
+		menu->list = rd_menu(r, rec->list);
+		menu->sym = rd_sym(r, rec->sym);
+		menu->prompt = rd_obj(r, prop, rec->prompt);
+		menu->visibility = rd_obj(r, expr, rec->visibility);
+		menu->dep = rd_obj(r, expr, rec->dep);
+		menu->flags = rec->flags;
+		menu->help = (char *)rd_str(r, rec->help);
+		menu->file = rd_obj(r, file, rec->file);
+		menu->lineno = rec->lineno;
+	}
+
+	modules_sym = rd_sym(r, hdr->modules);
+	sym_defconfig_list = rd_sym(r, hdr->defconfig_list);
+	sym_env_list = rd_obj(r, expr, hdr->env_list);
+}
+
+bool conf_cache_load(const char *name)
+{
+	const char *path = getenv(CACHE_ENV);
+	const struct cache_header *hdr;
+	struct cache_reader r;
+	struct stat st;
+	const char *p;
+	void *map;
+	size_t size;
+	uint32_t i, hash[2];
+	int fd;
+
+	if (!path || !*path)
+		return false;
+
+	for (i = 0; i < SYMBOL_HASHSIZE; i++) {
+		if (symbol_hash[i])
+			return false;
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof(*hdr)) {
+		close(fd);
+		return false;
+	}
+	size = st.st_size;
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return false;
+
+	memset(&r, 0, sizeof(r));
+	hdr = r.hdr = map;
+	if (memcmp(hdr->magic, CACHE_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->format != cache_format_id() || hdr->size != size)
+		goto fail;
+
+	/* nothing in the body is looked at before it is known to be intact */
+	cache_hash_body(hdr + 1, size - sizeof(*hdr), hash);
+	if (hash[0] != hdr->body_hash[0] || hash[1] != hdr->body_hash[1])
+		goto fail;
+
+	/* the sections follow the header in this order */
+	p = (const char *)(hdr + 1);
+	if ((uint64_t)hdr->nfile * sizeof(*r.files) +
+	    (uint64_t)hdr->nenv * sizeof(*r.envs) +
+	    (uint64_t)hdr->nsym * sizeof(*r.syms) +
+	    (uint64_t)hdr->nprop * sizeof(*r.props) +
+	    (uint64_t)hdr->nexpr * sizeof(*r.exprs) +
+	    (uint64_t)hdr->nmenu * sizeof(*r.menus) +
+	    hdr->nstr + sizeof(*hdr) != size)
+		goto fail;
+	r.files = (const struct cache_file *)p;
+	p += hdr->nfile * sizeof(*r.files);
+	r.envs = (const struct cache_env *)p;
+	p += hdr->nenv * sizeof(*r.envs);
+	r.syms = (const struct cache_sym *)p;
+	p += hdr->nsym * sizeof(*r.syms);
+	r.props = (const struct cache_prop *)p;
+	p += hdr->nprop * sizeof(*r.props);
+	r.exprs = (const struct cache_expr *)p;
+	p += hdr->nexpr * sizeof(*r.exprs);
+	r.menus = (const struct cache_menu *)p;
+	p += hdr->nmenu * sizeof(*r.menus);
+	r.str = (char *)p;
+	if (!hdr->nstr || r.str[hdr->nstr - 1])
+		goto fail;
+
+	if (!cache_check(&r) || !cache_current(&r, name))
+		goto fail;
+
+	/* the strings stay in the mapping for the life of the tree */
+	cache_build(&r);
+	sym_build_rdeps();
+	sym_build_index();
+	sym_set_change_count(1);
+	return true;
+
+fail:
+	munmap(map, size);
+	return false;
+}
@@ -4,6 +4,7 @@
  */
 
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -193,67 +194,38 @@ static int conf_set_sym_val(struct symbol *sym, int def, int def_flags, char *p)
 	return 0;
 }
 
-#define LINE_GROWTH 16
-static int add_byte(int c, char **lineptr, size_t slen, size_t *n)
-{
-	char *nline;
-	size_t new_size = slen + 1;
-	if (new_size > *n) {
-		new_size += LINE_GROWTH - 1;
-		new_size *= 2;
-		nline = realloc(*lineptr, new_size);
-		if (!nline)
-			return -1;
-
-		*lineptr = nline;
-		*n = new_size;
-	}
-
-	(*lineptr)[slen] = c;
-
-	return 0;
-}
-
-static ssize_t compat_getline(char **lineptr, size_t *n, FILE *stream)
+/*
+ * Read all of a configuration file into one buffer, so that its lines
+ * can be found with memchr() and split in place.  The buffer has room
+ * for a NUL after the last line.
+ */
+static char *conf_read_file(FILE *in, size_t *len)
 {
-	char *line = *lineptr;
-	size_t slen = 0;
-
+	struct stat st;
+	size_t size, n = 0;
+	char *buf;
+
+	size = 4096;
+	if (!fstat(fileno(in), &st) && S_ISREG(st.st_mode) && st.st_size > 0)
+		size = st.st_size + 1;
+	buf = xmalloc(size);
 	for (;;) {
-		int c = getc(stream);
-
-		switch (c) {
-		case '\n':
-			if (add_byte(c, &line, slen, n) < 0)
-				goto e_out;
-			slen++;
-			/* fall through */
-		case EOF:
-			if (add_byte('\0', &line, slen, n) < 0)
-				goto e_out;
-			*lineptr = line;
-			if (slen == 0)
-				return -1;
-			return slen;
-		default:
-			if (add_byte(c, &line, slen, n) < 0)
-				goto e_out;
-			slen++;
-		}
+		n += fread(buf + n, 1, size - n, in);
+		if (n < size)
+			break;
+		size *= 2;
+		buf = xrealloc(buf, size);
 	}
-
-e_out:
-	line[slen-1] = '\0';
-	*lineptr = line;
-	return -1;
+	*len = n;
+	return buf;
 }
 
 int conf_read_simple(const char *name, int def)
 {
 	FILE *in = NULL;
-	char   *line = NULL;
-	size_t  line_asize = 0;
-	char *p, *p2;
+	char *buf, *line, *next, *end;
+	size_t len;
+	char *p;
 	struct symbol *sym;
 	int i, def_flags;
 
@@ -311,11 +283,21 @@ load:
 		}
 	}
 
-	while (compat_getline(&line, &line_asize, in) != -1) {
+	buf = conf_read_file(in, &len);
+	fclose(in);
+
+	for (line = buf; line < buf + len; line = next) {
+		end = memchr(line, '\n', buf + len - line);
+		if (!end)
+			end = buf + len;
+		next = end + 1;
+		if (end > line && end[-1] == '\r')
+			end--;
+		*end = 0;
 		conf_lineno++;
 		sym = NULL;
 		if (line[0] == '#') {
-			if (memcmp(line + 2, CONFIG_, strlen(CONFIG_)))
+			if (!line[1] || strncmp(line + 2, CONFIG_, strlen(CONFIG_)))
 				continue;
 			p = strchr(line + 2 + strlen(CONFIG_), ' ');
 			if (!p)
@@ -346,17 +328,11 @@ load:
 			default:
 				;
 			}
-		} else if (memcmp(line, CONFIG_, strlen(CONFIG_)) == 0) {
+		} else if (strncmp(line, CONFIG_, strlen(CONFIG_)) == 0) {
 			p = strchr(line + strlen(CONFIG_), '=');
 			if (!p)
 				continue;
 			*p++ = 0;
-			p2 = strchr(p, '\n');
-			if (p2) {
-				*p2-- = 0;
-				if (*p2 == '\r')
-					*p2 = 0;
-			}
 			if (def == S_DEF_USER) {
 				sym = sym_find(line + strlen(CONFIG_));
 				if (!sym) {
@@ -374,9 +350,8 @@ load:
 			if (conf_set_sym_val(sym, def, def_flags, p))
 				continue;
 		} else {
-			if (line[0] != '\r' && line[0] != '\n')
-				conf_warning("unexpected data: %.*s",
-					     (int)strcspn(line, "\r\n"), line);
+			if (line[0])
+				conf_warning("unexpected data: %s", line);
 
 			continue;
 		}
@@ -401,11 +376,63 @@ setsym:
 			cs->def[def].tri = EXPR_OR(cs->def[def].tri, sym->def[def].tri);
 		}
 	}
-	free(line);
-	fclose(in);
+	free(buf);
 	return 0;
 }
 
+/*
+ * The symbol state right after parsing.  conf_reset() restores it, so
+ * that several configurations can be processed one after the other, each
+ * as if it had been read into a freshly parsed tree.
+ */
+struct conf_saved_sym {
+	struct symbol *sym;
+	struct symbol_value curr;
+	tristate visible, dir_dep, rev_dep, implied;
+	int flags;
+};
+
+static struct conf_saved_sym *conf_saved;
+static int conf_saved_cnt;
+static tristate conf_saved_modules;
+
+void conf_reset(void)
+{
+	struct conf_saved_sym *s;
+	struct symbol *sym;
+	int i;
+
+	if (!conf_saved) {
+		for_all_symbols(i, sym)
+			conf_saved_cnt++;
+		conf_saved = xcalloc(conf_saved_cnt, sizeof(*conf_saved));
+		s = conf_saved;
+		for_all_symbols(i, sym) {
+			s->sym = sym;
+			s->curr = sym->curr;
+			s->visible = sym->visible;
+			s->dir_dep = sym->dir_dep.tri;
+			s->rev_dep = sym->rev_dep.tri;
+			s->implied = sym->implied.tri;
+			s->flags = sym->flags;
+			s++;
+		}
+		conf_saved_modules = modules_val;
+		return;
+	}
+
+	for (s = conf_saved; s < conf_saved + conf_saved_cnt; s++) {
+		sym = s->sym;
+		sym->curr = s->curr;
+		sym->visible = s->visible;
+		sym->dir_dep.tri = s->dir_dep;
+		sym->rev_dep.tri = s->rev_dep;
+		sym->implied.tri = s->implied;
+		sym->flags = s->flags;
+	}
+	modules_val = conf_saved_modules;
+}
+
 int conf_read(const char *name)
 {
 	struct symbol *sym;
@@ -838,23 +865,103 @@ next:
 	return 0;
 }
 
+/*
+ * Touch every nth file of the list, starting with the first one.  This
+ * also runs in forked workers, so only async-signal-safe calls are made.
+ */
+static int conf_touch_split(char **path, int cnt, int first, int nth)
+{
+	struct stat sb;
+	char *d;
+	int i, fd;
+
+	for (i = first; i < cnt; i += nth) {
+		/* Assume directory path already exists. */
+		fd = open(path[i], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd == -1) {
+			if (errno != ENOENT)
+				return 1;
+			/*
+			 * Create directory components,
+			 * unless they exist already.
+			 */
+			d = path[i];
+			while ((d = strchr(d, '/'))) {
+				*d = 0;
+				if (stat(path[i], &sb) && mkdir(path[i], 0755) &&
+				    errno != EEXIST)
+					return 1;
+				*d++ = '/';
+			}
+			/* Try it again. */
+			fd = open(path[i], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (fd == -1)
+				return 1;
+		}
+		close(fd);
+	}
+	return 0;
+}
+
+/*
+ * Files per worker below which touching them isn't worth forking for, and
+ * the most workers used.
+ */
+#define SPLIT_FILES_PER_JOB	256
+#define SPLIT_MAX_JOBS		8
+
+static int conf_touch_split_all(char **path, int cnt)
+{
+	pid_t pids[SPLIT_MAX_JOBS];
+	int jobs, job, i, status, res = 0;
+	long cpus;
+	pid_t pid;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	jobs = cnt / SPLIT_FILES_PER_JOB;
+	if (jobs > cpus)
+		jobs = cpus;
+	if (jobs > SPLIT_MAX_JOBS)
+		jobs = SPLIT_MAX_JOBS;
+	if (jobs <= 1)
+		return conf_touch_split(path, cnt, 0, 1);
+
+	fflush(NULL);
+	for (job = 1; job < jobs; job++) {
+		pids[job] = fork();
+		if (pids[job] < 0)
+			break;
+		if (!pids[job])
+			_exit(conf_touch_split(path, cnt, job, jobs));
+	}
+	/* this process takes the first share and those of failed forks */
+	res = conf_touch_split(path, cnt, 0, jobs);
+	for (i = job; i < jobs; i++)
+		res |= conf_touch_split(path, cnt, i, jobs);
+	/* reap only our own workers, any other child is the caller's */
+	while (--job > 0) {
+		do
+			pid = waitpid(pids[job], &status, 0);
+		while (pid < 0 && errno == EINTR);
+		if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+			res = 1;
+	}
+	return res;
+}
+
 static int conf_split_config(void)
 {
 	const char *name;
-	char path[PATH_MAX+1];
+	char **path = NULL;
 	char *s, *d, c;
 	struct symbol *sym;
-	struct stat sb;
-	int res, i, fd;
+	int res, i, cnt = 0, size = 0;
 
 	name = conf_get_autoconfig_name();
 	conf_read_simple(name, S_DEF_AUTO);
 	sym_calc_value(modules_sym);
 
-	if (chdir("include/config"))
-		return 1;
-
-	res = 0;
+	/* First collect the files of the changed symbols, then touch them. */
 	for_all_symbols(i, sym) {
 		sym_calc_value(sym);
 		if ((sym->flags & SYMBOL_AUTO) || !sym->name)
@@ -906,48 +1013,32 @@ static int conf_split_config(void)
 		 *	different from 'no').
 		 */
 
+		if (cnt == size) {
+			size = size ? 2 * size : 64;
+			path = xrealloc(path, size * sizeof(*path));
+		}
 		/* Replace all '_' and append ".h" */
+		path[cnt] = d = xmalloc(strlen(sym->name) + 3);
 		s = sym->name;
-		d = path;
 		while ((c = *s++)) {
 			c = tolower(c);
 			*d++ = (c == '_') ? '/' : c;
 		}
 		strcpy(d, ".h");
+		cnt++;
+	}
 
-		/* Assume directory path already exists. */
-		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-		if (fd == -1) {
-			if (errno != ENOENT) {
-				res = 1;
-				break;
-			}
-			/*
-			 * Create directory components,
-			 * unless they exist already.
-			 */
-			d = path;
-			while ((d = strchr(d, '/'))) {
-				*d = 0;
-				if (stat(path, &sb) && mkdir(path, 0755)) {
-					res = 1;
-					goto out;
-				}
-				*d++ = '/';
-			}
-			/* Try it again. */
-			fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-			if (fd == -1) {
-				res = 1;
-				break;
-			}
-		}
-		close(fd);
+	if (chdir("include/config"))
+		res = 1;
+	else {
+		res = conf_touch_split_all(path, cnt);
+		if (chdir("../.."))
+			res = 1;
 	}
-out:
-	if (chdir("../.."))
-		return 1;
 
+	for (i = 0; i < cnt; i++)
+		free(path[i]);
+	free(path);
 	return res;
 }
 
@@ -14,9 +14,29 @@
 static int expr_eq(struct expr *e1, struct expr *e2);
 static struct expr *expr_eliminate_yn(struct expr *e);
 
+/* nodes given back by expr_free() are reused before the pool is touched */
+static struct expr *expr_free_list;
+
+static struct expr *expr_alloc(void)
+{
+	struct expr *e = expr_free_list;
+
+	if (!e)
+		return pool_alloc(sizeof(*e));
+	expr_free_list = e->left.expr;
+	memset(e, 0, sizeof(*e));
+	return e;
+}
+
+static void expr_free_node(struct expr *e)
+{
+	e->left.expr = expr_free_list;
+	expr_free_list = e;
+}
+
 struct expr *expr_alloc_symbol(struct symbol *sym)
 {
-	struct expr *e = xcalloc(1, sizeof(*e));
+	struct expr *e = expr_alloc();
 	e->type = E_SYMBOL;
 	e->left.sym = sym;
 	return e;
@@ -24,7 +44,7 @@ struct expr *expr_alloc_symbol(struct symbol *sym)
 
 struct expr *expr_alloc_one(enum expr_type type, struct expr *ce)
 {
-	struct expr *e = xcalloc(1, sizeof(*e));
+	struct expr *e = expr_alloc();
 	e->type = type;
 	e->left.expr = ce;
 	return e;
@@ -32,7 +52,7 @@ struct expr *expr_alloc_one(enum expr_type type, struct expr *ce)
 
 struct expr *expr_alloc_two(enum expr_type type, struct expr *e1, struct expr *e2)
 {
-	struct expr *e = xcalloc(1, sizeof(*e));
+	struct expr *e = expr_alloc();
 	e->type = type;
 	e->left.expr = e1;
 	e->right.expr = e2;
@@ -41,7 +61,7 @@ struct expr *expr_alloc_two(enum expr_type type, struct expr *e1, struct expr *e
 
 struct expr *expr_alloc_comp(enum expr_type type, struct symbol *s1, struct symbol *s2)
 {
-	struct expr *e = xcalloc(1, sizeof(*e));
+	struct expr *e = expr_alloc();
 	e->type = type;
 	e->left.sym = s1;
 	e->right.sym = s2;
@@ -69,7 +89,7 @@ struct expr *expr_copy(const struct expr *org)
 	if (!org)
 		return NULL;
 
-	e = xmalloc(sizeof(*org));
+	e = expr_alloc();
 	memcpy(e, org, sizeof(*org));
 	switch (org->type) {
 	case E_SYMBOL:
@@ -95,7 +115,7 @@ struct expr *expr_copy(const struct expr *org)
 		break;
 	default:
 		printf("can't copy type %d\n", e->type);
-		free(e);
+		expr_free_node(e);
 		e = NULL;
 		break;
 	}
@@ -113,7 +133,7 @@ void expr_free(struct expr *e)
 		break;
 	case E_NOT:
 		expr_free(e->left.expr);
-		return;
+		break;
 	case E_EQUAL:
 	case E_GEQ:
 	case E_GTH:
@@ -130,10 +150,11 @@ void expr_free(struct expr *e)
 		printf("how to free type %d?\n", e->type);
 		break;
 	}
-	free(e);
+	expr_free_node(e);
 }
 
 static int trans_count;
+static unsigned int dups_pass;
 
 #define e1 (*ep1)
 #define e2 (*ep2)
@@ -197,6 +218,55 @@ void expr_eliminate_eq(struct expr **ep1, struct expr **ep2)
 #undef e1
 #undef e2
 
+/*
+ * Add up the symbols of all leaves, or return false if there is a leaf
+ * expr_eliminate_yn() could act on.
+ */
+static bool expr_leaf_sig(struct expr *e, unsigned long *sig, int *cnt)
+{
+	switch (e->type) {
+	case E_SYMBOL:
+		if (e->left.sym == &symbol_yes || e->left.sym == &symbol_no)
+			return false;
+		*sig += ((unsigned long)e->left.sym >> 4) * 0x9e3779b1;
+		(*cnt)++;
+		return true;
+	case E_NOT:
+		return expr_leaf_sig(e->left.expr, sig, cnt);
+	case E_AND:
+	case E_OR:
+		return expr_leaf_sig(e->left.expr, sig, cnt) &&
+		       expr_leaf_sig(e->right.expr, sig, cnt);
+	case E_EQUAL:
+	case E_GEQ:
+	case E_GTH:
+	case E_LEQ:
+	case E_LTH:
+	case E_UNEQUAL:
+		*sig += ((unsigned long)e->left.sym >> 4) * 0x9e3779b1;
+		*sig += ((unsigned long)e->right.sym >> 4) * 0x7feb352d;
+		(*cnt)++;
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Without 'y' or 'n' operands, two AND/OR trees are only equal if every
+ * operand of one is matched by an equal operand of the other, so both
+ * must have the same leaves.  This is much cheaper than copying them.
+ */
+static bool expr_leaves_differ(struct expr *e1, struct expr *e2)
+{
+	unsigned long sig1 = 0, sig2 = 0;
+	int cnt1 = 0, cnt2 = 0;
+
+	if (!expr_leaf_sig(e1, &sig1, &cnt1) || !expr_leaf_sig(e2, &sig2, &cnt2))
+		return false;
+	return sig1 != sig2 || cnt1 != cnt2;
+}
+
 static int expr_eq(struct expr *e1, struct expr *e2)
 {
 	int res, old_count;
@@ -217,6 +287,8 @@ static int expr_eq(struct expr *e1, struct expr *e2)
 		return expr_eq(e1->left.expr, e2->left.expr);
 	case E_AND:
 	case E_OR:
+		if (expr_leaves_differ(e1, e2))
+			return 0;
 		e1 = expr_copy(e1);
 		e2 = expr_copy(e2);
 		old_count = trans_count;
@@ -260,10 +332,10 @@ static struct expr *expr_eliminate_yn(struct expr *e)
 				e->right.expr = NULL;
 				return e;
 			} else if (e->left.expr->left.sym == &symbol_yes) {
-				free(e->left.expr);
+				expr_free_node(e->left.expr);
 				tmp = e->right.expr;
 				*e = *(e->right.expr);
-				free(tmp);
+				expr_free_node(tmp);
 				return e;
 			}
 		}
@@ -276,10 +348,10 @@ static struct expr *expr_eliminate_yn(struct expr *e)
 				e->right.expr = NULL;
 				return e;
 			} else if (e->right.expr->left.sym == &symbol_yes) {
-				free(e->right.expr);
+				expr_free_node(e->right.expr);
 				tmp = e->left.expr;
 				*e = *(e->left.expr);
-				free(tmp);
+				expr_free_node(tmp);
 				return e;
 			}
 		}
@@ -289,10 +361,10 @@ static struct expr *expr_eliminate_yn(struct expr *e)
 		e->right.expr = expr_eliminate_yn(e->right.expr);
 		if (e->left.expr->type == E_SYMBOL) {
 			if (e->left.expr->left.sym == &symbol_no) {
-				free(e->left.expr);
+				expr_free_node(e->left.expr);
 				tmp = e->right.expr;
 				*e = *(e->right.expr);
-				free(tmp);
+				expr_free_node(tmp);
 				return e;
 			} else if (e->left.expr->left.sym == &symbol_yes) {
 				expr_free(e->left.expr);
@@ -305,10 +377,10 @@ static struct expr *expr_eliminate_yn(struct expr *e)
 		}
 		if (e->right.expr->type == E_SYMBOL) {
 			if (e->right.expr->left.sym == &symbol_no) {
-				free(e->right.expr);
+				expr_free_node(e->right.expr);
 				tmp = e->left.expr;
 				*e = *(e->left.expr);
-				free(tmp);
+				expr_free_node(tmp);
 				return e;
 			} else if (e->right.expr->left.sym == &symbol_yes) {
 				expr_free(e->left.expr);
@@ -537,7 +609,14 @@ static void expr_eliminate_dups1(enum expr_type type, struct expr **ep1, struct
 
 	switch (e1->type) {
 	case E_OR: case E_AND:
-		expr_eliminate_dups1(e1->type, &e1, &e1);
+		/* an operand is only changed by joins, don't rescan it */
+		if (e1->dups_pass != dups_pass) {
+			int old_count = trans_count;
+
+			expr_eliminate_dups1(e1->type, &e1, &e1);
+			if (trans_count == old_count)
+				e1->dups_pass = dups_pass;
+		}
 	default:
 		;
 	}
@@ -577,6 +656,7 @@ struct expr *expr_eliminate_dups(struct expr *e)
 	oldcount = trans_count;
 	while (1) {
 		trans_count = 0;
+		dups_pass++;
 		switch (e->type) {
 		case E_OR: case E_AND:
 			expr_eliminate_dups1(e->type, &e, &e);
@@ -662,8 +742,8 @@ struct expr *expr_transform(struct expr *e)
 		case E_NOT:
 			// !!a -> a
 			tmp = e->left.expr->left.expr;
-			free(e->left.expr);
-			free(e);
+			expr_free_node(e->left.expr);
+			expr_free_node(e);
 			e = tmp;
 			e = expr_transform(e);
 			break;
@@ -671,7 +751,7 @@ struct expr *expr_transform(struct expr *e)
 		case E_UNEQUAL:
 			// !a='x' -> a!='x'
 			tmp = e->left.expr;
-			free(e);
+			expr_free_node(e);
 			e = tmp;
 			e->type = e->type == E_EQUAL ? E_UNEQUAL : E_EQUAL;
 			break;
@@ -679,7 +759,7 @@ struct expr *expr_transform(struct expr *e)
 		case E_GEQ:
 			// !a<='x' -> a>'x'
 			tmp = e->left.expr;
-			free(e);
+			expr_free_node(e);
 			e = tmp;
 			e->type = e->type == E_LEQ ? E_GTH : E_LTH;
 			break;
@@ -687,7 +767,7 @@ struct expr *expr_transform(struct expr *e)
 		case E_GTH:
 			// !a<'x' -> a>='x'
 			tmp = e->left.expr;
-			free(e);
+			expr_free_node(e);
 			e = tmp;
 			e->type = e->type == E_LTH ? E_GEQ : E_LEQ;
 			break;
@@ -713,7 +793,7 @@ struct expr *expr_transform(struct expr *e)
 			if (e->left.expr->left.sym == &symbol_yes) {
 				// !'y' -> 'n'
 				tmp = e->left.expr;
-				free(e);
+				expr_free_node(e);
 				e = tmp;
 				e->type = E_SYMBOL;
 				e->left.sym = &symbol_no;
@@ -722,7 +802,7 @@ struct expr *expr_transform(struct expr *e)
 			if (e->left.expr->left.sym == &symbol_mod) {
 				// !'m' -> 'm'
 				tmp = e->left.expr;
-				free(e);
+				expr_free_node(e);
 				e = tmp;
 				e->type = E_SYMBOL;
 				e->left.sym = &symbol_mod;
@@ -731,7 +811,7 @@ struct expr *expr_transform(struct expr *e)
 			if (e->left.expr->left.sym == &symbol_no) {
 				// !'n' -> 'y'
 				tmp = e->left.expr;
-				free(e);
+				expr_free_node(e);
 				e = tmp;
 				e->type = E_SYMBOL;
 				e->left.sym = &symbol_yes;
@@ -927,7 +1007,9 @@ tristate expr_calc_value(struct expr *e)
 
 	switch (e->type) {
 	case E_SYMBOL:
-		sym_calc_value(e->left.sym);
+		/* most leaves are already valid, skip the call for them */
+		if (!(e->left.sym->flags & SYMBOL_VALID))
+			sym_calc_value(e->left.sym);
 		return e->left.sym->curr.tri;
 	case E_AND:
 		val1 = expr_calc_value(e->left.expr);
@@ -41,6 +41,8 @@ union expr_data {
 
 struct expr {
 	enum expr_type type;
+	/* expr_eliminate_dups() pass that found nothing to join in it */
+	unsigned int dups_pass;
 	union expr_data left, right;
 };
 
@@ -86,11 +88,14 @@ struct symbol {
 	struct expr_value dir_dep;
 	struct expr_value rev_dep;
 	struct expr_value implied;
+	struct symbol **rdeps;		/* symbols calculated from this one */
+	int rdep_count;
 };
 
 #define for_all_symbols(i, sym) for (i = 0; i < SYMBOL_HASHSIZE; i++) for (sym = symbol_hash[i]; sym; sym = sym->next) if (sym->type != S_OTHER)
 
 #define SYMBOL_CONST      0x0001  /* symbol is const */
+#define SYMBOL_RDEP       0x0004  /* used while invalidating dependents */
 #define SYMBOL_CHECK      0x0008  /* used during dependency checking */
 #define SYMBOL_CHOICE     0x0010  /* start of a choice block (null name) */
 #define SYMBOL_CHOICEVAL  0x0020  /* used as a value in a choice block */
@@ -199,6 +204,7 @@ struct file *lookup_file(const char *name);
 
 extern struct symbol symbol_yes, symbol_no, symbol_mod;
 extern struct symbol *modules_sym;
+extern tristate modules_val;
 extern struct symbol *sym_defconfig_list;
 extern int cdebug;
 struct expr *expr_alloc_symbol(struct symbol *sym);
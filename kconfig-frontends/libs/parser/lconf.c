@@ -838,9 +838,10 @@ static void append_string(const char *str, int size)
 	text[text_size] = 0;
 }
 
+/* words are small and often kept, take them from the parser pool */
 static void alloc_string(const char *str, int size)
 {
-	text = xmalloc(size + 1);
+	text = pool_alloc(size + 1);
 	memcpy(text, str, size);
 	text[size] = 0;
 }
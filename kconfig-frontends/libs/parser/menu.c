@@ -48,8 +48,7 @@ void menu_add_entry(struct symbol *sym)
 {
 	struct menu *menu;
 
-	menu = xmalloc(sizeof(*menu));
-	memset(menu, 0, sizeof(*menu));
+	menu = pool_alloc(sizeof(*menu));
 	menu->sym = sym;
 	menu->parent = current_menu;
 	menu->file = current_file;
@@ -449,6 +448,12 @@ void menu_finalize(struct menu *parent)
 				expr_alloc_and(parent->prompt->visible.expr,
 					expr_alloc_symbol(&symbol_mod)));
 	}
+
+	/* all dependencies are final once the whole tree is done */
+	if (parent == &rootmenu) {
+		sym_build_rdeps();
+		sym_build_index();
+	}
 }
 
 bool menu_has_prompt(struct menu *menu)
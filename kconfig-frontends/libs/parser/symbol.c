@@ -498,6 +498,141 @@ void sym_clear_all_valid(void)
 	sym_calc_value(modules_sym);
 }
 
+/*
+ * The symbols calculated from a symbol are recorded in its rdeps array
+ * once the menu tree is finalized.  Changing a user value then only has
+ * to invalidate the symbols that can depend on it, directly or not,
+ * instead of every symbol.
+ */
+static bool sym_rdeps_valid;
+
+static void sym_add_rdep(struct symbol *sym, struct symbol *dep)
+{
+	if (!sym || sym->flags & SYMBOL_CONST)
+		return;
+	/* dependents are added one at a time, so a repeat is the last one */
+	if (sym->rdep_count && sym->rdeps[sym->rdep_count - 1] == dep)
+		return;
+	if (!(sym->rdep_count % 8))
+		sym->rdeps = xrealloc(sym->rdeps,
+				      (sym->rdep_count + 8) * sizeof(*sym->rdeps));
+	sym->rdeps[sym->rdep_count++] = dep;
+}
+
+static void sym_add_expr_rdeps(struct expr *e, struct symbol *dep)
+{
+	if (!e)
+		return;
+
+	switch (e->type) {
+	case E_SYMBOL:
+		sym_add_rdep(e->left.sym, dep);
+		break;
+	case E_NOT:
+		sym_add_expr_rdeps(e->left.expr, dep);
+		break;
+	case E_AND:
+	case E_OR:
+		sym_add_expr_rdeps(e->left.expr, dep);
+		sym_add_expr_rdeps(e->right.expr, dep);
+		break;
+	case E_LIST:
+		sym_add_rdep(e->right.sym, dep);
+		sym_add_expr_rdeps(e->left.expr, dep);
+		break;
+	case E_EQUAL:
+	case E_GEQ:
+	case E_GTH:
+	case E_LEQ:
+	case E_LTH:
+	case E_UNEQUAL:
+	case E_RANGE:
+		sym_add_rdep(e->left.sym, dep);
+		sym_add_rdep(e->right.sym, dep);
+		break;
+	default:
+		;
+	}
+}
+
+void sym_build_rdeps(void)
+{
+	struct symbol *sym;
+	struct property *prop;
+	int i;
+
+	for_all_symbols(i, sym) {
+		if (sym->flags & SYMBOL_CONST)
+			continue;
+		for (prop = sym->prop; prop; prop = prop->next) {
+			sym_add_expr_rdeps(prop->visible.expr, sym);
+			/* the targets of select and imply don't affect sym */
+			if (prop->type != P_SELECT && prop->type != P_IMPLY)
+				sym_add_expr_rdeps(prop->expr, sym);
+		}
+		sym_add_expr_rdeps(sym->dir_dep.expr, sym);
+		sym_add_expr_rdeps(sym->rev_dep.expr, sym);
+		sym_add_expr_rdeps(sym->implied.expr, sym);
+		if (sym_is_choice_value(sym))
+			sym_add_rdep(prop_get_symbol(sym_get_choice_prop(sym)), sym);
+	}
+	sym_rdeps_valid = true;
+}
+
+/*
+ * Invalidate sym and all symbols depending on it.  The modules symbol
+ * affects every tristate, so changing it still invalidates everything.
+ */
+static void sym_clear_valid(struct symbol *sym)
+{
+	static struct symbol **stack;
+	static int stack_size;
+	struct symbol *dep;
+	bool all;
+	int n, i, j;
+
+	if (!sym_rdeps_valid) {
+		sym_clear_all_valid();
+		return;
+	}
+
+	n = 0;
+	if (!stack_size) {
+		stack_size = 64;
+		stack = xmalloc(stack_size * sizeof(*stack));
+	}
+	stack[n++] = sym;
+	sym->flags |= SYMBOL_RDEP;
+	for (i = 0; i < n; i++) {
+		sym = stack[i];
+		for (j = 0; j < sym->rdep_count; j++) {
+			dep = sym->rdeps[j];
+			if (dep->flags & SYMBOL_RDEP)
+				continue;
+			if (n == stack_size) {
+				stack_size *= 2;
+				stack = xrealloc(stack, stack_size * sizeof(*stack));
+			}
+			stack[n++] = dep;
+			dep->flags |= SYMBOL_RDEP;
+		}
+	}
+
+	all = false;
+	for (i = 0; i < n; i++) {
+		stack[i]->flags &= ~(SYMBOL_RDEP | SYMBOL_VALID);
+		if (stack[i] == modules_sym)
+			all = true;
+	}
+	if (all) {
+		sym_clear_all_valid();
+		return;
+	}
+
+	sym_add_change_count(1);
+	sym_calc_value(modules_sym);
+}
+
 bool sym_tristate_within_range(struct symbol *sym, tristate val)
 {
 	int type = sym_get_type(sym);
@@ -550,7 +685,7 @@ bool sym_set_tristate_value(struct symbol *sym, tristate val)
 
 	sym->def[S_DEF_USER].tri = val;
 	if (oldval != val)
-		sym_clear_all_valid();
+		sym_clear_valid(sym);
 
 	return true;
 }
@@ -707,7 +842,7 @@ bool sym_set_string_value(struct symbol *sym, const char *newval)
 
 	strcpy(val, newval);
 	free((void *)oldval);
-	sym_clear_all_valid();
+	sym_clear_valid(sym);
 
 	return true;
 }
@@ -828,10 +963,83 @@ static unsigned strhash(const char *s)
 	return hash;
 }
 
+/*
+ * sym_find() is called for every line of a .config, so once the tree is
+ * parsed, the symbols that it can return are also kept in an open
+ * addressing index with at least twice as many slots as symbols.  The
+ * full name hash and the name are kept with each entry, so that probes
+ * rarely need strcmp() and never the symbol itself.
+ */
+struct sym_index_entry {
+	unsigned hash;
+	const char *name;
+	struct symbol *sym;
+};
+
+static struct sym_index_entry *sym_index;
+static unsigned sym_index_size, sym_index_cnt;
+
+/*
+ * The names searched by sym_re_search(), upper-cased and packed one after
+ * the other, so that a search doesn't need to visit the symbols that
+ * don't match.  It is rebuilt after symbols have been added.
+ */
+static struct {
+	char *names;
+	int *off;
+	struct symbol **sym;
+	int cnt;
+	bool valid;
+} sym_search;
+
+/* a newer symbol of the same name hides the older, as in symbol_hash */
+static void sym_index_add(struct symbol *sym, unsigned hash, bool newer)
+{
+	struct sym_index_entry *e;
+	unsigned i;
+
+	for (i = hash & (sym_index_size - 1); (e = &sym_index[i])->sym;
+	     i = (i + 1) & (sym_index_size - 1)) {
+		if (e->hash == hash && !strcmp(e->name, sym->name)) {
+			if (newer)
+				e->sym = sym;
+			return;
+		}
+	}
+	e->hash = hash;
+	e->name = sym->name;
+	e->sym = sym;
+	sym_index_cnt++;
+}
+
+void sym_build_index(void)
+{
+	struct symbol *sym;
+	unsigned cnt = 0;
+	int i;
+
+	for (i = 0; i < SYMBOL_HASHSIZE; i++)
+		for (sym = symbol_hash[i]; sym; sym = sym->next)
+			cnt++;
+
+	free(sym_index);
+	for (sym_index_size = 64; sym_index_size < 2 * cnt; sym_index_size *= 2)
+		;
+	sym_index = xcalloc(sym_index_size, sizeof(*sym_index));
+	sym_index_cnt = 0;
+	for (i = 0; i < SYMBOL_HASHSIZE; i++) {
+		for (sym = symbol_hash[i]; sym; sym = sym->next) {
+			if (sym->name && !(sym->flags & SYMBOL_CONST))
+				sym_index_add(sym, strhash(sym->name), false);
+		}
+	}
+}
+
 struct symbol *sym_lookup(const char *name, int flags)
 {
 	struct symbol *symbol;
 	char *new_name;
+	unsigned full_hash = 0;
 	int hash;
 
 	if (name) {
@@ -842,7 +1050,8 @@ struct symbol *sym_lookup(const char *name, int flags)
 			case 'n': return &symbol_no;
 			}
 		}
-		hash = strhash(name) % SYMBOL_HASHSIZE;
+		full_hash = strhash(name);
+		hash = full_hash % SYMBOL_HASHSIZE;
 
 		for (symbol = symbol_hash[hash]; symbol; symbol = symbol->next) {
 			if (symbol->name &&
@@ -851,14 +1060,13 @@ struct symbol *sym_lookup(const char *name, int flags)
 				   : !(symbol->flags & (SYMBOL_CONST|SYMBOL_CHOICE))))
 				return symbol;
 		}
-		new_name = strdup(name);
+		new_name = pool_strdup(name);
 	} else {
 		new_name = NULL;
 		hash = 0;
 	}
 
-	symbol = xmalloc(sizeof(*symbol));
-	memset(symbol, 0, sizeof(*symbol));
+	symbol = pool_alloc(sizeof(*symbol));
 	symbol->name = new_name;
 	symbol->type = S_UNKNOWN;
 	symbol->flags |= flags;
@@ -866,12 +1074,22 @@ struct symbol *sym_lookup(const char *name, int flags)
 	symbol->next = symbol_hash[hash];
 	symbol_hash[hash] = symbol;
 
+	if (new_name && !(flags & SYMBOL_CONST))
+		sym_search.valid = false;
+	if (sym_index && new_name && !(flags & SYMBOL_CONST)) {
+		sym_index_add(symbol, full_hash, true);
+		if (2 * sym_index_cnt > sym_index_size)
+			sym_build_index();
+	}
+
 	return symbol;
 }
 
 struct symbol *sym_find(const char *name)
 {
 	struct symbol *symbol = NULL;
+	struct sym_index_entry *e;
+	unsigned i;
 	int hash = 0;
 
 	if (!name)
@@ -884,6 +1102,17 @@ struct symbol *sym_find(const char *name)
 		case 'n': return &symbol_no;
 		}
 	}
+	if (sym_index) {
+		unsigned full_hash = strhash(name);
+
+		for (i = full_hash & (sym_index_size - 1); (e = &sym_index[i])->sym;
+		     i = (i + 1) & (sym_index_size - 1)) {
+			if (e->hash == full_hash && !strcmp(e->name, name))
+				return e->sym;
+		}
+		return NULL;
+	}
+
 	hash = strhash(name) % SYMBOL_HASHSIZE;
 
 	for (symbol = symbol_hash[hash]; symbol; symbol = symbol->next) {
@@ -990,7 +1219,7 @@ const char *sym_escape_string_value(const char *in)
 
 struct sym_match {
 	struct symbol	*sym;
-	off_t		so, eo;
+	bool		exact;
 };
 
 /* Compare matched symbols as thus:
@@ -1012,8 +1241,8 @@ static int sym_rel_comp(const void *sym1, const void *sym2)
 	 * exactly; if this is the case, we can't decide which comes first,
 	 * and we fallback to sorting alphabetically.
 	 */
-	exact1 = (s1->eo - s1->so) == strlen(s1->sym->name);
-	exact2 = (s2->eo - s2->so) == strlen(s2->sym->name);
+	exact1 = s1->exact;
+	exact2 = s2->exact;
 	if (exact1 && !exact2)
 		return -1;
 	if (!exact1 && exact2)
@@ -1023,55 +1252,133 @@ static int sym_rel_comp(const void *sym1, const void *sym2)
 	return strcmp(s1->sym->name, s2->sym->name);
 }
 
+static void sym_search_build(void)
+{
+	struct symbol *sym;
+	size_t len = 0;
+	char *d;
+	const char *s;
+	int i, n = 0;
+
+	free(sym_search.names);
+	free(sym_search.off);
+	free(sym_search.sym);
+	for_all_symbols(i, sym) {
+		if (sym->flags & SYMBOL_CONST || !sym->name)
+			continue;
+		len += strlen(sym->name) + 1;
+		n++;
+	}
+	sym_search.names = xmalloc(len + 1);
+	sym_search.off = xmalloc((n + 1) * sizeof(*sym_search.off));
+	sym_search.sym = xmalloc((n + 1) * sizeof(*sym_search.sym));
+
+	d = sym_search.names;
+	n = 0;
+	for_all_symbols(i, sym) {
+		if (sym->flags & SYMBOL_CONST || !sym->name)
+			continue;
+		sym_search.off[n] = d - sym_search.names;
+		sym_search.sym[n++] = sym;
+		for (s = sym->name; *s; s++)
+			*d++ = toupper(*s);
+		*d++ = 0;
+	}
+	sym_search.off[n] = d - sym_search.names;
+	sym_search.cnt = n;
+	sym_search.valid = true;
+}
+
+/* Patterns without any of these match only themselves as a regex. */
+#define SYM_RE_SPECIAL	".[]()*+?{}|^$\\"
+
+/* The match is exact if the matched length is that of the name. */
+static void sym_match_add(struct sym_match **arr, int *cnt, int *size,
+			  int i, size_t len)
+{
+	struct symbol *sym = sym_search.sym[i];
+
+	if (*cnt >= *size) {
+		*size = *size ? 2 * *size : 64;
+		*arr = xrealloc(*arr, *size * sizeof(**arr));
+	}
+	sym_calc_value(sym);
+	(*arr)[*cnt].sym = sym;
+	(*arr)[*cnt].exact =
+		len == sym_search.off[i + 1] - sym_search.off[i] - 1;
+	(*cnt)++;
+}
+
 struct symbol **sym_re_search(const char *pattern)
 {
-	struct symbol *sym, **sym_arr = NULL;
+	struct symbol **sym_arr = NULL;
 	struct sym_match *sym_match_arr = NULL;
-	int i, cnt, size;
+	int i, lo, hi, cnt, size;
+	char *upper, *p, *end;
+	size_t len;
 	regex_t re;
 	regmatch_t match[1];
 
 	cnt = size = 0;
 	/* Skip if empty */
-	if (strlen(pattern) == 0)
+	len = strlen(pattern);
+	if (len == 0)
 		return NULL;
-	if (regcomp(&re, pattern, REG_EXTENDED|REG_ICASE))
-		return NULL;
-
-	for_all_symbols(i, sym) {
-		if (sym->flags & SYMBOL_CONST || !sym->name)
-			continue;
-		if (regexec(&re, sym->name, 1, match, 0))
-			continue;
-		if (cnt >= size) {
-			void *tmp;
-			size += 16;
-			tmp = realloc(sym_match_arr, size * sizeof(struct sym_match));
-			if (!tmp)
-				goto sym_re_search_free;
-			sym_match_arr = tmp;
+	if (!sym_search.valid)
+		sym_search_build();
+
+	if (strpbrk(pattern, SYM_RE_SPECIAL)) {
+		if (regcomp(&re, pattern, REG_EXTENDED|REG_ICASE))
+			return NULL;
+		for (i = 0; i < sym_search.cnt; i++) {
+			if (regexec(&re, sym_search.names + sym_search.off[i],
+				    1, match, 0))
+				continue;
+			/* As regexec returned 0, we know we have a match, so
+			 * we can use match[0].rm_[se]o without further checks
+			 */
+			sym_match_add(&sym_match_arr, &cnt, &size, i,
+				      match[0].rm_eo - match[0].rm_so);
 		}
-		sym_calc_value(sym);
-		/* As regexec returned 0, we know we have a match, so
-		 * we can use match[0].rm_[se]o without further checks
-		 */
-		sym_match_arr[cnt].so = match[0].rm_so;
-		sym_match_arr[cnt].eo = match[0].rm_eo;
-		sym_match_arr[cnt++].sym = sym;
+		regfree(&re);
+	} else {
+		/* a plain substring: scan all the names at once */
+		upper = xmalloc(len + 1);
+		for (i = 0; i <= len; i++)
+			upper[i] = toupper(pattern[i]);
+		p = sym_search.names;
+		end = sym_search.names + sym_search.off[sym_search.cnt];
+		while ((p = memchr(p, upper[0], end - p))) {
+			if (memcmp(p, upper, len)) {
+				p++;
+				continue;
+			}
+			/* find the name that p is in */
+			lo = 0;
+			hi = sym_search.cnt - 1;
+			while (lo < hi) {
+				i = (lo + hi + 1) / 2;
+				if (sym_search.off[i] <= p - sym_search.names)
+					lo = i;
+				else
+					hi = i - 1;
+			}
+			sym_match_add(&sym_match_arr, &cnt, &size, lo, len);
+			/* only the first match in each name counts */
+			p = sym_search.names + sym_search.off[lo + 1];
+		}
+		free(upper);
 	}
+
 	if (sym_match_arr) {
 		qsort(sym_match_arr, cnt, sizeof(struct sym_match), sym_rel_comp);
-		sym_arr = malloc((cnt+1) * sizeof(struct symbol));
-		if (!sym_arr)
-			goto sym_re_search_free;
+		sym_arr = xmalloc((cnt+1) * sizeof(struct symbol *));
 		for (i = 0; i < cnt; i++)
 			sym_arr[i] = sym_match_arr[i].sym;
 		sym_arr[cnt] = NULL;
 	}
-sym_re_search_free:
 	/* sym_match_arr can be NULL if no match, but free(NULL) is OK */
 	free(sym_match_arr);
-	regfree(&re);
 
 	return sym_arr;
 }
@@ -1185,6 +1492,17 @@ static void sym_check_print_recursive(struct symbol *last_sym)
 		dep_stack_remove();
 }
 
+/*
+ * Symbols are marked SYMBOL_CHECKED once their dependencies have been
+ * walked, so most leaves need no further work.
+ */
+static inline struct symbol *sym_check_leaf(struct symbol *sym)
+{
+	if ((sym->flags & (SYMBOL_CHECK | SYMBOL_CHECKED)) == SYMBOL_CHECKED)
+		return NULL;
+	return sym_check_deps(sym);
+}
+
 static struct symbol *sym_check_expr_deps(struct expr *e)
 {
 	struct symbol *sym;
@@ -1206,12 +1524,12 @@ static struct symbol *sym_check_expr_deps(struct expr *e)
 	case E_LEQ:
 	case E_LTH:
 	case E_UNEQUAL:
-		sym = sym_check_deps(e->left.sym);
+		sym = sym_check_leaf(e->left.sym);
 		if (sym)
 			return sym;
-		return sym_check_deps(e->right.sym);
+		return sym_check_leaf(e->right.sym);
 	case E_SYMBOL:
-		return sym_check_deps(e->left.sym);
+		return sym_check_leaf(e->left.sym);
 	default:
 		break;
 	}
@@ -1330,8 +1648,7 @@ struct property *prop_alloc(enum prop_type type, struct symbol *sym)
 	struct property *prop;
 	struct property **propp;
 
-	prop = xmalloc(sizeof(*prop));
-	memset(prop, 0, sizeof(*prop));
+	prop = pool_alloc(sizeof(*prop));
 	prop->type = type;
 	prop->sym = sym;
 	prop->file = current_file;
@@ -23,8 +23,7 @@ struct file *file_lookup(const char *name)
 		}
 	}
 
-	file = xmalloc(sizeof(*file));
-	memset(file, 0, sizeof(*file));
+	file = pool_alloc(sizeof(*file));
 	file->name = file_name;
 	file->next = file_list;
 	file_list = file;
@@ -145,3 +144,69 @@ void *xcalloc(size_t nmemb, size_t size)
 	fprintf(stderr, "Out of memory.\n");
 	exit(1);
 }
+
+void *xrealloc(void *p, size_t size)
+{
+	p = realloc(p, size);
+	if (p)
+		return p;
+	fprintf(stderr, "Out of memory.\n");
+	exit(1);
+}
+
+/*
+ * Objects that live as long as the parsed configuration are carved out of
+ * large zeroed chunks instead of being allocated one by one; they are
+ * never freed individually.
+ */
+#define POOL_CHUNK_SIZE	(64 * 1024)
+
+union pool_align {
+	long double	ld;
+	long long	ll;
+	void		*p;
+};
+
+struct pool_chunk {
+	struct pool_chunk *next;
+	size_t used, size;
+	union pool_align data[];
+};
+
+static struct pool_chunk *pool_chunks;
+
+void *pool_alloc(size_t size)
+{
+	struct pool_chunk *chunk = pool_chunks;
+	size_t n;
+	void *p;
+
+	n = (size + sizeof(union pool_align) - 1) / sizeof(union pool_align);
+	if (!chunk || chunk->size - chunk->used < n) {
+		/* big objects get a chunk of their own */
+		size_t cnt = POOL_CHUNK_SIZE / sizeof(union pool_align);
+
+		if (n > cnt / 4)
+			cnt = n;
+		chunk = xcalloc(1, sizeof(*chunk) + cnt * sizeof(union pool_align));
+		chunk->size = cnt;
+		if (n == cnt && pool_chunks) {
+			/* keep filling the current chunk */
+			chunk->next = pool_chunks->next;
+			pool_chunks->next = chunk;
+		} else {
+			chunk->next = pool_chunks;
+			pool_chunks = chunk;
+		}
+	}
+	p = &chunk->data[chunk->used];
+	chunk->used += n;
+	return p;
+}
+
+char *pool_strdup(const char *s)
+{
+	size_t len = strlen(s) + 1;
+
+	return memcpy(pool_alloc(len), s, len);
+}
@@ -1689,7 +1689,6 @@ yyreduce:
 		menu_add_option(id->token, (yyvsp[0].string));
 	else
 		zconfprint("warning: ignoring unknown option %s", (yyvsp[-1].string));
-	free((yyvsp[-1].string));
 }
 
     break;
@@ -2008,7 +2007,7 @@ yyreduce:
 
   case 121:
 
-    { (yyval.symbol) = sym_lookup((yyvsp[0].string), 0); free((yyvsp[0].string)); }
+    { (yyval.symbol) = sym_lookup((yyvsp[0].string), 0); }
 
     break;
 
@@ -2261,6 +2260,9 @@ void conf_parse(const char *name)
 	struct symbol *sym;
 	int i;
 
+	if (conf_cache_load(name))
+		return;
+
 	zconf_initscan(name);
 
 	sym_init();
@@ -2286,6 +2288,7 @@ void conf_parse(const char *name)
 	if (zconfnerrs)
 		exit(1);
 	sym_set_change_count(1);
+	conf_cache_save(name);
 }
 
 static const char *zconf_tokenname(int token)
@@ -2508,3 +2511,4 @@ void zconfdump(FILE *out)
 #include "expr.c"
 #include "symbol.c"
 #include "menu.c"
+#include "cache.c"
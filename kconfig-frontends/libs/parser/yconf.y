@@ -241,7 +241,6 @@ symbol_option_list:
 		menu_add_option(id->token, $3);
 	else
 		zconfprint("warning: ignoring unknown option %s", $2);
-	free($2);
 };
 
 symbol_option_arg:
@@ -491,7 +490,7 @@ expr:	  symbol				{ $$ = expr_alloc_symbol($1); }
 	| expr T_AND expr			{ $$ = expr_alloc_two(E_AND, $1, $3); }
 ;
 
-symbol:	  T_WORD	{ $$ = sym_lookup($1, 0); free($1); }
+symbol:	  T_WORD	{ $$ = sym_lookup($1, 0); }
 	| T_WORD_QUOTE	{ $$ = sym_lookup($1, SYMBOL_CONST); free($1); }
 ;
 
@@ -505,6 +504,9 @@ void conf_parse(const char *name)
 	struct symbol *sym;
 	int i;
 
+	if (conf_cache_load(name))
+		return;
+
 	zconf_initscan(name);
 
 	sym_init();
@@ -530,6 +532,7 @@ void conf_parse(const char *name)
 	if (zconfnerrs)
 		exit(1);
 	sym_set_change_count(1);
+	conf_cache_save(name);
 }
 
 static const char *zconf_tokenname(int token)
@@ -752,3 +755,4 @@ void zconfdump(FILE *out)
 #include "expr.c"
 #include "symbol.c"
 #include "menu.c"
+#include "cache.c"
@@ -122,7 +122,9 @@
 #define FIOC_REFORMAT   _FIOC(0x0002)     /* IN:  None
                                            * OUT: None
                                            */
-#define FIOC_OPTIMIZE   _FIOC(0x0003)     /* IN:  None
+#define FIOC_OPTIMIZE   _FIOC(0x0003)     /* IN:  None or, if non-zero, a bound
+                                           *      on the work performed (file
+                                           *      system specific)
                                            * OUT: None
                                            */
 #define FIOC_FILENAME   _FIOC(0x0004)     /* IN:  FAR const char ** pointer
@@ -144,6 +146,10 @@
 #define FIOCHMOD        _FIOC(0x0008)     /* IN:  New mode flags (int)
                                            * OUT: OK if successful, -ENOSYS if not
                                            */
+#define FIOC_CACHESTATS _FIOC(0x0009)     /* IN:  Location to return statistics
+                                           *      (file system specific structure)
+                                           * OUT: Block cache statistics
+                                           */
 
 /* NuttX file system ioctl definitions **************************************/
 
@@ -226,6 +232,20 @@
                                            *      the block with specific debug
                                            *      command and data.
                                            * OUT: None.  */
+#define BIOC_BULKALLOC  _BIOC(0x000C)     /* Allocate several logical sectors from
+                                           * the block device in one request.
+                                           * IN:  Pointer to the bulk allocation
+                                           *      request (the number of sectors
+                                           *      and the array to return them in)
+                                           * OUT: Number of sectors allocated is
+                                           *      updated in the request. */
+#define BIOC_FREESECTS  _BIOC(0x000D)     /* Release a list of logical sectors
+                                           * from the block device in one request.
+                                           * IN:  Pointer to the release request
+                                           *      (the number of sectors and the
+                                           *      array of sector numbers)
+                                           * OUT: None (ioctl return value provides
+                                           *      success/failure indication). */
 
 /* NuttX MTD driver ioctl definitions ***************************************/
 
@@ -41,6 +41,9 @@
  ****************************************************************************/
 
 #include <nuttx/config.h>
+
+#include <stdint.h>
+
 #include <nuttx/fs/fs.h>
 
 /****************************************************************************
@@ -85,6 +88,53 @@
 #  define CONFIG_NXFFS_TAILTHRESHOLD (8*1024)
 #endif
 
+/* The number of logical blocks held in the volume block cache.  Blocks are
+ * replaced on a least-recently-used basis.  When a forward scan of the
+ * volume misses in the cache, up to CONFIG_NXFFS_CACHE_READAHEAD following
+ * blocks are read along with the requested block.
+ */
+
+#ifndef CONFIG_NXFFS_CACHE_NBLOCKS
+#  define CONFIG_NXFFS_CACHE_NBLOCKS 4
+#endif
+
+#if CONFIG_NXFFS_CACHE_NBLOCKS < 1
+#  error "CONFIG_NXFFS_CACHE_NBLOCKS must be at least 1"
+#endif
+
+#ifndef CONFIG_NXFFS_CACHE_READAHEAD
+#  define CONFIG_NXFFS_CACHE_READAHEAD 2
+#endif
+
+#if CONFIG_NXFFS_CACHE_READAHEAD >= CONFIG_NXFFS_CACHE_NBLOCKS
+#  undef CONFIG_NXFFS_CACHE_READAHEAD
+#  define CONFIG_NXFFS_CACHE_READAHEAD (CONFIG_NXFFS_CACHE_NBLOCKS - 1)
+#endif
+
+/* When the volume is scanned at mount time (CONFIG_NXFFS_SCAN_VOLUME), the
+ * block headers of large volumes are examined by up to this many threads,
+ * each taking a contiguous range of erase blocks.  Each thread other than
+ * the caller allocates one erase block buffer.  The MTD driver must then
+ * permit concurrent reads.  1 examines the volume serially.
+ */
+
+#ifndef CONFIG_NXFFS_MOUNT_THREADS
+#  define CONFIG_NXFFS_MOUNT_THREADS 4
+#endif
+
+#if CONFIG_NXFFS_MOUNT_THREADS < 1
+#  error "CONFIG_NXFFS_MOUNT_THREADS must be at least 1"
+#endif
+
+/* With CONFIG_NXFFS_APPEND_EXTENTS, an existing file may be opened with
+ * O_APPEND and the data appended is written as an extent of the file.
+ * Extents are inodes in a state that NXFFS without this option does not
+ * know:  Such a system treats them as invalid inodes, so it does not see
+ * the appended data and its re-packing discards it.  A volume to which
+ * data has been appended must only be used with this option enabled.  It
+ * is off by default, which keeps the FLASH format unchanged.
+ */
+
 /* At present, only a single pre-allocated NXFFS volume is supported.  This
  * is because here can be only a single NXFFS volume mounted at any time.
  * This has to do with the fact that we bind to an MTD driver (instead of a
@@ -107,6 +157,21 @@
 #  endif
 #endif
 
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/* Volume block cache statistics returned by the FIOC_CACHESTATS ioctl */
+
+struct nxffs_cachestats_s
+{
+  uint32_t hits;       /* Block reads satisfied from the cache */
+  uint32_t misses;     /* Block reads that required a FLASH access */
+  uint32_t readahead;  /* Blocks read ahead of a forward scan */
+  uint32_t writes;     /* Blocks written through the cache */
+  uint16_t nblocks;    /* Number of blocks held by the cache */
+};
+
 /****************************************************************************
  * Public Function Prototypes
  ****************************************************************************/
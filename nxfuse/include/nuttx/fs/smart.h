@@ -120,6 +120,26 @@ struct smart_read_write_s
   const uint8_t *buffer;  /* Pointer to the data to write */
 };
 
+/* The following defines the information for allocating a run of logical
+ * sectors with a single BIOC_BULKALLOC request.
+ */
+
+struct smart_bulkalloc_s
+{
+  uint16_t       count;     /* Number of sectors requested / allocated */
+  FAR uint16_t  *sectors;   /* Array to receive the logical sector numbers */
+};
+
+/* The following defines the request for releasing a list of logical
+ * sectors with a single BIOC_FREESECTS request.
+ */
+
+struct smart_freesects_s
+{
+  uint16_t       count;     /* Number of sectors to release */
+  FAR uint16_t  *sectors;   /* Array of logical sector numbers to release */
+};
+
 /* The following defines the procfs data exchange interface between the
  * SMART MTD and FS layers.
  */
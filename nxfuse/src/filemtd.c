@@ -166,8 +166,7 @@ static ssize_t filemtd_write(FAR struct file_dev_s *priv, size_t offset,
         {
           /* Read more data from the file */
 
-          lseek(priv->fd, seekpos, SEEK_SET);
-          buflen = read(priv->fd, buf, sizeof(buf));
+          buflen = pread(priv->fd, buf, sizeof(buf), seekpos);
           pout = (FAR uint8_t *) buf;
         }
 
@@ -209,8 +208,7 @@ static ssize_t filemtd_write(FAR struct file_dev_s *priv, size_t offset,
 
       if (buflen == 0)
         { 
-          lseek(priv->fd, seekpos, SEEK_SET);
-          write(priv->fd, buf, sizeof(buf));
+          pwrite(priv->fd, buf, sizeof(buf), seekpos);
           seekpos += sizeof(buf);
         } 
     }
@@ -219,8 +217,7 @@ static ssize_t filemtd_write(FAR struct file_dev_s *priv, size_t offset,
 
   if (buflen != 0)
     {
-      lseek(priv->fd, seekpos, SEEK_SET);
-      write(priv->fd, buf, sizeof(buf));
+      pwrite(priv->fd, buf, sizeof(buf), seekpos);
     }
 
   return len;
@@ -234,11 +231,9 @@ static ssize_t filemtd_read(FAR struct file_dev_s *priv,
                             FAR unsigned char *buffer, size_t offsetbytes,
                              unsigned int nbytes)
 {
-  /* Set the starting location in the file */
-
-  lseek(priv->fd, priv->offset + offsetbytes, SEEK_SET);
+  /* Positioned read so concurrent readers do not share the file offset */
 
-  return read(priv->fd, buffer, nbytes);
+  return pread(priv->fd, buffer, nbytes, priv->offset + offsetbytes);
 }
 
 /****************************************************************************
@@ -283,11 +278,12 @@ static int file_erase(FAR struct mtd_dev_s *dev, off_t startblock,
 
   /* Then erase the data in the file */
 
-  lseek(priv->fd, priv->offset + offset, SEEK_SET);
+  offset += priv->offset;
   memset(buffer, CONFIG_FILEMTD_ERASESTATE, sizeof(buffer));
   while (nbytes)
     {
-      write(priv->fd, buffer, sizeof(buffer));
+      pwrite(priv->fd, buffer, sizeof(buffer), offset);
+      offset += sizeof(buffer);
       nbytes -= sizeof(buffer); 
     }
 
@@ -112,6 +112,13 @@
  *   At present, the only kind of inode support is a file.  So for now, the
  *   term file and inode are interchangeable.
  *
+ * EXTENT INODE HEADER:
+ *   Data appended to a file (O_APPEND) is written as an extent: an inode
+ *   header with the same name as the file that encloses only the new data.
+ *   The time stamp field of an extent holds the file position of its first
+ *   data byte instead.  The extents of a file follow its inode header in
+ *   FLASH in the order that they were written.
+ *
  * INODE DATA HEADER:
  *   Inode data is enclosed in a data header.  For a given inode, there
  *   is at most one inode data block per logical block.  If the inode data
@@ -120,19 +127,22 @@
  *
  * NXFFS Limitations:
  * 1. Since the files are contiguous in FLASH and since allocations always
- *    proceed toward the end of the FLASH, there can only be one file opened
- *    for writing at a time.  Multiple files may be opened for reading.
- * 2. Files may not be increased in size after they have been closed.  The
- *    O_APPEND open flag is not supported.
+ *    proceed toward the end of the FLASH, the data written to a file is
+ *    held in memory until the file is closed and is then written to FLASH
+ *    all at once.  A file being written must fit in the available memory.
+ * 2. Files may not be increased in size after they have been closed unless
+ *    CONFIG_NXFFS_APPEND_EXTENTS is enabled.  Then each open with O_APPEND
+ *    adds an extent to the file.  Extents are not understood by NXFFS
+ *    without that option (see include/nuttx/fs/nxffs.h).
  * 3. Files are always written sequential.  Seeking within a file opened for
  *    writing will not work.
  * 4. There are no directories, however, '/' may be used within a file name
  *    string providing some illusion of directories.
  * 5. Files may be opened for reading or for writing, but not both: The O_RDWR
  *    open flag is not supported.
- * 6. The re-packing process occurs only during a write when the free FLASH
- *    memory at the end of the FLASH is exhausted.  Thus, occasionally, file
- *    writing may take a long time.
+ * 6. The re-packing process occurs only when a file is written to FLASH and
+ *    the free FLASH memory at the end of the FLASH is exhausted.  Thus,
+ *    occasionally, closing a file may take a long time.
  * 7. Another limitation is that there can be only a single NXFFS volume
  *    mounted at any time.  This has to do with the fact that we bind to
  *    an MTD driver (instead of a block driver) and bypass all of the normal
@@ -156,6 +166,9 @@
 /* Values for NXFFS inode state.  Similar there are 2 (maybe 3) inode states:
  *
  * INODE_STATE_FILE    - The inode is a valid usuable, file
+ * INODE_STATE_EXTENT  - The inode holds data appended to a file.  Only
+ *                       written with CONFIG_NXFFS_APPEND_EXTENTS; NXFFS
+ *                       without extent support sees an invalid state.
  * INODE_STATE_DELETED - The inode has been deleted.
  * Other values        - The inode is bad and has an invalid state.
  *
@@ -164,6 +177,7 @@
  */
 
 #define INODE_STATE_FILE          (CONFIG_NXFFS_ERASEDSTATE ^ 0x22)
+#define INODE_STATE_EXTENT        (CONFIG_NXFFS_ERASEDSTATE ^ 0x88)
 #define INODE_STATE_DELETED       (CONFIG_NXFFS_ERASEDSTATE ^ 0xaa)
 
 /* Number of bytes in an the NXFFS magic sequences */
@@ -184,6 +198,21 @@
 
 #define NXFFS_NERASED             128
 
+/* Initial number of hash chains in the in-memory inode index.  The table
+ * doubles in size whenever the number of indexed inodes exceeds the number
+ * of chains.  Must be a power of two.
+ */
+
+#define NXFFS_INDEX_NBUCKETS      64
+
+/* A file open for reading remembers the location of every
+ * NXFFS_SKIP_INTERVAL'th data block that it passes over.  A seek backward
+ * then resumes the search for the read position at the nearest remembered
+ * data block rather than at the beginning of the file.
+ */
+
+#define NXFFS_SKIP_INTERVAL       16
+
 /* Quasi-standard definitions */
 
 #ifndef MIN
@@ -242,8 +271,67 @@ struct nxffs_entry_s
   off_t                     noffset;   /* FLASH offset to the inode name */
   off_t                     doffset;   /* FLASH offset to the first data header */
   FAR char                 *name;      /* inode name */
+  uint32_t                  utc;       /* Time stamp (extents: file position) */
+  uint32_t                  datlen;    /* Length of inode data */
+  uint32_t                  extlen;    /* Length of data in the file extents */
+  bool                      borrowed;  /* True: name is not owned by the entry */
+  bool                      extent;    /* True: The inode is a file extent */
+};
+
+/* This structure describes one extent of data appended to a file in the
+ * inode index.
+ */
+
+struct nxffs_extent_s
+{
+  off_t                     hoffset;   /* FLASH offset to the extent inode header */
+  off_t                     doffset;   /* FLASH offset to the first data header */
+  uint32_t                  fpos;      /* File position of the extent data */
+  uint32_t                  datlen;    /* Length of the extent data */
+};
+
+/* This structure describes one inode in the in-memory inode index.  It holds
+ * everything from the inode header that nxffs_findinode() reports so that a
+ * lookup needs no FLASH access.
+ */
+
+struct nxffs_idxentry_s
+{
+  FAR struct nxffs_idxentry_s *flink;  /* Next entry in the hash chain */
+  off_t                     hoffset;   /* FLASH offset to the inode header */
+  off_t                     noffset;   /* FLASH offset to the inode name */
+  off_t                     doffset;   /* FLASH offset to the first data header */
   uint32_t                  utc;       /* Time stamp */
   uint32_t                  datlen;    /* Length of inode data */
+  uint32_t                  extlen;    /* Length of data in the file extents */
+  uint32_t                  nextents;  /* Number of file extents */
+  uint32_t                  maxextents; /* Allocated size of extents[] */
+  FAR struct nxffs_extent_s *extents;  /* File extents in file position order */
+  uint32_t                  hash;      /* Hash of the inode name */
+  char                      name[1];   /* inode name (variable length) */
+};
+
+/* This structure describes the name-to-inode hash index of a volume.  If
+ * the index could not be kept current (for example, a memory allocation
+ * failed), it is marked invalid and lookups fall back to scanning FLASH.
+ */
+
+struct nxffs_index_s
+{
+  FAR struct nxffs_idxentry_s **buckets; /* Hash chains */
+  uint32_t                  nbuckets;  /* Number of hash chains */
+  uint32_t                  ninodes;   /* Number of inodes in the index */
+  bool                      valid;     /* True: The index is complete */
+};
+
+/* This structure describes one logical block held in the volume block cache.
+ * The block data for slot n begins at cbuffer + n * blocksize.
+ */
+
+struct nxffs_cslot_s
+{
+  off_t                     block;     /* Block held in the slot (-1: empty) */
+  uint32_t                  stamp;     /* Time of last use (for LRU replacement) */
 };
 
 /* This structure describes int in-memory representation of the data block */
@@ -281,6 +369,48 @@ struct nxffs_wrfile_s
   uint16_t                  datlen;     /* Number of bytes written in data block */
   off_t                     doffset;    /* FLASH offset to the current data header */
   uint32_t                  crc;        /* Accumulated data block CRC */
+
+  /* File data is staged in memory and committed to FLASH when the file is
+   * closed.
+   */
+
+  size_t                    stglen;     /* Number of bytes staged */
+  size_t                    stgsize;    /* Allocated size of the staging buffer */
+  FAR uint8_t              *stage;      /* Staged file data */
+  off_t                     reserved;   /* FLASH bytes reserved for the staged data */
+};
+
+/* This structure describes one entry in the skip index of a file opened for
+ * reading.
+ */
+
+struct nxffs_skip_s
+{
+  off_t                     fpos;       /* File position of the first data byte */
+  off_t                     hoffset;    /* FLASH offset to the data block header */
+  off_t                     segend;     /* File position at the end of its extent */
+};
+
+/* A file opened for reading remembers the data block that holds the read
+ * position so that sequential reads do not have to search for it.
+ */
+
+struct nxffs_rdfile_s
+{
+  /* The following fields provide the common open file information. */
+
+  struct nxffs_ofile_s      ofile;
+
+  /* The following fields are required to support the read operation */
+
+  bool                      valid;      /* True: blkentry and fpos are valid */
+  uint16_t                  nskip;      /* Number of entries in the skip index */
+  uint16_t                  maxskip;    /* Allocated size of the skip index */
+  uint32_t                  blkno;      /* Number of data blocks before blkentry */
+  off_t                     fpos;       /* File position of the first byte in blkentry */
+  off_t                     segend;     /* File position at the end of the blkentry extent */
+  struct nxffs_blkentry_s   blkentry;   /* The data block at the read position */
+  FAR struct nxffs_skip_s  *skip;       /* Skip index */
 };
 
 /* This structure represents the overall state of on NXFFS instance. */
@@ -289,18 +419,29 @@ struct nxffs_volume_s
 {
   FAR struct mtd_dev_s     *mtd;       /* Supports FLASH access */
   sem_t                     exclsem;   /* Used to assure thread-safe access */
-  sem_t                     wrsem;     /* Enforces single writer restriction */
   struct mtd_geometry_s     geo;       /* Device geometry */
   uint8_t                   blkper;    /* R/W blocks per erase block */
   uint16_t                  iooffset;  /* Next offset in read/write access (in ioblock) */
   off_t                     inoffset;  /* Offset to the first valid inode header */
   off_t                     froffset;  /* Offset to the first free byte */
+  off_t                     packoff;   /* Volume is packed below this offset (0: unknown) */
   off_t                     nblocks;   /* Number of R/W blocks on volume */
   off_t                     ioblock;   /* Current block number being accessed */
-  off_t                     cblock;    /* Starting block number in cache */
+  off_t                     cblock;    /* Block number in cache (current slot) */
   FAR struct nxffs_ofile_s *ofiles;    /* A singly-linked list of open files */
-  FAR uint8_t              *cache;     /* On cached erase block for general I/O */
+  FAR struct nxffs_wrfile_s *wrfile;   /* The writer being committed to FLASH */
+  FAR uint8_t              *cache;     /* Current cached block for general I/O */
+  FAR uint8_t              *cbuffer;   /* Memory for all block cache slots */
+  uint32_t                  cstamp;    /* Block cache LRU clock */
+  struct nxffs_cslot_s      cslot[CONFIG_NXFFS_CACHE_NBLOCKS];
+  struct nxffs_cachestats_s cstats;    /* Block cache statistics */
   FAR uint8_t              *pack;      /* A full erase block to support packing */
+  struct nxffs_index_s      index;     /* Name-to-inode index */
+  uint32_t                  ninodes;   /* Number of valid inodes on the volume */
+  off_t                     livebytes; /* FLASH bytes held by valid inodes */
+  off_t                     reserved;  /* FLASH bytes reserved by open writers */
+  off_t                     nbad;      /* Number of bad blocks found so far */
+  char                      scanname[CONFIG_NXFFS_MAXNAMLEN + 1]; /* Name of the last inode read */
 };
 
 /* This structure describes the state of the blocks on the NXFFS volume */
@@ -473,7 +614,9 @@ size_t nxffs_erased(FAR const uint8_t *buffer, size_t buflen);
  * Name: nxffs_rdcache
  *
  * Description:
- *   Read one I/O block into the volume cache memory.
+ *   Make one I/O block the current block in the volume cache memory.  The
+ *   block is read from FLASH only if it is not already held in the cache.
+ *   On return, volume->cache refers to the block data.
  *
  * Input Parameters:
  *   volume - Describes the current volume
@@ -489,11 +632,34 @@ size_t nxffs_erased(FAR const uint8_t *buffer, size_t buflen);
 
 int nxffs_rdcache(FAR struct nxffs_volume_s *volume, off_t block);
 
+/****************************************************************************
+ * Name: nxffs_invcache
+ *
+ * Description:
+ *   Discard any cached copies of a range of blocks.  This must be called
+ *   whenever FLASH is modified without going through nxffs_wrcache().
+ *
+ * Input Parameters:
+ *   volume  - Describes the current volume
+ *   block   - The first logical block to discard
+ *   nblocks - The number of logical blocks to discard
+ *
+ * Returned Value:
+ *   None
+ *
+ * Defined in nxffs_cache.c
+ *
+ ****************************************************************************/
+
+void nxffs_invcache(FAR struct nxffs_volume_s *volume, off_t block,
+                    off_t nblocks);
+
 /****************************************************************************
  * Name: nxffs_wrcache
  *
  * Description:
- *   Write one or more logical blocks from the volume cache memory.
+ *   Write the current block from the volume cache memory.  The cache is
+ *   write-through:  the cached copy remains valid after the write.
  *
  * Input Parameters:
  *   volume - Describes the current volume
@@ -568,13 +734,44 @@ off_t nxffs_iotell(FAR struct nxffs_volume_s *volume);
 
 int nxffs_getc(FAR struct nxffs_volume_s *volume, uint16_t reserve);
 
+/****************************************************************************
+ * Name: nxffs_scan
+ *
+ * Description:
+ *   Search forward from the current seek position for the next occurrence
+ *   of a magic sequence.  This visits the same bytes as a sequence of
+ *   nxffs_getc() calls would, but works on whole cached blocks at a time.
+ *
+ * Input Parameters:
+ *   volume  - Describes the NXFFS volume.  The search begins at the
+ *     position set by nxffs_ioseek().
+ *   magic   - The NXFFS_MAGICSIZE magic sequence to search for.
+ *   hdrsize - The size of the header that begins with the magic sequence.
+ *     Only positions where the whole header fits in the block are matched.
+ *   offset  - On success, the FLASH offset of the magic sequence.
+ *
+ * Returned Value:
+ *   Zero is returned on success, leaving the seek position just after the
+ *   magic sequence.  -ENOENT is returned if NXFFS_NERASED consecutive erased
+ *   bytes are found first, and -ENOSPC if the end of FLASH is reached.
+ *   Other negated errno values indicate read failures.
+ *
+ * Defined in nxffs_cache.c
+ *
+ ****************************************************************************/
+
+int nxffs_scan(FAR struct nxffs_volume_s *volume, FAR const uint8_t *magic,
+               uint16_t hdrsize, FAR off_t *offset);
+
 /****************************************************************************
  * Name: nxffs_freeentry
  *
  * Description:
- *   The inode values returned by nxffs_nextentry() include allocated memory
- *   (specifically, the file name string).  This function should be called
- *   to dispose of that memory when the inode entry is no longer needed.
+ *   An inode entry may include allocated memory (specifically, the file
+ *   name string).  This function should be called to dispose of that
+ *   memory when the inode entry is no longer needed.  Entries returned by
+ *   nxffs_nextentry() and nxffs_findinode() only borrow the name; nothing
+ *   is freed for them.
  *
  *   Note that the nxffs_entry_s containing structure is not freed.  The
  *   caller may call kmm_free upon return of this function if necessary to
@@ -597,6 +794,10 @@ void nxffs_freeentry(FAR struct nxffs_entry_s *entry);
  *
  * Description:
  *   Search for the next valid inode starting at the provided FLASH offset.
+ *   The name in the returned entry is borrowed from the volume and is only
+ *   valid until the next inode is read.  File extents are returned as well
+ *   (with entry->extent set); callers interested only in files must skip
+ *   them.
  *
  * Input Parameters:
  *   volume - Describes the NXFFS volume.
@@ -621,7 +822,10 @@ int nxffs_nextentry(FAR struct nxffs_volume_s *volume, off_t offset,
  * Description:
  *   Search for an inode with the provided name starting with the first
  *   valid inode and proceeding to the end FLASH or until the matching
- *   inode is found.
+ *   inode is found.  The name in the returned entry is borrowed and is
+ *   only valid until the volume is next modified or scanned; callers that
+ *   keep the entry must make their own copy.  entry->extlen is the length
+ *   of all data appended to the file in extents.
  *
  * Input Parameters:
  *   volume - Describes the NXFFS volume
@@ -639,6 +843,35 @@ int nxffs_nextentry(FAR struct nxffs_volume_s *volume, off_t offset,
 int nxffs_findinode(FAR struct nxffs_volume_s *volume, FAR const char *name,
                     FAR struct nxffs_entry_s *entry);
 
+/****************************************************************************
+ * Name: nxffs_findextent
+ *
+ * Description:
+ *   Find the extent of a file that begins at the provided file position.
+ *   The index is used if it is valid; otherwise FLASH is searched starting
+ *   at the provided offset.
+ *
+ * Input Parameters:
+ *   volume - Describes the NXFFS volume
+ *   name   - The name of the file.  This must not be the volume scan name
+ *     buffer that is overwritten by the search.
+ *   offset - The FLASH offset to start searching at (the file inode header
+ *     or any earlier extent of the file).
+ *   fpos   - The file position of the first byte in the extent.
+ *   extent - The location to return information about the extent.
+ *
+ * Returned Value:
+ *   Zero is returned on success. Otherwise, a negated errno is returned
+ *   that indicates the nature of the failure.
+ *
+ * Defined in nxffs_inode.c
+ *
+ ****************************************************************************/
+
+int nxffs_findextent(FAR struct nxffs_volume_s *volume, FAR const char *name,
+                     off_t offset, uint32_t fpos,
+                     FAR struct nxffs_entry_s *extent);
+
 /****************************************************************************
  * Name: nxffs_inodeend
  *
@@ -666,6 +899,161 @@ int nxffs_findinode(FAR struct nxffs_volume_s *volume, FAR const char *name,
 off_t nxffs_inodeend(FAR struct nxffs_volume_s *volume,
                      FAR struct nxffs_entry_s *entry);
 
+/****************************************************************************
+ * Name: nxffs_inodesize
+ *
+ * Description:
+ *   Return the *approximate* number of FLASH bytes occupied by an inode:
+ *   The inode header, the inode name, and the inode data with its data
+ *   block headers.  This is used to keep the volume space accounting
+ *   current without scanning FLASH.
+ *
+ * Input Parameters:
+ *   volume - Describes the NXFFS volume
+ *   entry  - Describes the inode.
+ *
+ * Returned Value:
+ *   The (approximate) size of the inode in FLASH.  No errors are detected.
+ *
+ * Defined in nxffs_inode.c
+ *
+ ****************************************************************************/
+
+off_t nxffs_inodesize(FAR struct nxffs_volume_s *volume,
+                      FAR struct nxffs_entry_s *entry);
+
+/****************************************************************************
+ * Name: nxffs_idxreset
+ *
+ * Description:
+ *   Discard all entries in the inode index and mark it valid.  Called when
+ *   the index is about to be rebuilt from FLASH or when the volume has been
+ *   reformatted and is known to be empty.
+ *
+ * Input Parameters:
+ *   volume - Describes the NXFFS volume
+ *
+ * Returned Value:
+ *   None
+ *
+ * Defined in nxffs_index.c
+ *
+ ****************************************************************************/
+
+void nxffs_idxreset(FAR struct nxffs_volume_s *volume);
+
+/****************************************************************************
+ * Name: nxffs_idxinvalidate
+ *
+ * Description:
+ *   Discard all entries in the inode index and mark it invalid.  Lookups
+ *   will scan FLASH until the index is rebuilt by nxffs_limits().
+ *
+ * Input Parameters:
+ *   volume - Describes the NXFFS volume
+ *
+ * Returned Value:
+ *   None
+ *
+ * Defined in nxffs_index.c
+ *
+ ****************************************************************************/
+
+void nxffs_idxinvalidate(FAR struct nxffs_volume_s *volume);
+
+/****************************************************************************
+ * Name: nxffs_idxinsert
+ *
+ * Description:
+ *   Add an inode to the index, replacing any entry with the same name.  The
+ *   extents of an entry that is replaced are kept.  An extent is added to
+ *   the file that it continues or, if it was moved, replaces the extent at
+ *   the same file position.
+ *
+ * Input Parameters:
+ *   volume - Describes the NXFFS volume
+ *   entry  - Describes the inode as written to FLASH
+ *
+ * Returned Value:
+ *   Zero on success.  -ENOENT if the entry is an extent that does not
+ *   belong to any file in the index.  On other failures, the index is
+ *   invalidated and a negated errno value is returned.
+ *
+ * Defined in nxffs_index.c
+ *
+ ****************************************************************************/
+
+int nxffs_idxinsert(FAR struct nxffs_volume_s *volume,
+                    FAR const struct nxffs_entry_s *entry);
+
+/****************************************************************************
+ * Name: nxffs_idxremove
+ *
+ * Description:
+ *   Remove the inode with the provided name from the index.
+ *
+ * Input Parameters:
+ *   volume - Describes the NXFFS volume
+ *   name   - The name of the inode to remove
+ *
+ * Returned Value:
+ *   None
+ *
+ * Defined in nxffs_index.c
+ *
+ ****************************************************************************/
+
+void nxffs_idxremove(FAR struct nxffs_volume_s *volume, FAR const char *name);
+
+/****************************************************************************
+ * Name: nxffs_idxfind
+ *
+ * Description:
+ *   Look up an inode by name in the index.
+ *
+ * Input Parameters:
+ *   volume - Describes the NXFFS volume
+ *   name   - The name of the inode to find
+ *   entry  - The location to return information about the inode.  May be
+ *     NULL if only the existence of the inode is of interest.  The name
+ *     returned in the entry is borrowed from the index.
+ *
+ * Returned Value:
+ *   Zero if the inode was found, -ENOENT if it does not exist, or -ENOSYS
+ *   if the index is not valid and FLASH must be searched instead.
+ *
+ * Defined in nxffs_index.c
+ *
+ ****************************************************************************/
+
+int nxffs_idxfind(FAR struct nxffs_volume_s *volume, FAR const char *name,
+                  FAR struct nxffs_entry_s *entry);
+
+/****************************************************************************
+ * Name: nxffs_idxextent
+ *
+ * Description:
+ *   Look up the extent of a file that begins at the provided file position
+ *   in the index.
+ *
+ * Input Parameters:
+ *   volume - Describes the NXFFS volume
+ *   name   - The name of the file
+ *   fpos   - The file position of the first byte in the extent
+ *   extent - The location to return information about the extent.  May be
+ *     NULL if only the existence of the extent is of interest.
+ *
+ * Returned Value:
+ *   Zero if the extent was found, -ENOENT if it does not exist, or -ENOSYS
+ *   if the index is not valid and FLASH must be searched instead.
+ *
+ * Defined in nxffs_index.c
+ *
+ ****************************************************************************/
+
+int nxffs_idxextent(FAR struct nxffs_volume_s *volume, FAR const char *name,
+                    uint32_t fpos, FAR struct nxffs_entry_s *extent);
+
 /****************************************************************************
  * Name: nxffs_verifyblock
  *
@@ -807,14 +1195,15 @@ FAR struct nxffs_ofile_s *nxffs_findofile(FAR struct nxffs_volume_s *volume,
  * Name: nxffs_findwriter
  *
  * Description:
- *   Search the list of already opened files and return the open file
- *   instance for the write.
+ *   Return the open file instance of the writer whose data is currently
+ *   being committed to FLASH.  Other writers hold their data in memory and
+ *   have nothing on FLASH.
  *
  * Input Parameters:
  *   volume - Describes the NXFFS volume.
  *
  * Returned Value:
- *   If there is an active writer of the volume, its open file instance is
+ *   If a writer is being committed to FLASH, its open file instance is
  *   returned.  NULL is returned otherwise.
  *
  * Defined in nxffs_open.c
@@ -977,6 +1366,30 @@ int nxffs_wrverify(FAR struct nxffs_volume_s *volume, size_t size);
 int nxffs_wrblkhdr(FAR struct nxffs_volume_s *volume,
                    FAR struct nxffs_wrfile_s *wrfile);
 
+/****************************************************************************
+ * Name: nxffs_wrdata
+ *
+ * Description:
+ *   Write all of the data staged for a file to FLASH as a contiguous
+ *   sequence of data blocks, re-packing the volume if necessary.  The
+ *   final, partial data block is not finished; that is done by
+ *   nxffs_wrblkhdr() when the file is closed.
+ *
+ * Input Parameters:
+ *   volume - Describes the state of the NXFFS volume
+ *   wrfile - Describes the state of the open file
+ *
+ * Returned Value:
+ *   Zero is returned on success; Otherwise, a negated errno value is
+ *   returned to indicate the nature of the failure.
+ *
+ * Defined in nxffs_write.c
+ *
+ ****************************************************************************/
+
+int nxffs_wrdata(FAR struct nxffs_volume_s *volume,
+                 FAR struct nxffs_wrfile_s *wrfile);
+
 /****************************************************************************
  * Name: nxffs_nextblock
  *
@@ -1022,6 +1435,25 @@ int nxffs_nextblock(FAR struct nxffs_volume_s *volume, off_t offset,
 int nxffs_rdblkhdr(FAR struct nxffs_volume_s *volume, off_t offset,
                    FAR uint16_t *datlen);
 
+/****************************************************************************
+ * Name: nxffs_rdinvalidate
+ *
+ * Description:
+ *   Forget the remembered read positions of all files open for reading.
+ *   This must be called whenever file data may have been moved on FLASH.
+ *
+ * Input Parameters:
+ *   volume - Describes the current volume.
+ *
+ * Returned Value:
+ *   None
+ *
+ * Defined in nxffs_read.c
+ *
+ ****************************************************************************/
+
+void nxffs_rdinvalidate(FAR struct nxffs_volume_s *volume);
+
 /****************************************************************************
  * Name: nxffs_rminode
  *
@@ -1059,6 +1491,32 @@ int nxffs_rminode(FAR struct nxffs_volume_s *volume, FAR const char *name);
 
 int nxffs_pack(FAR struct nxffs_volume_s *volume);
 
+/****************************************************************************
+ * Name: nxffs_packstep
+ *
+ * Description:
+ *   Perform one bounded, incremental packing step.  At most 'budget' inodes
+ *   are moved toward the beginning of FLASH.  The volume is consistent when
+ *   this function returns, and the offset below which the volume is known
+ *   to be packed is remembered so that the next step resumes there.  No
+ *   FLASH is freed at the end of the volume; that still requires
+ *   nxffs_pack().
+ *
+ * Input Parameters:
+ *   volume - The volume to be packed.
+ *   budget - Maximum number of inodes to move (must be non-zero).
+ *
+ * Returned Values:
+ *   The number of inodes moved on success.  Zero means that there is
+ *   nothing left to move.  Otherwise, a negated errno value is returned to
+ *   indicate the nature of the failure.
+ *
+ * Defined in nxffs_pack.c
+ *
+ ****************************************************************************/
+
+int nxffs_packstep(FAR struct nxffs_volume_s *volume, uint32_t budget);
+
 /****************************************************************************
  * Standard mountpoint operation methods
  *
@@ -1067,7 +1525,7 @@ int nxffs_pack(FAR struct nxffs_volume_s *volume);
  *
  * - nxffs_open() and nxffs_close() are defined in nxffs_open.c
  * - nxffs_read() is defined in nxffs_read.c
- * - nxffs_write() is defined in nxffs_write.c
+ * - nxffs_write() and nxffs_sync() are defined in nxffs_write.c
  * - nxffs_ioctl() is defined in nxffs_ioctl.c
  * - nxffs_dup() is defined in nxffs_open.c
  * - nxffs_opendir(), nxffs_readdir(), and nxffs_rewindir() are defined in
@@ -1091,6 +1549,7 @@ ssize_t nxffs_read(FAR struct file *filep, FAR char *buffer, size_t buflen);
 ssize_t nxffs_write(FAR struct file *filep, FAR const char *buffer,
                     size_t buflen);
 int nxffs_ioctl(FAR struct file *filep, int cmd, unsigned long arg);
+int nxffs_sync(FAR struct file *filep);
 int nxffs_dup(FAR const struct file *oldp, FAR struct file *newp);
 int nxffs_opendir(FAR struct inode *mountpt, FAR const char *relpath,
                   FAR struct fs_dirent_s *dir);
@@ -42,9 +42,11 @@
 #include <nuttx/config.h>
 
 #include <string.h>
+#include <pthread.h>
 #include <errno.h>
 #include <debug.h>
 
+#include <nuttx/kmalloc.h>
 #include <nuttx/mtd/mtd.h>
 
 #include "nxffs.h"
@@ -53,10 +55,35 @@
  * Pre-processor Definitions
  ****************************************************************************/
 
+/* A volume is not split into more ranges than would leave each range with
+ * fewer than this number of erase blocks.  Smaller volumes are not worth a
+ * thread.
+ */
+
+#define NXFFS_MINRANGE 16
+
 /****************************************************************************
  * Private Types
  ****************************************************************************/
 
+#ifndef CONFIG_NXFFS_NAND
+/* This structure describes one range of erase blocks examined by
+ * nxffs_blockstats() and the statistics collected for that range.
+ */
+
+struct nxffs_statrange_s
+{
+  FAR struct nxffs_volume_s *volume;   /* The volume being examined */
+  off_t                     first;     /* First I/O block of the range */
+  off_t                     last;      /* I/O block after the end of the range */
+  FAR uint8_t              *buffer;    /* Erase block buffer for this range */
+  pthread_t                 thread;    /* Thread examining this range */
+  bool                      started;   /* True: thread was started */
+  int                       ret;       /* Result for the range */
+  struct nxffs_blkstats_s   stats;     /* Statistics for the range */
+};
+#endif
+
 /****************************************************************************
  * Public Data
  ****************************************************************************/
@@ -66,58 +93,51 @@
  ****************************************************************************/
 
 /****************************************************************************
- * Public Functions
- ****************************************************************************/
-
-/****************************************************************************
- * Name: nxffs_blockstats
+ * Name: nxffs_rangestats
  *
  * Description:
- *   Analyze the NXFFS volume.  This operation must be performed when the
- *   volume is first mounted in order to detect if the volume has been
- *   formatted and contains a usable NXFFS file system.
+ *   Collect the block statistics for one range of erase blocks.  Each
+ *   range has its own erase block buffer and reads the FLASH directly
+ *   (not through the volume block cache), so ranges may be examined
+ *   concurrently.
  *
  * Input Parameters:
- *   volume - Describes the current NXFFS volume.
- *   stats  - On return, will hold nformation describing the state of the
- *     volume.
+ *   range - Describes the range of erase blocks.  On return, range->stats
+ *     holds the statistics for the range and range->ret the result.
  *
  * Returned Value:
- *   Negated errnos are returned only in the case of MTD reported failures.
- *   Nothing in the volume data itself will generate errors.
+ *   Always NULL.  The result is returned in range->ret.
  *
  ****************************************************************************/
 
-int nxffs_blockstats(FAR struct nxffs_volume_s *volume,
-                     FAR struct nxffs_blkstats_s *stats)
-{
 #ifndef CONFIG_NXFFS_NAND
+static FAR void *nxffs_rangestats(FAR void *arg)
+{
+  FAR struct nxffs_statrange_s *range = (FAR struct nxffs_statrange_s *)arg;
+  FAR struct nxffs_volume_s *volume = range->volume;
+  FAR struct nxffs_blkstats_s *stats = &range->stats;
   FAR uint8_t *bptr;     /* Pointer to next block data */
-  int lblock;            /* Logical block index */
-#endif
   off_t ioblock;         /* I/O block number */
+  int lblock;            /* Logical block index */
   int ret;
 
-  /* Process each erase block */
-
-  memset(stats, 0, sizeof(struct nxffs_blkstats_s));
-
-#ifndef CONFIG_NXFFS_NAND
-  for (ioblock = 0; ioblock < volume->nblocks; ioblock += volume->blkper)
+  range->ret = OK;
+  for (ioblock = range->first; ioblock < range->last; ioblock += volume->blkper)
     {
       /* Read the full erase block */
 
-      ret = MTD_BREAD(volume->mtd, ioblock, volume->blkper, volume->pack);
+      ret = MTD_BREAD(volume->mtd, ioblock, volume->blkper, range->buffer);
       if (ret < volume->blkper)
         {
           fdbg("ERROR: Failed to read erase block %d: %d\n",
                ioblock / volume->blkper, ret);
-          return ret;
+          range->ret = ret;
+          break;
         }
 
       /* Then examine each logical block in the erase block */
 
-      for (bptr = volume->pack, lblock = 0;
+      for (bptr = range->buffer, lblock = 0;
            lblock < volume->blkper;
            bptr += volume->geo.blocksize, lblock++)
         {
@@ -163,6 +183,157 @@ int nxffs_blockstats(FAR struct nxffs_volume_s *volume,
         }
     }
 
+  return NULL;
+}
+#endif
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: nxffs_blockstats
+ *
+ * Description:
+ *   Analyze the NXFFS volume.  This operation must be performed when the
+ *   volume is first mounted in order to detect if the volume has been
+ *   formatted and contains a usable NXFFS file system.
+ *
+ * Input Parameters:
+ *   volume - Describes the current NXFFS volume.
+ *   stats  - On return, will hold nformation describing the state of the
+ *     volume.
+ *
+ * Returned Value:
+ *   Negated errnos are returned only in the case of MTD reported failures.
+ *   Nothing in the volume data itself will generate errors.
+ *
+ ****************************************************************************/
+
+int nxffs_blockstats(FAR struct nxffs_volume_s *volume,
+                     FAR struct nxffs_blkstats_s *stats)
+{
+#ifndef CONFIG_NXFFS_NAND
+  struct nxffs_statrange_s ranges[CONFIG_NXFFS_MOUNT_THREADS];
+  FAR struct nxffs_statrange_s *range;
+  off_t neblocks;        /* Number of erase blocks in a range */
+  int nranges;           /* Number of ranges */
+  int i;
+#else
+  off_t ioblock;         /* I/O block number */
+#endif
+  int ret;
+
+  /* Process each erase block */
+
+  memset(stats, 0, sizeof(struct nxffs_blkstats_s));
+
+#ifndef CONFIG_NXFFS_NAND
+  /* Divide the erase blocks into contiguous ranges.  Every range but the
+   * first is examined by a thread of its own while the first range is
+   * examined here using the pre-allocated volume->pack buffer.  The volume
+   * block cache is not used, so the threads share nothing but the MTD
+   * driver.
+   */
+
+  nranges = volume->geo.neraseblocks / NXFFS_MINRANGE;
+  if (nranges > CONFIG_NXFFS_MOUNT_THREADS)
+    {
+      nranges = CONFIG_NXFFS_MOUNT_THREADS;
+    }
+  else if (nranges < 1)
+    {
+      nranges = 1;
+    }
+
+  neblocks = (volume->geo.neraseblocks + nranges - 1) / nranges;
+  memset(ranges, 0, sizeof(ranges));
+
+  for (i = 0; i < nranges; i++)
+    {
+      range         = &ranges[i];
+      range->volume = volume;
+      range->first  = MIN(i * neblocks, volume->geo.neraseblocks) * volume->blkper;
+      range->last   = MIN((i + 1) * neblocks, volume->geo.neraseblocks) * volume->blkper;
+      range->buffer = volume->pack;
+
+      if (i == 0 || range->first >= range->last)
+        {
+          continue;
+        }
+
+      /* If there is no memory or no thread for this range, then it will
+       * simply be examined here after the first range.
+       */
+
+      range->buffer = (FAR uint8_t *)kmm_malloc(volume->geo.erasesize);
+      if (range->buffer)
+        {
+          if (pthread_create(&range->thread, NULL, nxffs_rangestats,
+                             range) == 0)
+            {
+              range->started = true;
+            }
+          else
+            {
+              fdbg("WARNING: Failed to start a thread for range %d\n", i);
+              kmm_free(range->buffer);
+              range->buffer = volume->pack;
+            }
+        }
+      else
+        {
+          range->buffer = volume->pack;
+        }
+    }
+
+  /* Examine the first range and any ranges that were not started, then
+   * wait for the threads and combine the statistics.  The first error
+   * reported is returned.
+   */
+
+  ret = OK;
+  for (i = 0; i < nranges; i++)
+    {
+      range = &ranges[i];
+      if (range->started)
+        {
+          continue;
+        }
+
+      if (ret == OK)
+        {
+          (void)nxffs_rangestats(range);
+          ret = range->ret;
+        }
+    }
+
+  for (i = 0; i < nranges; i++)
+    {
+      range = &ranges[i];
+      if (range->started)
+        {
+          (void)pthread_join(range->thread, NULL);
+          kmm_free(range->buffer);
+
+          if (ret == OK)
+            {
+              ret = range->ret;
+            }
+        }
+
+      stats->nblocks   += range->stats.nblocks;
+      stats->ngood     += range->stats.ngood;
+      stats->nbad      += range->stats.nbad;
+      stats->nunformat += range->stats.nunformat;
+      stats->ncorrupt  += range->stats.ncorrupt;
+    }
+
+  if (ret != OK)
+    {
+      return ret;
+    }
+
   fdbg("Number blocks:        %d\n", stats->nblocks);
   fdbg("  Good blocks:        %d\n", stats->ngood);
   fdbg("  Bad blocks:         %d\n", stats->nbad);
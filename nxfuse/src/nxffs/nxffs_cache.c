@@ -41,6 +41,7 @@
 
 #include <nuttx/config.h>
 
+#include <string.h>
 #include <assert.h>
 #include <errno.h>
 #include <debug.h>
@@ -65,6 +66,57 @@
  * Private Functions
  ****************************************************************************/
 
+/****************************************************************************
+ * Name: nxffs_cfind
+ *
+ * Description:
+ *   Find the cache slot that holds a block.
+ *
+ * Input Parameters:
+ *   volume - Describes the current volume
+ *   block  - The logical block to find
+ *
+ * Returned Value:
+ *   The index of the slot holding the block or -1 if the block is not
+ *   cached.
+ *
+ ****************************************************************************/
+
+static int nxffs_cfind(FAR struct nxffs_volume_s *volume, off_t block)
+{
+  int i;
+
+  for (i = 0; i < CONFIG_NXFFS_CACHE_NBLOCKS; i++)
+    {
+      if (volume->cslot[i].block == block)
+        {
+          return i;
+        }
+    }
+
+  return -1;
+}
+
+/****************************************************************************
+ * Name: nxffs_cselect
+ *
+ * Description:
+ *   Make a cache slot the current cache block and mark it as most recently
+ *   used.
+ *
+ * Input Parameters:
+ *   volume - Describes the current volume
+ *   slot   - The index of the cache slot
+ *
+ ****************************************************************************/
+
+static void nxffs_cselect(FAR struct nxffs_volume_s *volume, int slot)
+{
+  volume->cslot[slot].stamp = ++volume->cstamp;
+  volume->cache  = &volume->cbuffer[slot * volume->geo.blocksize];
+  volume->cblock = volume->cslot[slot].block;
+}
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -73,7 +125,8 @@
  * Name: nxffs_rdcache
  *
  * Description:
- *   Read one I/O block into the volume block cache memory.
+ *   Make one I/O block the current block in the volume cache memory.  The
+ *   block is read from FLASH only if it is not already held in the cache.
  *
  * Input Parameters:
  *   volume - Describes the current volume
@@ -87,34 +140,142 @@
 
 int nxffs_rdcache(FAR struct nxffs_volume_s *volume, off_t block)
 {
-  size_t nxfrd;
+  ssize_t nxfrd;
+  off_t lastblock;
+  int victim;
+  int nread;
+  int slot;
+  int i;
+
+  /* Check if the requested data is already the current cache block */
+
+  if (block == volume->cblock)
+    {
+      volume->cstats.hits++;
+      return OK;
+    }
+
+  /* Check if the requested data is held in some other cache slot */
+
+  slot = nxffs_cfind(volume, block);
+  if (slot >= 0)
+    {
+      nxffs_cselect(volume, slot);
+      volume->cstats.hits++;
+      return OK;
+    }
+
+  /* No.. replace the least recently used slot.  Empty slots have a stamp of
+   * zero and so are always used first.
+   */
+
+  victim = 0;
+  for (i = 1; i < CONFIG_NXFFS_CACHE_NBLOCKS; i++)
+    {
+      if (volume->cslot[i].stamp < volume->cslot[victim].stamp)
+        {
+          victim = i;
+        }
+    }
+
+  /* If we are scanning forward through FLASH, then read the following
+   * blocks into the following slots with the same MTD access.  Stop at any
+   * block that is already cached so that no block is ever held twice.
+   */
 
-  /* Check if the requested data is already in the cache */
+  nread = 1;
+  if (volume->cblock >= 0 && block == volume->cblock + 1)
+    {
+      lastblock = MIN(block + CONFIG_NXFFS_CACHE_READAHEAD,
+                      volume->nblocks - 1);
+
+      while (block + nread <= lastblock &&
+             victim + nread < CONFIG_NXFFS_CACHE_NBLOCKS &&
+             nxffs_cfind(volume, block + nread) < 0)
+        {
+          nread++;
+        }
+    }
 
-  if (block != volume->cblock)
+  /* Read the specified blocks into cache */
+
+  nxfrd = MTD_BREAD(volume->mtd, block, nread,
+                    &volume->cbuffer[victim * volume->geo.blocksize]);
+  if (nxfrd != nread)
     {
-      /* Read the specified blocks into cache */
+      fdbg("ERROR: Read block %d failed: %d\n", block, nxfrd);
+
+      /* The content of the slots is now unknown */
 
-      nxfrd = MTD_BREAD(volume->mtd, block, 1, volume->cache);
-      if (nxfrd != 1)
+      for (i = victim; i < victim + nread; i++)
         {
-          fdbg("ERROR: Read block %d failed: %d\n", block, nxfrd);
-          return -EIO;
+          volume->cslot[i].block = (off_t)-1;
+          volume->cslot[i].stamp = 0;
         }
 
-      /* Remember what is in the cache */
+      volume->cblock = (off_t)-1;
+      return -EIO;
+    }
+
+  /* Remember what is in the cache */
 
-      volume->cblock  = block;
+  for (i = 0; i < nread; i++)
+    {
+      volume->cslot[victim + i].block = block + i;
+      volume->cslot[victim + i].stamp = volume->cstamp;
     }
 
+  nxffs_cselect(volume, victim);
+
+  volume->cstats.misses++;
+  volume->cstats.readahead += nread - 1;
   return OK;
 }
 
+/****************************************************************************
+ * Name: nxffs_invcache
+ *
+ * Description:
+ *   Discard any cached copies of a range of blocks.  This must be called
+ *   whenever FLASH is modified without going through nxffs_wrcache().
+ *
+ * Input Parameters:
+ *   volume  - Describes the current volume
+ *   block   - The first logical block to discard
+ *   nblocks - The number of logical blocks to discard
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void nxffs_invcache(FAR struct nxffs_volume_s *volume, off_t block,
+                    off_t nblocks)
+{
+  int i;
+
+  for (i = 0; i < CONFIG_NXFFS_CACHE_NBLOCKS; i++)
+    {
+      if (volume->cslot[i].block >= block &&
+          volume->cslot[i].block < block + nblocks)
+        {
+          volume->cslot[i].block = (off_t)-1;
+          volume->cslot[i].stamp = 0;
+        }
+    }
+
+  if (volume->cblock >= block && volume->cblock < block + nblocks)
+    {
+      volume->cblock = (off_t)-1;
+    }
+}
+
 /****************************************************************************
  * Name: nxffs_wrcache
  *
  * Description:
- *   Write one or more logical blocks from the volume cache memory.
+ *   Write the current block from the volume cache memory.  The cache is
+ *   write-through:  the cached copy remains valid after the write.
  *
  * Input Parameters:
  *   volume - Describes the current volume
@@ -134,11 +295,16 @@ int nxffs_wrcache(FAR struct nxffs_volume_s *volume)
   if (nxfrd != 1)
     {
       fdbg("ERROR: Write block %d failed: %d\n", volume->cblock, nxfrd);
+
+      /* The cached copy no longer matches what is in FLASH */
+
+      nxffs_invcache(volume, volume->cblock, 1);
       return -EIO;
     }
 
   /* Write was successful */
 
+  volume->cstats.writes++;
   return OK;
 }
 
@@ -272,3 +438,164 @@ int nxffs_getc(FAR struct nxffs_volume_s *volume, uint16_t reserve)
   volume->iooffset++;
   return ret;
 }
+
+/****************************************************************************
+ * Name: nxffs_scan
+ *
+ * Description:
+ *   Search forward from the current seek position for the next occurrence
+ *   of a magic sequence.
+ *
+ *   Each block is searched in place in the cache: memchr() locates the
+ *   candidate positions of the first magic byte and of the next erased
+ *   byte, and nxffs_erased() measures runs of erased bytes.  Only bytes
+ *   that can start a complete header are examined, as with nxffs_getc().
+ *
+ * Input Parameters:
+ *   volume  - Describes the NXFFS volume.
+ *   magic   - The magic sequence to search for.
+ *   hdrsize - The size of the header that begins with the magic sequence.
+ *   offset  - On success, the FLASH offset of the magic sequence.
+ *
+ * Returned Value:
+ *   Zero on success; -ENOENT if the end of valid data was found; -ENOSPC
+ *   at the end of FLASH; other negated errno values on read failures.
+ *
+ ****************************************************************************/
+
+int nxffs_scan(FAR struct nxffs_volume_s *volume, FAR const uint8_t *magic,
+               uint16_t hdrsize, FAR off_t *offset)
+{
+  FAR const uint8_t *cache;
+  FAR const uint8_t *match;
+  FAR const uint8_t *erased;
+  size_t nerased;
+  size_t pos;
+  size_t end;
+  size_t n;
+  int ret;
+
+  DEBUGASSERT(hdrsize >= NXFFS_MAGICSIZE && hdrsize < volume->geo.blocksize);
+
+  /* Only positions before this offset in a block can begin a header */
+
+  end     = volume->geo.blocksize - hdrsize + 1;
+  nerased = 0;
+
+  for (; ; )
+    {
+      /* Move to the next block if there is no room left in this one */
+
+      if (volume->iooffset >= end)
+        {
+          off_t nextblock = volume->ioblock + 1;
+          if (nextblock >= volume->nblocks)
+            {
+              fvdbg("End of FLASH encountered\n");
+              return -ENOSPC;
+            }
+
+          volume->ioblock  = nextblock;
+          volume->iooffset = SIZEOF_NXFFS_BLOCK_HDR;
+        }
+
+      /* Make sure that the block is in the cache and skip over blocks that
+       * are marked bad.
+       */
+
+      ret = nxffs_verifyblock(volume, volume->ioblock);
+      if (ret < 0)
+        {
+#ifndef CONFIG_NXFFS_NAND
+          if (ret != -ENOENT)
+            {
+              /* Read errors are fatal */
+
+              fdbg("ERROR: Failed to read valid data into cache: %d\n", ret);
+              return ret;
+            }
+#else
+          if (ret != -ENOENT)
+            {
+              fdbg("ERROR: Failed to read valid data into cache: %d\n", ret);
+            }
+#endif
+
+          volume->iooffset = end;
+          continue;
+        }
+
+      /* Search the remainder of the block */
+
+      cache = volume->cache;
+      pos   = volume->iooffset;
+      if (pos < SIZEOF_NXFFS_BLOCK_HDR)
+        {
+          pos = SIZEOF_NXFFS_BLOCK_HDR;
+        }
+
+      match = NULL;
+      while (pos < end)
+        {
+          /* Measure any run of erased bytes beginning here */
+
+          if (cache[pos] == CONFIG_NXFFS_ERASEDSTATE)
+            {
+              n        = nxffs_erased(&cache[pos], end - pos);
+              nerased += n;
+              pos     += n;
+
+              if (nerased >= NXFFS_NERASED)
+                {
+                  fvdbg("No entry found\n");
+                  volume->iooffset = pos;
+                  return -ENOENT;
+                }
+
+              continue;
+            }
+
+          nerased = 0;
+
+          /* Find the next candidate for the first byte of the magic
+           * sequence.  The previous candidate is reused until it is passed.
+           */
+
+          if (match == NULL || match < &cache[pos])
+            {
+              match = memchr(&cache[pos], magic[0], end - pos);
+              if (match == NULL)
+                {
+                  match = &cache[end];
+                }
+            }
+
+          /* An erased byte before the candidate must be accounted for
+           * first.
+           */
+
+          erased = memchr(&cache[pos], CONFIG_NXFFS_ERASEDSTATE,
+                          match - &cache[pos]);
+          if (erased != NULL)
+            {
+              pos = erased - cache;
+              continue;
+            }
+
+          pos = match - cache;
+          if (pos < end &&
+              memcmp(&cache[pos], magic, NXFFS_MAGICSIZE) == 0)
+            {
+              /* Found it.  Leave the seek position after the magic */
+
+              volume->iooffset = pos + NXFFS_MAGICSIZE;
+              *offset = nxffs_iotell(volume) - NXFFS_MAGICSIZE;
+              return OK;
+            }
+
+          pos++;
+        }
+
+      volume->iooffset = end;
+    }
+}
@@ -153,6 +153,15 @@ int nxffs_readdir(FAR struct inode *mountpt, FAR struct fs_dirent_s *dir)
   offset = dir->u.nxffs.nx_offset;
   ret = nxffs_nextentry(volume, offset, &entry);
 
+  /* File extents are not reported; they are part of a file */
+
+  while (ret == OK && entry.extent)
+    {
+      offset = nxffs_inodeend(volume, &entry);
+      nxffs_freeentry(&entry);
+      ret = nxffs_nextentry(volume, offset, &entry);
+    }
+
   /* If the read was successful, then handle the reported inode.  Note
    * that when the last inode has been reported, the value -ENOENT will
    * be returned.. which is correct for the readdir() method.
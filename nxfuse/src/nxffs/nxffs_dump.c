@@ -211,6 +211,14 @@ static inline ssize_t nxffs_analyzeinode(FAR struct nxffs_blkinfo_s *blkinfo,
                  blkinfo->block, offset, "INODE", "OK     ", datlen);
         }
     }
+  else if (state == INODE_STATE_EXTENT)
+    {
+      if (blkinfo->verbose)
+        {
+          syslog(LOG_NOTICE, g_format,
+                 blkinfo->block, offset, "INODE", "EXTENT ", datlen);
+        }
+    }
   else if (state == INODE_STATE_DELETED)
     {
       if (blkinfo->verbose)
@@ -0,0 +1,540 @@
+/****************************************************************************
+ * fs/nxffs/nxffs_index.c
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <string.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <nuttx/kmalloc.h>
+
+#include "nxffs.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Initial size of the extent array of an index entry */
+
+#define NXFFS_INDEX_NEXTENTS 4
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/****************************************************************************
+ * Public Data
+ ****************************************************************************/
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: nxffs_idxhash
+ *
+ * Description:
+ *   Return the 32-bit FNV-1a hash of an inode name.
+ *
+ ****************************************************************************/
+
+static uint32_t nxffs_idxhash(FAR const char *name)
+{
+  uint32_t hash = 2166136261u;
+
+  while (*name != '\0')
+    {
+      hash ^= (uint8_t)*name++;
+      hash *= 16777619u;
+    }
+
+  return hash;
+}
+
+/****************************************************************************
+ * Name: nxffs_idxfree
+ *
+ * Description:
+ *   Free every entry and the hash chains of the index.
+ *
+ ****************************************************************************/
+
+static void nxffs_idxfree(FAR struct nxffs_index_s *index)
+{
+  FAR struct nxffs_idxentry_s *ientry;
+  FAR struct nxffs_idxentry_s *next;
+  uint32_t i;
+
+  if (index->buckets)
+    {
+      for (i = 0; i < index->nbuckets; i++)
+        {
+          for (ientry = index->buckets[i]; ientry; ientry = next)
+            {
+              next = ientry->flink;
+              kmm_free(ientry->extents);
+              kmm_free(ientry);
+            }
+        }
+
+      kmm_free(index->buckets);
+    }
+
+  index->buckets  = NULL;
+  index->nbuckets = 0;
+  index->ninodes  = 0;
+}
+
+/****************************************************************************
+ * Name: nxffs_idxgrow
+ *
+ * Description:
+ *   Re-hash the index into a table with the provided number of chains.
+ *
+ ****************************************************************************/
+
+static int nxffs_idxgrow(FAR struct nxffs_index_s *index, uint32_t nbuckets)
+{
+  FAR struct nxffs_idxentry_s **buckets;
+  FAR struct nxffs_idxentry_s *ientry;
+  FAR struct nxffs_idxentry_s *next;
+  uint32_t i;
+
+  buckets = (FAR struct nxffs_idxentry_s **)
+    kmm_zalloc(nbuckets * sizeof(FAR struct nxffs_idxentry_s *));
+  if (!buckets)
+    {
+      return -ENOMEM;
+    }
+
+  for (i = 0; i < index->nbuckets; i++)
+    {
+      for (ientry = index->buckets[i]; ientry; ientry = next)
+        {
+          next                = ientry->flink;
+          ientry->flink       = buckets[ientry->hash & (nbuckets - 1)];
+          buckets[ientry->hash & (nbuckets - 1)] = ientry;
+        }
+    }
+
+  kmm_free(index->buckets);
+  index->buckets  = buckets;
+  index->nbuckets = nbuckets;
+  return OK;
+}
+
+/****************************************************************************
+ * Name: nxffs_idxlookup
+ *
+ * Description:
+ *   Return the address of the link that points to the entry with the
+ *   provided name, or the address of the NULL link terminating its hash
+ *   chain if there is no such entry.
+ *
+ ****************************************************************************/
+
+static FAR struct nxffs_idxentry_s **
+nxffs_idxlookup(FAR struct nxffs_index_s *index, FAR const char *name,
+                uint32_t hash)
+{
+  FAR struct nxffs_idxentry_s **link;
+
+  link = &index->buckets[hash & (index->nbuckets - 1)];
+  while (*link && ((*link)->hash != hash || strcmp((*link)->name, name) != 0))
+    {
+      link = &(*link)->flink;
+    }
+
+  return link;
+}
+
+/****************************************************************************
+ * Name: nxffs_idxbsearch
+ *
+ * Description:
+ *   Return the index of the extent of an index entry that begins at the
+ *   provided file position, or -1 if there is no such extent.
+ *
+ ****************************************************************************/
+
+static int nxffs_idxbsearch(FAR struct nxffs_idxentry_s *ientry,
+                            uint32_t fpos)
+{
+  int lower = 0;
+  int upper = (int)ientry->nextents - 1;
+  int mid;
+
+  while (lower <= upper)
+    {
+      mid = (lower + upper) >> 1;
+      if (ientry->extents[mid].fpos == fpos)
+        {
+          return mid;
+        }
+      else if (ientry->extents[mid].fpos < fpos)
+        {
+          lower = mid + 1;
+        }
+      else
+        {
+          upper = mid - 1;
+        }
+    }
+
+  return -1;
+}
+
+/****************************************************************************
+ * Name: nxffs_idxextend
+ *
+ * Description:
+ *   Add an extent to the index entry of the file that it belongs to, or
+ *   update the extent at the same file position if the extent was moved.
+ *
+ ****************************************************************************/
+
+static int nxffs_idxextend(FAR struct nxffs_volume_s *volume,
+                           FAR const struct nxffs_entry_s *entry)
+{
+  FAR struct nxffs_index_s *index = &volume->index;
+  FAR struct nxffs_idxentry_s *ientry;
+  FAR struct nxffs_extent_s *extents;
+  uint32_t maxextents;
+  int i;
+
+  if (index->ninodes == 0)
+    {
+      return -ENOENT;
+    }
+
+  ientry = *nxffs_idxlookup(index, entry->name, nxffs_idxhash(entry->name));
+  if (!ientry)
+    {
+      return -ENOENT;
+    }
+
+  /* Has the extent been moved? */
+
+  i = nxffs_idxbsearch(ientry, entry->utc);
+  if (i >= 0)
+    {
+      ientry->extents[i].hoffset = entry->hoffset;
+      ientry->extents[i].doffset = entry->doffset;
+      return OK;
+    }
+
+  /* No.. it must continue the file */
+
+  if (entry->utc != ientry->datlen + ientry->extlen)
+    {
+      return -ENOENT;
+    }
+
+  if (ientry->nextents >= ientry->maxextents)
+    {
+      maxextents = ientry->maxextents ? 2 * ientry->maxextents :
+                   NXFFS_INDEX_NEXTENTS;
+      extents    = (FAR struct nxffs_extent_s *)
+        kmm_realloc(ientry->extents, maxextents * sizeof(struct nxffs_extent_s));
+      if (!extents)
+        {
+          nxffs_idxinvalidate(volume);
+          return -ENOMEM;
+        }
+
+      ientry->extents    = extents;
+      ientry->maxextents = maxextents;
+    }
+
+  extents          = &ientry->extents[ientry->nextents];
+  extents->hoffset = entry->hoffset;
+  extents->doffset = entry->doffset;
+  extents->fpos    = entry->utc;
+  extents->datlen  = entry->datlen;
+
+  ientry->nextents++;
+  ientry->extlen  += entry->datlen;
+  return OK;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: nxffs_idxreset
+ *
+ * Description:
+ *   Discard all entries in the inode index and mark it valid.
+ *
+ ****************************************************************************/
+
+void nxffs_idxreset(FAR struct nxffs_volume_s *volume)
+{
+  nxffs_idxfree(&volume->index);
+  volume->index.valid = true;
+}
+
+/****************************************************************************
+ * Name: nxffs_idxinvalidate
+ *
+ * Description:
+ *   Discard all entries in the inode index and mark it invalid.
+ *
+ ****************************************************************************/
+
+void nxffs_idxinvalidate(FAR struct nxffs_volume_s *volume)
+{
+  if (volume->index.valid)
+    {
+      fdbg("WARNING: Inode index invalidated\n");
+    }
+
+  nxffs_idxfree(&volume->index);
+  volume->index.valid = false;
+}
+
+/****************************************************************************
+ * Name: nxffs_idxinsert
+ *
+ * Description:
+ *   Add an inode to the index, replacing any entry with the same name.
+ *
+ ****************************************************************************/
+
+int nxffs_idxinsert(FAR struct nxffs_volume_s *volume,
+                    FAR const struct nxffs_entry_s *entry)
+{
+  FAR struct nxffs_index_s *index = &volume->index;
+  FAR struct nxffs_idxentry_s **link;
+  FAR struct nxffs_idxentry_s *ientry;
+  uint32_t hash;
+  int namlen;
+  int ret;
+
+  if (!index->valid)
+    {
+      return -ENOSYS;
+    }
+
+  /* Extents belong to the index entry of their file */
+
+  if (entry->extent)
+    {
+      return nxffs_idxextend(volume, entry);
+    }
+
+  /* Allocate the hash chains on first use and keep the load factor at or
+   * below one.
+   */
+
+  if (index->ninodes >= index->nbuckets)
+    {
+      ret = nxffs_idxgrow(index, index->nbuckets ? 2 * index->nbuckets :
+                          NXFFS_INDEX_NBUCKETS);
+      if (ret < 0)
+        {
+          goto errout;
+        }
+    }
+
+  hash = nxffs_idxhash(entry->name);
+  link = nxffs_idxlookup(index, entry->name, hash);
+  ientry = *link;
+
+  if (!ientry)
+    {
+      namlen = strlen(entry->name);
+      ientry = (FAR struct nxffs_idxentry_s *)
+        kmm_malloc(sizeof(struct nxffs_idxentry_s) + namlen);
+      if (!ientry)
+        {
+          ret = -ENOMEM;
+          goto errout;
+        }
+
+      ientry->flink      = NULL;
+      ientry->hash       = hash;
+      ientry->extlen     = 0;
+      ientry->nextents   = 0;
+      ientry->maxextents = 0;
+      ientry->extents    = NULL;
+      memcpy(ientry->name, entry->name, namlen + 1);
+
+      *link = ientry;
+      index->ninodes++;
+    }
+
+  ientry->hoffset = entry->hoffset;
+  ientry->noffset = entry->noffset;
+  ientry->doffset = entry->doffset;
+  ientry->utc     = entry->utc;
+  ientry->datlen  = entry->datlen;
+  return OK;
+
+errout:
+  nxffs_idxinvalidate(volume);
+  return ret;
+}
+
+/****************************************************************************
+ * Name: nxffs_idxremove
+ *
+ * Description:
+ *   Remove the inode with the provided name from the index.
+ *
+ ****************************************************************************/
+
+void nxffs_idxremove(FAR struct nxffs_volume_s *volume, FAR const char *name)
+{
+  FAR struct nxffs_index_s *index = &volume->index;
+  FAR struct nxffs_idxentry_s **link;
+  FAR struct nxffs_idxentry_s *ientry;
+
+  if (index->valid && index->ninodes > 0)
+    {
+      link   = nxffs_idxlookup(index, name, nxffs_idxhash(name));
+      ientry = *link;
+      if (ientry)
+        {
+          *link = ientry->flink;
+          kmm_free(ientry->extents);
+          kmm_free(ientry);
+          index->ninodes--;
+        }
+    }
+}
+
+/****************************************************************************
+ * Name: nxffs_idxfind
+ *
+ * Description:
+ *   Look up an inode by name in the index.
+ *
+ ****************************************************************************/
+
+int nxffs_idxfind(FAR struct nxffs_volume_s *volume, FAR const char *name,
+                  FAR struct nxffs_entry_s *entry)
+{
+  FAR struct nxffs_index_s *index = &volume->index;
+  FAR struct nxffs_idxentry_s *ientry;
+
+  if (!index->valid)
+    {
+      return -ENOSYS;
+    }
+
+  if (index->ninodes == 0)
+    {
+      return -ENOENT;
+    }
+
+  ientry = *nxffs_idxlookup(index, name, nxffs_idxhash(name));
+  if (!ientry)
+    {
+      return -ENOENT;
+    }
+
+  if (entry)
+    {
+      entry->name     = ientry->name;
+      entry->borrowed = true;
+      entry->hoffset  = ientry->hoffset;
+      entry->noffset  = ientry->noffset;
+      entry->doffset  = ientry->doffset;
+      entry->utc      = ientry->utc;
+      entry->datlen   = ientry->datlen;
+      entry->extlen   = ientry->extlen;
+      entry->extent   = false;
+    }
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: nxffs_idxextent
+ *
+ * Description:
+ *   Look up the extent of a file that begins at the provided file position
+ *   in the index.
+ *
+ ****************************************************************************/
+
+int nxffs_idxextent(FAR struct nxffs_volume_s *volume, FAR const char *name,
+                    uint32_t fpos, FAR struct nxffs_entry_s *extent)
+{
+  FAR struct nxffs_index_s *index = &volume->index;
+  FAR struct nxffs_idxentry_s *ientry;
+  int i;
+
+  if (!index->valid)
+    {
+      return -ENOSYS;
+    }
+
+  if (index->ninodes == 0)
+    {
+      return -ENOENT;
+    }
+
+  ientry = *nxffs_idxlookup(index, name, nxffs_idxhash(name));
+  if (!ientry)
+    {
+      return -ENOENT;
+    }
+
+  i = nxffs_idxbsearch(ientry, fpos);
+  if (i < 0)
+    {
+      return -ENOENT;
+    }
+
+  if (extent)
+    {
+      extent->name     = ientry->name;
+      extent->borrowed = true;
+      extent->hoffset  = ientry->extents[i].hoffset;
+      extent->noffset  = 0;
+      extent->doffset  = ientry->extents[i].doffset;
+      extent->utc      = fpos;
+      extent->datlen   = ientry->extents[i].datlen;
+      extent->extlen   = 0;
+      extent->extent   = true;
+    }
+
+  return OK;
+}
@@ -83,7 +83,7 @@ const struct mountpt_operations nxffs_operations =
   NULL,              /* seek -- Use f_pos in struct file */
   nxffs_ioctl,       /* ioctl */
 
-  NULL,              /* sync -- No buffered data */
+  nxffs_sync,        /* sync */
   nxffs_dup,         /* dup */
 
   nxffs_opendir,     /* opendir */
@@ -143,6 +143,89 @@ struct nxffs_volume_s g_volume;
  * Private Functions
  ****************************************************************************/
 
+/****************************************************************************
+ * Name: nxffs_lmentry
+ *
+ * Description:
+ *   Add an inode found by nxffs_limits() to the index and to the volume
+ *   space accounting.  If the same inode appears more than once (an
+ *   interrupted truncation or packing), the first one found wins just as it
+ *   would for a FLASH scan.  A file extent that does not continue a file
+ *   found earlier no longer belongs to any file and is not counted.
+ *
+ * Input Parameters:
+ *   volume - Identifies the NXFFS volume
+ *   entry  - Describes the inode that was found
+ *
+ ****************************************************************************/
+
+static void nxffs_lmentry(FAR struct nxffs_volume_s *volume,
+                          FAR struct nxffs_entry_s *entry)
+{
+  int ret;
+
+  if (entry->extent)
+    {
+      ret = nxffs_idxextent(volume, entry->name, entry->utc, NULL);
+    }
+  else
+    {
+      ret = nxffs_idxfind(volume, entry->name, NULL);
+    }
+
+  if (ret == OK)
+    {
+      return;
+    }
+
+  if (ret == -ENOENT && nxffs_idxinsert(volume, entry) == -ENOENT)
+    {
+      return;
+    }
+
+  if (!entry->extent)
+    {
+      volume->ninodes++;
+    }
+
+  volume->livebytes += nxffs_inodesize(volume, entry);
+}
+
+/****************************************************************************
+ * Name: nxffs_lmend
+ *
+ * Description:
+ *   Return the FLASH offset just past the final data block of an inode.
+ *   Unlike nxffs_inodeend(), this is exact:  The data blocks of the inode
+ *   are followed to the end.
+ *
+ * Input Parameters:
+ *   volume - Identifies the NXFFS volume
+ *   entry  - Describes the inode
+ *
+ ****************************************************************************/
+
+static off_t nxffs_lmend(FAR struct nxffs_volume_s *volume,
+                         FAR struct nxffs_entry_s *entry)
+{
+  struct nxffs_blkentry_s blkentry;
+  off_t offset = entry->doffset;
+  uint32_t nbytes;
+
+  for (nbytes = 0; offset > 0 && nbytes < entry->datlen; )
+    {
+      if (nxffs_nextblock(volume, offset, &blkentry) < 0)
+        {
+          return nxffs_inodeend(volume, entry);
+        }
+
+      nbytes += blkentry.datlen;
+      offset  = blkentry.hoffset + SIZEOF_NXFFS_DATA_HDR + blkentry.datlen;
+    }
+
+  return offset > 0 ? offset : nxffs_inodeend(volume, entry);
+}
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -170,6 +253,7 @@ int nxffs_initialize(FAR struct mtd_dev_s *mtd)
   off_t threshold;
 #endif
   int ret;
+  int i;
 
   /* If CONFIG_NXFFS_PREALLOCATED is defined, then this is the single, pre-
    * allocated NXFFS volume instance.
@@ -196,7 +280,6 @@ int nxffs_initialize(FAR struct mtd_dev_s *mtd)
   volume->mtd    = mtd;
   volume->cblock = (off_t)-1;
   sem_init(&volume->exclsem, 0, 1);
-  sem_init(&volume->wrsem, 0, 1);
 
   /* Get the volume geometry. (casting to uintptr_t first eliminates
    * complaints on some architectures where the sizeof long is different
@@ -210,16 +293,25 @@ int nxffs_initialize(FAR struct mtd_dev_s *mtd)
       goto errout_with_volume;
     }
 
-  /* Allocate one I/O block buffer to general files system access */
+  /* Allocate the I/O block buffers of the block cache for general file
+   * system access.  All cache slots start out empty.
+   */
 
-  volume->cache = (FAR uint8_t *)kmm_malloc(volume->geo.blocksize);
-  if (!volume->cache)
+  volume->cbuffer = (FAR uint8_t *)
+    kmm_malloc(CONFIG_NXFFS_CACHE_NBLOCKS * volume->geo.blocksize);
+  if (!volume->cbuffer)
     {
-      fdbg("ERROR: Failed to allocate an erase block buffer\n");
+      fdbg("ERROR: Failed to allocate the block cache\n");
       ret = -ENOMEM;
       goto errout_with_volume;
     }
 
+  volume->cache = volume->cbuffer;
+  for (i = 0; i < CONFIG_NXFFS_CACHE_NBLOCKS; i++)
+    {
+      volume->cslot[i].block = (off_t)-1;
+    }
+
   /* Pre-allocate one, full, in-memory erase block.  This is needed for filesystem
    * packing (but is useful in other places as well). This buffer is not needed
    * often, but is best to have pre-allocated and in-place.
@@ -251,6 +343,8 @@ int nxffs_initialize(FAR struct mtd_dev_s *mtd)
       goto errout_with_buffer;
     }
 
+  volume->nbad = stats.nbad;
+
   /* If the proportion of good blocks is low or the proportion of unformatted
    * blocks is high, then reformat the FLASH.
    */
@@ -324,7 +418,7 @@ int nxffs_initialize(FAR struct mtd_dev_s *mtd)
 errout_with_buffer:
   kmm_free(volume->pack);
 errout_with_cache:
-  kmm_free(volume->cache);
+  kmm_free(volume->cbuffer);
 errout_with_volume:
 #ifndef CONFIG_NXFFS_PREALLOCATED
   kmm_free(volume);
@@ -362,10 +456,19 @@ int nxffs_limits(FAR struct nxffs_volume_s *volume)
   FAR struct nxffs_entry_s entry;
   off_t block;
   off_t offset;
+  off_t lastoff = 0;
   bool noinodes = false;
   int nerased;
   int ret;
 
+  /* The inode index and the space accounting are rebuilt from scratch as
+   * the inodes are found.
+   */
+
+  nxffs_idxreset(volume);
+  volume->ninodes   = 0;
+  volume->livebytes = 0;
+
   /* Get the offset to the first valid block on the FLASH */
 
   block = 0;
@@ -409,9 +512,13 @@ int nxffs_limits(FAR struct nxffs_volume_s *volume)
       volume->inoffset = entry.hoffset;
       fvdbg("First inode at offset %d\n", volume->inoffset);
 
-      /* Discard this entry and set the next offset. */
+      /* Index and count this entry, then discard it and set the next
+       * offset.
+       */
 
+      nxffs_lmentry(volume, &entry);
       offset = nxffs_inodeend(volume, &entry);
+      lastoff = entry.hoffset;
       nxffs_freeentry(&entry);
     }
 
@@ -421,9 +528,24 @@ int nxffs_limits(FAR struct nxffs_volume_s *volume)
     {
       while (nxffs_nextentry(volume, offset, &entry) == OK)
         {
+          /* Index and count the entry */
+
+          nxffs_lmentry(volume, &entry);
+
           /* Discard the entry and guess the next offset. */
 
-          offset = nxffs_inodeend(volume, &entry);
+          offset  = nxffs_inodeend(volume, &entry);
+          lastoff = entry.hoffset;
+          nxffs_freeentry(&entry);
+        }
+
+      /* The data of the last inode could end with bytes that look erased.
+       * Begin the search for erased FLASH at the exact end of its data.
+       */
+
+      if (nxffs_nextentry(volume, lastoff, &entry) == OK)
+        {
+          offset = nxffs_lmend(volume, &entry);
           nxffs_freeentry(&entry);
         }
 
@@ -496,7 +618,11 @@ int nxffs_limits(FAR struct nxffs_volume_s *volume)
         }
       else
         {
-          offset += nerased + 1;
+          /* nxffs_getc() skips over block headers and bad blocks, so take
+           * the offset from the I/O position rather than counting bytes.
+           */
+
+          offset  = nxffs_iotell(volume);
           nerased = 0;
         }
     }
@@ -108,7 +108,8 @@ static int nxffs_rdentry(FAR struct nxffs_volume_s *volume, off_t offset,
   /* Check if the file state is recognized. */
 
   state = inode.state;
-  if (state != INODE_STATE_FILE && state != INODE_STATE_DELETED)
+  if (state != INODE_STATE_FILE && state != INODE_STATE_EXTENT &&
+      state != INODE_STATE_DELETED)
     {
       /* This can't be a valid inode.. don't bother with the rest */
 
@@ -131,16 +132,14 @@ static int nxffs_rdentry(FAR struct nxffs_volume_s *volume, off_t offset,
   memset(inode.crc, 0, 4);
   crc            = crc32((FAR const uint8_t *)&inode, SIZEOF_NXFFS_INODE_HDR);
 
-  /* Allocate memory to hold the variable-length file name */
+  /* The variable-length file name is read into the volume scan name
+   * buffer.  The entry only borrows it; it remains valid until the next
+   * inode is read.
+   */
 
-  namlen = inode.namlen;
-  entry->name = (FAR char *)kmm_malloc(namlen + 1);
-  if (!entry->name)
-    {
-      fdbg("ERROR: Failed to allocate name, namlen: %d\n", namlen);
-      ret = -ENOMEM;
-      goto errout_no_offset;
-    }
+  namlen          = inode.namlen;
+  entry->name     = volume->scanname;
+  entry->borrowed = true;
 
   /* Seek to the expected location of the name in FLASH */
 
@@ -176,15 +175,20 @@ static int nxffs_rdentry(FAR struct nxffs_volume_s *volume, off_t offset,
    * Check the file state.
    */
 
-  if (state != INODE_STATE_FILE)
+  if (state == INODE_STATE_EXTENT)
     {
-      /* It is a deleted file.  But still, the data offset and the
-       * start size are good so we can use this information to advance
-       * further in FLASH memory and reduce the search time.
+      entry->extent = true;
+    }
+  else if (state != INODE_STATE_FILE)
+    {
+      /* It is a deleted file.  Its data is not skipped:  If the data
+       * ended with bytes that look erased, the next inode may have been
+       * written over them when the free FLASH offset was recovered at
+       * mount time.  Resume the search after the inode name.
        */
 
-      offset = nxffs_inodeend(volume, entry);
-      nxffs_freeentry(entry);
+      offset = entry->noffset + namlen;
+      entry->name = NULL;
       ret = -ENOENT;
       goto errout;
     }
@@ -201,7 +205,7 @@ static int nxffs_rdentry(FAR struct nxffs_volume_s *volume, off_t offset,
    */
 
 errout_with_name:
-  nxffs_freeentry(entry);
+  entry->name = NULL;
 errout_no_offset:
   offset += NXFFS_MAGICSIZE;
 errout:
@@ -217,9 +221,11 @@ errout:
  * Name: nxffs_freeentry
  *
  * Description:
- *   The inode values returned by nxffs_nextentry() include allocated memory
- *   (specifically, the file name string).  This function should be called
- *   to dispose of that memory when the inode entry is no longer needed.
+ *   An inode entry may include allocated memory (specifically, the file
+ *   name string).  This function should be called to dispose of that
+ *   memory when the inode entry is no longer needed.  Entries returned by
+ *   nxffs_nextentry() and nxffs_findinode() only borrow the name; nothing
+ *   is freed for them.
  *
  *   Note that the nxffs_entry_s containing structure is not freed.  The
  *   caller may call kmm_free upon return of this function if necessary to
@@ -235,11 +241,13 @@ errout:
 
 void nxffs_freeentry(FAR struct nxffs_entry_s *entry)
 {
-  if (entry->name)
+  if (entry->name && !entry->borrowed)
     {
       kmm_free(entry->name);
-      entry->name = NULL;
     }
+
+  entry->name     = NULL;
+  entry->borrowed = false;
 }
 
 /****************************************************************************
@@ -263,9 +271,6 @@ void nxffs_freeentry(FAR struct nxffs_entry_s *entry)
 int nxffs_nextentry(FAR struct nxffs_volume_s *volume, off_t offset,
                     FAR struct nxffs_entry_s *entry)
 {
-  int nmagic;
-  int ch;
-  int nerased;
   int ret;
 
   /* Seek to the first FLASH offset provided by the caller. */
@@ -274,90 +279,41 @@ int nxffs_nextentry(FAR struct nxffs_volume_s *volume, off_t offset,
 
   /* Then begin searching */
 
-  nerased = 0;
-  nmagic  = 0;
   for (; ; )
     {
-      /* Read the next character */
-
-      ch = nxffs_getc(volume, SIZEOF_NXFFS_INODE_HDR - nmagic);
-      if (ch < 0)
-        {
-          fdbg("ERROR: nxffs_getc failed: %d\n", -ch);
-          return ch;
-        }
-
-      /* Check for another erased byte */
+      /* Find the next magic sequence indicating the start of an NXFFS
+       * inode.  There is the possibility of this magic sequnce occurring in
+       * FLASH data.  However, the header CRC should distinguish between
+       * real NXFFS inode headers and such false alarms.
+       */
 
-      else if (ch == CONFIG_NXFFS_ERASEDSTATE)
+      ret = nxffs_scan(volume, g_inodemagic, SIZEOF_NXFFS_INODE_HDR, &offset);
+      if (ret < 0)
         {
-          /* If we have encountered NXFFS_NERASED number of consecutive
-           * erased bytes, then presume we have reached the end of valid
-           * data.
-           */
-
-          if (++nerased >= NXFFS_NERASED)
+          if (ret == -ENOENT)
             {
               fvdbg("No entry found\n");
-              return -ENOENT;
-            }
-        }
-      else
-        {
-          nerased = 0;
-
-          /* Check for the magic sequence indicating the start of an NXFFS
-           * inode. There is the possibility of this magic sequnce occurring
-           * in FLASH data.  However, the header CRC should distinguish
-           * between real NXFFS inode headers and such false alarms.
-           */
-
-          if (ch != g_inodemagic[nmagic])
-            {
-              /* Ooops... this is the not the right character for the magic
-               * Sequence.  Check if we need to restart or to cancel the sequence:
-               */
-
-              if (ch == g_inodemagic[0])
-                {
-                  nmagic = 1;
-                }
-              else
-                {
-                  nmagic = 0;
-                }
-            }
-          else if (nmagic < NXFFS_MAGICSIZE - 1)
-            {
-              /* We have one more character in the magic sequence */
-
-              nmagic++;
             }
-
-          /* We have found the magic sequence in the FLASH data that may
-           * indicate the beginning of an NXFFS inode.
-           */
-
           else
             {
-              /* The the FLASH offset where we found the matching magic number */
-
-              offset = nxffs_iotell(volume) - NXFFS_MAGICSIZE;
-
-              /* Try to extract the inode header from that position */
+              fdbg("ERROR: nxffs_scan failed: %d\n", -ret);
+            }
 
-              ret = nxffs_rdentry(volume, offset, entry);
-              if (ret == OK)
-                {
-                  fvdbg("Found a valid fileheader, offset: %d\n", offset);
-                  return OK;
-                }
+          return ret;
+        }
 
-              /* False alarm.. keep looking */
+      /* Try to extract the inode header from that position */
 
-              nmagic = 0;
-            }
+      ret = nxffs_rdentry(volume, offset, entry);
+      if (ret == OK)
+        {
+          fvdbg("Found a valid fileheader, offset: %d\n", offset);
+          return OK;
         }
+
+      /* False alarm.. nxffs_rdentry() has left the seek position where the
+       * search should resume.  Keep looking.
+       */
     }
 
   /* We won't get here, but to keep some compilers happy: */
@@ -387,9 +343,20 @@ int nxffs_nextentry(FAR struct nxffs_volume_s *volume, off_t offset,
 int nxffs_findinode(FAR struct nxffs_volume_s *volume, FAR const char *name,
                     FAR struct nxffs_entry_s *entry)
 {
+  struct nxffs_entry_s extent;
   off_t offset;
   int ret;
 
+  /* The in-memory index answers the lookup without touching FLASH.  Only
+   * if the index could not be kept current do we need to scan for it.
+   */
+
+  ret = nxffs_idxfind(volume, name, entry);
+  if (ret != -ENOSYS)
+    {
+      return ret;
+    }
+
   /* Start with the first valid inode that was discovered when the volume
    * was created (or modified after the last file system re-packing).
    */
@@ -414,10 +381,25 @@ int nxffs_findinode(FAR struct nxffs_volume_s *volume, FAR const char *name,
 
       /* Is this the NXFFS inode we are looking for? */
 
-      else if (strcmp(name, entry->name) == 0)
+      else if (!entry->extent && strcmp(name, entry->name) == 0)
         {
-          /* Yes, return success with the entry data in 'entry' */
+          /* Yes, add up the data appended to the file in extents */
 
+          offset = entry->hoffset;
+          while (nxffs_findextent(volume, name, offset,
+                                  entry->datlen + entry->extlen,
+                                  &extent) == OK)
+            {
+              entry->extlen += extent.datlen;
+              offset         = extent.hoffset;
+              nxffs_freeentry(&extent);
+            }
+
+          /* The search for extents re-used the volume scan name buffer
+           * that the entry name was borrowed from.
+           */
+
+          strcpy(volume->scanname, name);
           return OK;
         }
 
@@ -439,6 +421,70 @@ int nxffs_findinode(FAR struct nxffs_volume_s *volume, FAR const char *name,
   return -ENOENT;
 }
 
+/****************************************************************************
+ * Name: nxffs_findextent
+ *
+ * Description:
+ *   Find the extent of a file that begins at the provided file position.
+ *   The index is used if it is valid; otherwise FLASH is searched starting
+ *   at the provided offset.
+ *
+ * Input Parameters:
+ *   volume - Describes the NXFFS volume
+ *   name   - The name of the file.  This must not be the volume scan name
+ *     buffer that is overwritten by the search.
+ *   offset - The FLASH offset to start searching at (the file inode header
+ *     or any earlier extent of the file).
+ *   fpos   - The file position of the first byte in the extent.
+ *   extent - The location to return information about the extent.
+ *
+ * Returned Value:
+ *   Zero is returned on success. Otherwise, a negated errno is returned
+ *   that indicates the nature of the failure.
+ *
+ ****************************************************************************/
+
+int nxffs_findextent(FAR struct nxffs_volume_s *volume, FAR const char *name,
+                     off_t offset, uint32_t fpos,
+                     FAR struct nxffs_entry_s *extent)
+{
+  int ret;
+
+  ret = nxffs_idxextent(volume, name, fpos, extent);
+  if (ret != -ENOSYS)
+    {
+      return ret;
+    }
+
+  /* The extents of a file follow its inode header in the order that they
+   * were written.  An extent at an earlier file position is a left-over
+   * copy from an interrupted re-packing and is skipped.
+   */
+
+  offset += SIZEOF_NXFFS_INODE_HDR;
+  for (; ; )
+    {
+      ret = nxffs_nextentry(volume, offset, extent);
+      if (ret < 0)
+        {
+          return ret;
+        }
+
+      if (extent->extent && extent->utc == fpos &&
+          strcmp(name, extent->name) == 0)
+        {
+          return OK;
+        }
+
+      offset = nxffs_inodeend(volume, extent);
+      nxffs_freeentry(extent);
+    }
+
+  /* We won't get here, but for some compilers: */
+
+  return -ENOENT;
+}
+
 /****************************************************************************
  * Name: nxffs_inodeend
  *
@@ -496,3 +542,33 @@ off_t nxffs_inodeend(FAR struct nxffs_volume_s *volume,
   DEBUGASSERT(entry->noffset);
   return entry->noffset + strlen(entry->name);
 }
+
+/****************************************************************************
+ * Name: nxffs_inodesize
+ *
+ * Description:
+ *   Return the *approximate* number of FLASH bytes occupied by an inode:
+ *   The inode header, the inode name, and the inode data with its data
+ *   block headers.  This is used to keep the volume space accounting
+ *   current without scanning FLASH.
+ *
+ * Input Parameters:
+ *   volume - Describes the NXFFS volume
+ *   entry  - Describes the inode.
+ *
+ * Returned Value:
+ *   The (approximate) size of the inode in FLASH.  No errors are detected.
+ *
+ ****************************************************************************/
+
+off_t nxffs_inodesize(FAR struct nxffs_volume_s *volume,
+                      FAR struct nxffs_entry_s *entry)
+{
+  uint16_t maxsize = volume->geo.blocksize - SIZEOF_NXFFS_BLOCK_HDR - SIZEOF_NXFFS_DATA_HDR;
+  off_t minblocks  = (entry->datlen + maxsize - 1) / maxsize;
+
+  /* As with nxffs_inodeend(), assume the minimum number of data blocks */
+
+  return SIZEOF_NXFFS_INODE_HDR + strlen(entry->name) + entry->datlen +
+         minblocks * SIZEOF_NXFFS_DATA_HDR;
+}
@@ -108,7 +108,7 @@ int nxffs_ioctl(FAR struct file *filep, int cmd, unsigned long arg)
       goto errout;
     }
 
-  /* Only a reformat and optimize commands are supported */
+  /* Only reformat, optimize, and cache statistics commands are supported */
 
   if (cmd == FIOC_REFORMAT)
     {
@@ -123,18 +123,54 @@ int nxffs_ioctl(FAR struct file *filep, int cmd, unsigned long arg)
           goto errout_with_semaphore;
         }
 
-      /* Re-format the volume -- all is lost */
+      /* Re-format the volume -- all is lost.  Then find the (now empty)
+       * free FLASH region again.
+       */
 
       ret = nxffs_reformat(volume);
+      if (ret == OK)
+        {
+          ret = nxffs_limits(volume);
+        }
     }
 
   else if (cmd == FIOC_OPTIMIZE)
     {
-      fvdbg("Optimize command\n");
+      fvdbg("Optimize command, budget: %lu\n", arg);
+
+      /* Pack the volume.  A non-zero argument limits the number of inodes
+       * moved so that the volume is unavailable only briefly; it returns
+       * the number of inodes moved (zero when there is nothing left to do).
+       */
+
+      if (arg > 0)
+        {
+          ret = nxffs_packstep(volume, (uint32_t)arg);
+        }
+      else
+        {
+          ret = nxffs_pack(volume);
+        }
+    }
+
+  else if (cmd == FIOC_CACHESTATS)
+    {
+      FAR struct nxffs_cachestats_s *stats =
+        (FAR struct nxffs_cachestats_s *)((uintptr_t)arg);
+
+      fvdbg("Cache statistics command\n");
+
+      if (!stats)
+        {
+          ret = -EINVAL;
+          goto errout_with_semaphore;
+        }
 
-      /* Pack the volume */
+      /* Return a snapshot of the block cache statistics */
 
-      ret = nxffs_pack(volume);
+      volume->cstats.nblocks = CONFIG_NXFFS_CACHE_NBLOCKS;
+      memcpy(stats, &volume->cstats, sizeof(struct nxffs_cachestats_s));
+      ret = OK;
     }
   else
     {
@@ -67,14 +67,6 @@
  * Private Data
  ****************************************************************************/
 
-/* Since we are limited to a single file opened for writing, it makes sense
- * to pre-allocate the write state structure.
- */
-
-#ifdef CONFIG_NXFFS_PREALLOCATED
-static struct nxffs_wrfile_s g_wrfile;
-#endif
-
 /****************************************************************************
  * Public Data
  ****************************************************************************/
@@ -376,173 +368,35 @@ static inline int nxffs_wrname(FAR struct nxffs_volume_s *volume,
 }
 
 /****************************************************************************
- * Name: nxffs_wropen
+ * Name: nxffs_wrinodealloc
  *
  * Description:
- *   Handle opening for writing.  Only a single writer is permitted and only
- *   file creation is supported.
+ *   Allocate FLASH memory for the inode header and write the inode name.
+ *   This is the first step in committing a file to FLASH when it is
+ *   closed.
+ *
+ * Input parameters
+ *   volume - Describes the NXFFS volume
+ *   wrfile - Describes the state of the open file
+ *
+ * Returned Value:
+ *   Zero is returned on success; Otherwise, a negated errno value is returned
+ *   indicating the nature of the failure.
  *
  ****************************************************************************/
 
-static inline int nxffs_wropen(FAR struct nxffs_volume_s *volume,
-                               FAR const char *name, mode_t oflags,
-                               FAR struct nxffs_ofile_s **ppofile)
+static inline int nxffs_wrinodealloc(FAR struct nxffs_volume_s *volume,
+                                     FAR struct nxffs_wrfile_s *wrfile)
 {
-  FAR struct nxffs_wrfile_s *wrfile;
-  FAR struct nxffs_entry_s entry;
   bool packed;
-  bool truncate = false;
   int namlen;
   int ret;
 
-  /* Limitation: Only a single writer is permitted.  Writing may involve
-   * extension of the file system in FLASH.  Since files are contiguous
-   * in FLASH, only a single file may be extending the FLASH region.
-   */
-
-  ret = sem_wait(&volume->wrsem);
-  if (ret != OK)
-    {
-      fdbg("ERROR: sem_wait failed: %d\n", ret);
-      ret = -get_errno();
-      goto errout;
-    }
-
-  /* Get exclusive access to the volume.  Note that the volume exclsem
-   * protects the open file list.  Note that exclsem is ALWAYS taken
-   * after wrsem to avoid deadlocks.
-   */
-
-  ret = sem_wait(&volume->exclsem);
-  if (ret != OK)
-    {
-      fdbg("ERROR: sem_wait failed: %d\n", ret);
-      ret = -get_errno();
-      goto errout_with_wrsem;
-    }
-
-  /* Check if the file exists */
-
-  ret = nxffs_findinode(volume, name, &entry);
-  if (ret == OK)
-    {
-      FAR struct nxffs_ofile_s *ofile;
-
-      /* It exists.  Release the entry. */
-
-      nxffs_freeentry(&entry);
-
-      /* Is the file already open for reading? */
-
-      ofile = nxffs_findofile(volume, name);
-      if (ofile)
-        {
-          /* The file is already open.
-           * Limitation:  Files cannot be open both for reading and writing.
-           */
-
-          fdbg("ERROR: File is open for reading\n");
-          ret = -ENOSYS;
-          goto errout_with_exclsem;
-        }
-
-      /* It would be an error if we are asked to create the file
-       * exclusively.
-       */
-
-      else if ((oflags & (O_CREAT | O_EXCL)) == (O_CREAT | O_EXCL))
-        {
-          fdbg("ERROR: File exists, can't create O_EXCL\n");
-          ret = -EEXIST;
-          goto errout_with_exclsem;
-        }
-
-      /* Were we asked to truncate the file?  NOTE: Don't truncate the
-       * file if we were not also asked to created it.  See below...
-       * we will not re-create the file unless O_CREAT is also specified.
-       */
+  namlen = strlen(wrfile->ofile.entry.name);
 
-      else if ((oflags & (O_CREAT | O_TRUNC)) == (O_CREAT | O_TRUNC))
-        {
-          /* Just schedule the removal the file and fall through to re-create it.
-           * Note that the old file of the same name will not actually be removed
-           * until the new file is successfully written.
-           */
-
-          truncate = true;
-        }
-
-      /* The file exists and we were not asked to truncate (and recreate) it.
-       * Limitation: Cannot write to existing files.
-       */
-
-      else
-        {
-          fdbg("ERROR: File %s exists and we were not asked to truncate it\n");
-          ret = -ENOSYS;
-          goto errout_with_exclsem;
-        }
-    }
-
-  /* Okay, the file is not open and does not exists (maybe because we deleted
-   * it).  Now, make sure that we were asked to created it.
-   */
-
-  if ((oflags & O_CREAT) == 0)
-    {
-      fdbg("ERROR: Not asked to create the file\n");
-      ret = -ENOENT;
-      goto errout_with_exclsem;
-    }
-
-  /* Make sure that the length of the file name will fit in a uint8_t */
-
-  namlen = strlen(name);
-  if (namlen > CONFIG_NXFFS_MAXNAMLEN)
-    {
-      fdbg("ERROR: Name is too long: %d\n", namlen);
-      ret = -EINVAL;
-      goto errout_with_exclsem;
-    }
-
-  /* Yes.. Create a new structure that will describe the state of this open
-   * file.  NOTE that a special variant of the open file structure is used
-   * that includes additional information to support the write operation.
-   */
-
-#ifdef CONFIG_NXFFS_PREALLOCATED
-  wrfile = &g_wrfile;
-  memset(wrfile, 0, sizeof(struct nxffs_wrfile_s));
-#else
-  wrfile = (FAR struct nxffs_wrfile_s *)kmm_zalloc(sizeof(struct nxffs_wrfile_s));
-  if (!wrfile)
-    {
-      ret = -ENOMEM;
-      goto errout_with_exclsem;
-    }
-#endif
-
-  /* Initialize the open file state structure */
-
-  wrfile->ofile.crefs     = 1;
-  wrfile->ofile.oflags    = oflags;
-  wrfile->ofile.entry.utc = time(NULL);
-  wrfile->truncate        = truncate;
-
-  /* Save a copy of the inode name. */
-
-  wrfile->ofile.entry.name = strdup(name);
-  if (!wrfile->ofile.entry.name)
-    {
-      ret = -ENOMEM;
-      goto errout_with_ofile;
-    }
-
-  /* Allocate FLASH memory for the file and set up for the write.
-   *
-   * Loop until the inode header is configured or until a failure occurs.
+  /* Loop until the inode header is configured or until a failure occurs.
    * Note that nothing is written to FLASH.  The inode header is not
-   * written until the file is closed.
+   * written until all of the file data has been written.
    */
 
   packed = false;
@@ -575,7 +429,7 @@ static inline int nxffs_wropen(FAR struct nxffs_volume_s *volume,
       if (ret != -ENOSPC || packed)
         {
           fdbg("ERROR: Failed to find inode header memory: %d\n", -ret);
-          goto errout_with_name;
+          return ret;
         }
 
       /* -ENOSPC is a special case..  It means that the volume is full.
@@ -586,7 +440,7 @@ static inline int nxffs_wropen(FAR struct nxffs_volume_s *volume,
       if (ret < 0)
         {
           fdbg("ERROR: Failed to pack the volume: %d\n", -ret);
-          goto errout_with_name;
+          return ret;
         }
 
       /* After packing the volume, froffset will be updated to point to the
@@ -622,7 +476,7 @@ static inline int nxffs_wropen(FAR struct nxffs_volume_s *volume,
               if (ret < 0)
                 {
                   fdbg("ERROR: Failed to write the inode name: %d\n", -ret);
-                  goto errout_with_name;
+                  return ret;
                 }
 
               /* Then just break out of the loop reporting success.  Note
@@ -641,7 +495,7 @@ static inline int nxffs_wropen(FAR struct nxffs_volume_s *volume,
       if (ret != -ENOSPC || packed)
         {
           fdbg("ERROR: Failed to find inode name memory: %d\n", -ret);
-          goto errout_with_name;
+          return ret;
         }
 
       /* -ENOSPC is a special case..  It means that the volume is full.
@@ -652,7 +506,7 @@ static inline int nxffs_wropen(FAR struct nxffs_volume_s *volume,
       if (ret < 0)
         {
           fdbg("ERROR: Failed to pack the volume: %d\n", -ret);
-          goto errout_with_name;
+          return ret;
         }
 
       /* After packing the volume, froffset will be updated to point to the
@@ -662,32 +516,194 @@ static inline int nxffs_wropen(FAR struct nxffs_volume_s *volume,
       packed = true;
     }
 
+  return OK;
+}
+
+/****************************************************************************
+ * Name: nxffs_wropen
+ *
+ * Description:
+ *   Handle opening for writing.  Only file creation and, with
+ *   CONFIG_NXFFS_APPEND_EXTENTS, appending to an existing file (O_APPEND)
+ *   are supported.  Nothing is written to FLASH
+ *   until the file is closed, so any number of files may be open for
+ *   writing at the same time.
+ *
+ ****************************************************************************/
+
+static inline int nxffs_wropen(FAR struct nxffs_volume_s *volume,
+                               FAR const char *name, mode_t oflags,
+                               FAR struct nxffs_ofile_s **ppofile)
+{
+  FAR struct nxffs_wrfile_s *wrfile;
+  FAR struct nxffs_entry_s entry;
+  bool truncate = false;
+  bool append = false;
+  uint32_t filelen = 0;
+  int namlen;
+  int ret;
+
+  /* Get exclusive access to the volume.  Note that the volume exclsem
+   * protects the open file list.
+   */
+
+  ret = sem_wait(&volume->exclsem);
+  if (ret != OK)
+    {
+      fdbg("ERROR: sem_wait failed: %d\n", ret);
+      ret = -get_errno();
+      goto errout;
+    }
+
+  /* Is the file already open?  It may be open for reading or it may be
+   * open by another writer that has not yet committed it to FLASH.
+   * Limitation:  Files cannot be open both for reading and writing.
+   */
+
+  if (nxffs_findofile(volume, name))
+    {
+      fdbg("ERROR: File is already open\n");
+      ret = -ENOSYS;
+      goto errout_with_exclsem;
+    }
+
+  /* Check if the file exists */
+
+  ret = nxffs_findinode(volume, name, &entry);
+  if (ret == OK)
+    {
+      /* It exists.  Release the entry. */
+
+      filelen = entry.datlen + entry.extlen;
+      nxffs_freeentry(&entry);
+
+      /* It would be an error if we are asked to create the file
+       * exclusively.
+       */
+
+      if ((oflags & (O_CREAT | O_EXCL)) == (O_CREAT | O_EXCL))
+        {
+          fdbg("ERROR: File exists, can't create O_EXCL\n");
+          ret = -EEXIST;
+          goto errout_with_exclsem;
+        }
+
+      /* Were we asked to truncate the file?  NOTE: Don't truncate the
+       * file if we were not also asked to created it.  See below...
+       * we will not re-create the file unless O_CREAT is also specified.
+       */
+
+      else if ((oflags & (O_CREAT | O_TRUNC)) == (O_CREAT | O_TRUNC))
+        {
+          /* Just schedule the removal the file and fall through to re-create it.
+           * Note that the old file of the same name will not actually be removed
+           * until the new file is successfully written.
+           */
+
+          truncate = true;
+        }
+
+#ifdef CONFIG_NXFFS_APPEND_EXTENTS
+      /* Were we asked to append to the file?  The data written will be
+       * added to the file as a new extent when the file is closed.
+       */
+
+      else if ((oflags & O_APPEND) != 0)
+        {
+          append = true;
+        }
+#endif
+
+      /* The file exists and we were not asked to truncate (and recreate) it
+       * or to append to it.
+       * Limitation: Cannot otherwise write to existing files.  Appending
+       * requires CONFIG_NXFFS_APPEND_EXTENTS.
+       */
+
+      else
+        {
+          fdbg("ERROR: File %s exists and we were not asked to truncate it\n");
+          ret = -ENOSYS;
+          goto errout_with_exclsem;
+        }
+    }
+
+  /* Okay, the file is not open and does not exists (maybe because we deleted
+   * it).  Now, make sure that we were asked to created it.
+   */
+
+  if (!append && (oflags & O_CREAT) == 0)
+    {
+      fdbg("ERROR: Not asked to create the file\n");
+      ret = -ENOENT;
+      goto errout_with_exclsem;
+    }
+
+  /* Make sure that the length of the file name will fit in a uint8_t */
+
+  namlen = strlen(name);
+  if (namlen > CONFIG_NXFFS_MAXNAMLEN)
+    {
+      fdbg("ERROR: Name is too long: %d\n", namlen);
+      ret = -EINVAL;
+      goto errout_with_exclsem;
+    }
+
+  /* Yes.. Create a new structure that will describe the state of this open
+   * file.  NOTE that a special variant of the open file structure is used
+   * that includes additional information to support the write operation.
+   */
+
+  wrfile = (FAR struct nxffs_wrfile_s *)kmm_zalloc(sizeof(struct nxffs_wrfile_s));
+  if (!wrfile)
+    {
+      ret = -ENOMEM;
+      goto errout_with_exclsem;
+    }
+
+  /* Initialize the open file state structure */
+
+  wrfile->ofile.crefs     = 1;
+  wrfile->ofile.oflags    = oflags;
+  wrfile->ofile.entry.utc = time(NULL);
+  wrfile->truncate        = truncate;
+
+  /* An extent records the file position of its first byte in place of the
+   * time stamp.
+   */
+
+  if (append)
+    {
+      wrfile->ofile.entry.extent = true;
+      wrfile->ofile.entry.utc    = filelen;
+    }
+
+  /* Save a copy of the inode name. */
+
+  wrfile->ofile.entry.name = strdup(name);
+  if (!wrfile->ofile.entry.name)
+    {
+      ret = -ENOMEM;
+      goto errout_with_ofile;
+    }
+
   /* Add the open file structure to the head of the list of open files */
 
   wrfile->ofile.flink = volume->ofiles;
   volume->ofiles      = &wrfile->ofile;
 
-  /* Indicate that the volume is open for writing and return the open file
-   * instance.  Releasing exclsem allows other readers while the write is
-   * in progress.  But wrsem is still held for this open file, preventing
-   * any further writers until this inode is closed.s
+  /* Return the open file instance.  The data written to the file will be
+   * staged in memory until the file is closed.
    */
 
   *ppofile = &wrfile->ofile;
   sem_post(&volume->exclsem);
   return OK;
 
-errout_with_name:
-  kmm_free(wrfile->ofile.entry.name);
 errout_with_ofile:
-#ifndef CONFIG_NXFFS_PREALLOCATED
   kmm_free(wrfile);
-#endif
-
 errout_with_exclsem:
   sem_post(&volume->exclsem);
-errout_with_wrsem:
-  sem_post(&volume->wrsem);
 errout:
   return ret;
 }
@@ -750,7 +766,7 @@ static inline int nxffs_rdopen(FAR struct nxffs_volume_s *volume,
     {
       /* Not already open.. create a new open structure */
 
-      ofile = (FAR struct nxffs_ofile_s *)kmm_zalloc(sizeof(struct nxffs_ofile_s));
+      ofile = (FAR struct nxffs_ofile_s *)kmm_zalloc(sizeof(struct nxffs_rdfile_s));
       if (!ofile)
         {
           fdbg("ERROR: ofile allocation failed\n");
@@ -772,6 +788,18 @@ static inline int nxffs_rdopen(FAR struct nxffs_volume_s *volume,
           goto errout_with_ofile;
         }
 
+      /* The entry only borrows the name.  Keep a copy for as long as the
+       * file is open.
+       */
+
+      ofile->entry.name     = strdup(name);
+      ofile->entry.borrowed = false;
+      if (!ofile->entry.name)
+        {
+          ret = -ENOMEM;
+          goto errout_with_ofile;
+        }
+
       /* Add the open file structure to the head of the list of open files */
 
       ofile->flink   = volume->ofiles;
@@ -848,27 +876,42 @@ static inline void nxffs_freeofile(FAR struct nxffs_volume_s *volume,
 
   nxffs_freeentry(&ofile->entry);
 
-  /* Then free the open file container (unless this the pre-alloated
-   * write-only open file container)
+  /* Release the skip index of a file open for reading or the staged data
+   * of a file open for writing.
    */
 
-#ifdef CONFIG_NXFFS_PREALLOCATED
-  if ((FAR struct nxffs_wrfile_s *)ofile != &g_wrfile)
-#endif
+  if ((ofile->oflags & O_WROK) == 0)
+    {
+      kmm_free(((FAR struct nxffs_rdfile_s *)ofile)->skip);
+    }
+  else
     {
-      kmm_free(ofile);
+      volume->reserved -= ((FAR struct nxffs_wrfile_s *)ofile)->reserved;
+      kmm_free(((FAR struct nxffs_wrfile_s *)ofile)->stage);
     }
+
+  /* Then free the open file container */
+
+  kmm_free(ofile);
 }
 
 /****************************************************************************
  * Name: nxffs_wrclose
  *
  * Description:
- *   Perform special operations when a file is closed:
- *   1. Write the file block header
- *   2. Remove any file with the same name that was discovered when the
+ *   Commit a file to FLASH when it is closed:
+ *   1. Allocate the inode header and write the inode name,
+ *   2. Write the staged file data and the final file block header,
+ *   3. Remove any file with the same name that was discovered when the
  *      file was open for writing, and finally,
- *   3. Write the new file inode.
+ *   4. Write the new file inode.
+ *
+ *   When appending to a file, the inode written is an extent of the file.
+ *   Nothing is written if no data was appended.
+ *
+ *   The caller holds exclsem throughout, so the file is written
+ *   contiguously at the end of the FLASH just as if it had been the only
+ *   writer.
  *
  * Input parameters
  *   volume - Describes the NXFFS volume
@@ -881,6 +924,36 @@ static inline int nxffs_wrclose(FAR struct nxffs_volume_s *volume,
 {
   int ret;
 
+  /* An empty extent would add nothing to the file */
+
+  if (wrfile->ofile.entry.extent && wrfile->stglen == 0)
+    {
+      return OK;
+    }
+
+  /* This is now the writer with data on FLASH.  If the volume must be
+   * re-packed, the packing logic will find it.
+   */
+
+  volume->wrfile = wrfile;
+
+  /* Allocate FLASH memory for the inode header and write the inode name */
+
+  ret = nxffs_wrinodealloc(volume, wrfile);
+  if (ret < 0)
+    {
+      goto errout;
+    }
+
+  /* Write the staged data */
+
+  ret = nxffs_wrdata(volume, wrfile);
+  if (ret < 0)
+    {
+      fdbg("ERROR: Failed to write the file data: %d\n", -ret);
+      goto errout;
+    }
+
   /* Is there an unfinalized write data? */
 
   if (wrfile->datlen > 0)
@@ -914,14 +987,24 @@ static inline int nxffs_wrclose(FAR struct nxffs_volume_s *volume,
         }
     }
 
-  /* Write the inode header to FLASH */
+  /* Write the inode header to FLASH and add the new inode (or the new
+   * extent of the file) to the index.
+   */
 
   ret = nxffs_wrinode(volume, &wrfile->ofile.entry);
+  if (ret == OK)
+    {
+      (void)nxffs_idxinsert(volume, &wrfile->ofile.entry);
+      if (!wrfile->ofile.entry.extent)
+        {
+          volume->ninodes++;
+        }
 
-  /* The volume is now available for other writers */
+      volume->livebytes += nxffs_inodesize(volume, &wrfile->ofile.entry);
+    }
 
 errout:
-  sem_post(&volume->wrsem);
+  volume->wrfile = NULL;
   return ret;
 }
 
@@ -972,29 +1055,22 @@ FAR struct nxffs_ofile_s *nxffs_findofile(FAR struct nxffs_volume_s *volume,
  * Name: nxffs_findwriter
  *
  * Description:
- *   Search the list of already opened files and return the open file
- *   instance for the write.
+ *   Return the open file instance of the writer whose data is currently
+ *   being committed to FLASH.  Other writers hold their data in memory and
+ *   have nothing on FLASH.
  *
  * Input Parameters:
  *   volume - Describes the NXFFS volume.
  *
  * Returned Value:
- *   If there is an active writer of the volume, its open file instance is
+ *   If a writer is being committed to FLASH, its open file instance is
  *   returned.  NULL is returned otherwise.
  *
  ****************************************************************************/
 
 FAR struct nxffs_wrfile_s *nxffs_findwriter(FAR struct nxffs_volume_s *volume)
 {
-  /* We can tell if the write is in-use because it will have an allocated
-   * name attached.
-   */
-
-#ifdef CONFIG_NXFFS_PREALLOCATED
-  return g_wrfile.ofile.entry.name != NULL ? &g_wrfile : NULL;
-#else
-#  error "Missing implementation"
-#endif
+  return volume->wrfile;
 }
 
 /****************************************************************************
@@ -1109,12 +1185,11 @@ int nxffs_dup(FAR const struct file *oldp, FAR struct file *newp)
 
   /* Limitations: I do not think we have to be concerned about the
    * usual NXFFS file limitations here:  dup'ing cannot resulting
-   * in mixed reading and writing to the same file, or multiple
-   * writer to different file.
+   * in mixed reading and writing to the same file.
    *
-   * I notice that nxffs_wropen will prohibit multiple opens for
-   * writing. But I do not thing that dup'ing a file already opened
-   * for writing suffers from any of these issues.
+   * I notice that nxffs_wropen will prohibit multiple opens of the same
+   * file for writing.  But I do not thing that dup'ing a file already
+   * opened for writing suffers from any of these issues.
    */
 
   /* Just increment the reference count on the ofile */
@@ -1273,7 +1348,7 @@ int nxffs_wrinode(FAR struct nxffs_volume_s *volume,
 
   /* Finish the inode header */
 
-  inode->state = INODE_STATE_FILE;
+  inode->state = entry->extent ? INODE_STATE_EXTENT : INODE_STATE_FILE;
   nxffs_wrle32(inode->crc, crc);
 
   /* Write the block with the inode header */
@@ -1285,10 +1360,7 @@ int nxffs_wrinode(FAR struct nxffs_volume_s *volume,
            volume->ioblock, -ret);
     }
 
-  /* The volume is now available for other writers */
-
 errout:
-  sem_post(&volume->wrsem);
   return ret;
 }
 
@@ -1314,10 +1386,22 @@ int nxffs_updateinode(FAR struct nxffs_volume_s *volume,
 {
   FAR struct nxffs_ofile_s *ofile;
 
-  /* Find the open inode structure matching this name */
+  /* Extents are found through the index; open files only hold the file
+   * inode.
+   */
+
+  if (entry->extent)
+    {
+      return OK;
+    }
+
+  /* Find the open inode structure matching this name.  A file open for
+   * writing is not on FLASH yet:  It may have the same name as the inode
+   * that was moved, but the packing logic updates a writer separately.
+   */
 
   ofile = nxffs_findofile(volume, entry->name);
-  if (ofile)
+  if (ofile && (ofile->oflags & O_WROK) == 0)
     {
       /* Yes.. the file is open.  Update the FLASH offsets to inode headers */
 
@@ -55,6 +55,14 @@
  * Pre-processor Definitions
  ****************************************************************************/
 
+/* When an incremental packing step stops, the FLASH between the last inode
+ * moved and the first inode not yet moved is filled with this value.  It is
+ * not the erased value, so the space is not mistaken for the end of the
+ * inodes, and it never begins a header magic sequence.
+ */
+
+#define NXFFS_PACKFILL (CONFIG_NXFFS_ERASEDSTATE ^ 0xff)
+
 /****************************************************************************
  * Public Types
  ****************************************************************************/
@@ -86,6 +94,16 @@ struct nxffs_pack_s
   off_t                ioblock;    /* I/O block number */
   off_t                block0;     /* First I/O block number in the erase block */
   uint16_t             iooffset;   /* I/O block offset */
+
+  /* Name of the inode being moved (dest.entry borrows it) */
+
+  char                 name[CONFIG_NXFFS_MAXNAMLEN + 1];
+
+  /* These support incremental packing */
+
+  uint32_t             budget;     /* Maximum number of inodes to move (0: all) */
+  uint32_t             nmoved;     /* Number of inodes moved so far */
+  bool                 stop;       /* True: The budget is used up */
 };
 
 /****************************************************************************
@@ -182,6 +200,56 @@ static inline bool nxffs_packvalid(FAR struct nxffs_pack_s *pack)
           blkhdr->state == BLOCK_STATE_GOOD);
 }
 
+/****************************************************************************
+ * Name: nxffs_packentry
+ *
+ * Description:
+ *   Search for the next inode to be packed starting at the provided FLASH
+ *   offset.  This is nxffs_nextentry() except that file extents that no
+ *   longer belong to a file (because the file was removed or because they
+ *   are left-over copies from an interrupted packing) are skipped.  They
+ *   are not copied and so are discarded by the packing.
+ *
+ * Input Parameters:
+ *   volume - The volume to be packed.
+ *   offset - The FLASH memory offset to begin searching.
+ *   entry  - A pointer to memory provided by the caller in which to return
+ *     the inode description.
+ *
+ * Returned Values:
+ *   Zero on success; Otherwise, a negated errno value is returned to
+ *   indicate the nature of the failure.
+ *
+ ****************************************************************************/
+
+static int nxffs_packentry(FAR struct nxffs_volume_s *volume, off_t offset,
+                           FAR struct nxffs_entry_s *entry)
+{
+  struct nxffs_entry_s extent;
+  int ret;
+
+  for (; ; )
+    {
+      ret = nxffs_nextentry(volume, offset, entry);
+      if (ret < 0 || !entry->extent)
+        {
+          return ret;
+        }
+
+      /* Without a valid index, all extents must be kept */
+
+      ret = nxffs_idxextent(volume, entry->name, entry->utc, &extent);
+      if (ret == -ENOSYS || (ret == OK && extent.hoffset == entry->hoffset))
+        {
+          return OK;
+        }
+
+      fvdbg("Discarding extent at offset %d\n", entry->hoffset);
+      offset = nxffs_inodeend(volume, entry);
+      nxffs_freeentry(entry);
+    }
+}
+
 /****************************************************************************
  * Name: nxffs_mediacheck
  *
@@ -232,7 +300,7 @@ static inline off_t nxffs_mediacheck(FAR struct nxffs_volume_s *volume,
 
   /* Get the offset to the first valid inode entry after this free offset */
 
-  ret = nxffs_nextentry(volume, froffset, &pack->src.entry);
+  ret = nxffs_packentry(volume, froffset, &pack->src.entry);
   if (ret < 0)
     {
       /* No valid entries on the media -- Return offset zero */
@@ -303,13 +371,18 @@ static inline int nxffs_startpos(FAR struct nxffs_volume_s *volume,
            * inode header (only non-zero entries need to be initialized).
            */
 
-          pack->dest.entry.name    = pack->src.entry.name;
-          pack->dest.entry.utc     = pack->src.entry.utc;
-          pack->dest.entry.datlen  = pack->src.entry.datlen;
+          strcpy(pack->name, pack->src.entry.name);
+          pack->dest.entry.name     = pack->name;
+          pack->dest.entry.borrowed = true;
+          pack->dest.entry.utc      = pack->src.entry.utc;
+          pack->dest.entry.datlen   = pack->src.entry.datlen;
+          pack->dest.entry.extent   = pack->src.entry.extent;
 
-          /* The destination entry now "owns" the name string */
+          /* The source name is only borrowed from the volume scan buffer.
+           * Keep a copy with the destination entry.
+           */
 
-          pack->src.entry.name     = NULL;
+          pack->src.entry.name      = NULL;
 
           /* Return the FLASH offset to the destination inode header */
 
@@ -317,16 +390,20 @@ static inline int nxffs_startpos(FAR struct nxffs_volume_s *volume,
           return OK;
         }
 
-      /* Free the allocated memory in the entry */
-
-      nxffs_freeentry(&pack->src.entry);
-
       /* Update the offset to the first byte at the end of the last data
-       * block.
+       * block.  Zero-length files end with the inode name.
        */
 
       nbytes = 0;
       offset = pack->src.entry.doffset;
+      if (offset == 0)
+        {
+          offset = nxffs_inodeend(volume, &pack->src.entry);
+        }
+
+      /* Free the allocated memory in the entry */
+
+      nxffs_freeentry(&pack->src.entry);
 
       while (nbytes < pack->src.entry.datlen)
         {
@@ -350,11 +427,19 @@ static inline int nxffs_startpos(FAR struct nxffs_volume_s *volume,
       /* Make sure there is space at this location for an inode header */
 
       nxffs_ioseek(volume, offset);
-      if (volume->iooffset + SIZEOF_NXFFS_INODE_HDR > volume->geo.blocksize)
+      if (volume->iooffset < SIZEOF_NXFFS_BLOCK_HDR ||
+          volume->iooffset + SIZEOF_NXFFS_INODE_HDR > volume->geo.blocksize)
         {
-          /* No.. not enough space here. Find the next valid block */
+          /* No.. not enough space here. Find the next valid block.  If the
+           * data ended exactly at the end of a block, then the offset
+           * already refers to the next block.
+           */
+
+          if (volume->iooffset >= SIZEOF_NXFFS_BLOCK_HDR)
+            {
+              volume->ioblock++;
+            }
 
-          volume->ioblock++;
           ret = nxffs_validblock(volume, &volume->ioblock);
           if (ret < 0)
             {
@@ -372,7 +457,7 @@ static inline int nxffs_startpos(FAR struct nxffs_volume_s *volume,
 
       /* Get the offset to the next valid inode entry */
 
-      ret = nxffs_nextentry(volume, offset, &pack->src.entry);
+      ret = nxffs_packentry(volume, offset, &pack->src.entry);
       if (ret < 0)
         {
           /* No more valid inode entries.  Just return an end-of-flash error
@@ -700,20 +785,30 @@ static int nxffs_wrinodehdr(FAR struct nxffs_volume_s *volume,
 
       /* Finish the inode header */
 
-      inode->state = INODE_STATE_FILE;
+      inode->state = pack->dest.entry.extent ? INODE_STATE_EXTENT :
+                                               INODE_STATE_FILE;
       nxffs_wrle32(inode->crc, crc);
+      ret = OK;
+    }
 
-      /* If any open files reference this inode, then update the open file
-       * state.
-       */
+  /* If any open files reference this inode, then update the open file
+   * state.  This is needed in both cases:  A reader of the file must
+   * follow the inode to its new location whichever block it landed in.
+   */
 
-      ret = nxffs_updateinode(volume, &pack->dest.entry);
-      if (ret < 0)
-        {
-          fdbg("ERROR: Failed to update inode info: %s\n", -ret);
-        }
+  (void)nxffs_updateinode(volume, &pack->dest.entry);
+
+  /* The inode may have moved ahead of the first inode on the volume */
+
+  if (pack->dest.entry.hoffset < volume->inoffset)
+    {
+      volume->inoffset = pack->dest.entry.hoffset;
     }
 
+  /* The inode has moved; update its index entry */
+
+  (void)nxffs_idxinsert(volume, &pack->dest.entry);
+
   /* Reset the dest inode information */
 
   nxffs_freeentry(&pack->dest.entry);
@@ -954,13 +1049,24 @@ static inline int nxffs_packblock(FAR struct nxffs_volume_s *volume,
 
           nxffs_wrdathdr(volume, pack);
           nxffs_wrinodehdr(volume, pack);
+          pack->nmoved++;
+
+          /* Find the next valid source inode.  Zero-length files have no
+           * data block; search from the end of the inode header instead.
+           */
 
-          /* Find the next valid source inode */
+          if (pack->src.blkoffset > 0)
+            {
+              offset = pack->src.blkoffset + pack->src.blklen;
+            }
+          else
+            {
+              offset = pack->src.entry.hoffset + SIZEOF_NXFFS_INODE_HDR;
+            }
 
-          offset = pack->src.blkoffset + pack->src.blklen;
           memset(&pack->src, 0, sizeof(struct nxffs_packstream_s));
 
-          ret = nxffs_nextentry(volume, offset, &pack->src.entry);
+          ret = nxffs_packentry(volume, offset, &pack->src.entry);
           if (ret < 0)
             {
               /* No more valid inode entries.  Just return an end-of-flash error
@@ -970,6 +1076,16 @@ static inline int nxffs_packblock(FAR struct nxffs_volume_s *volume,
               return -ENOSPC;
             }
 
+          /* Stop between inodes if the budget of an incremental packing
+           * step has been used up.
+           */
+
+          if (pack->budget > 0 && pack->nmoved >= pack->budget)
+            {
+              pack->stop = true;
+              return OK;
+            }
+
           /* Setup the new source stream */
 
           ret = nxffs_srcsetup(volume, pack, pack->src.entry.doffset);
@@ -981,10 +1097,13 @@ static inline int nxffs_packblock(FAR struct nxffs_volume_s *volume,
           /* Setup the dest stream */
 
           memset(&pack->dest, 0, sizeof(struct nxffs_packstream_s));
-          pack->dest.entry.name   = pack->src.entry.name;
-          pack->dest.entry.utc    = pack->src.entry.utc;
-          pack->dest.entry.datlen = pack->src.entry.datlen;
-          pack->src.entry.name    = NULL;
+          strcpy(pack->name, pack->src.entry.name);
+          pack->dest.entry.name     = pack->name;
+          pack->dest.entry.borrowed = true;
+          pack->dest.entry.utc      = pack->src.entry.utc;
+          pack->dest.entry.datlen   = pack->src.entry.datlen;
+          pack->dest.entry.extent   = pack->src.entry.extent;
+          pack->src.entry.name      = NULL;
 
           /* Is there sufficient space at the end of the I/O block to hold
            * the inode header?
@@ -1098,9 +1217,12 @@ nxffs_setupwriter(FAR struct nxffs_volume_s *volume,
           /* Initialize for the packing operation. */
 
            memset(&pack->dest, 0, sizeof(struct nxffs_packstream_s));
-           pack->dest.entry.name   = strdup(wrfile->ofile.entry.name);
-           pack->dest.entry.utc    = wrfile->ofile.entry.utc;
-           pack->dest.entry.datlen = wrfile->ofile.entry.datlen;
+           strcpy(pack->name, wrfile->ofile.entry.name);
+           pack->dest.entry.name     = pack->name;
+           pack->dest.entry.borrowed = true;
+           pack->dest.entry.utc      = wrfile->ofile.entry.utc;
+           pack->dest.entry.datlen   = wrfile->ofile.entry.datlen;
+           pack->dest.entry.extent   = wrfile->ofile.entry.extent;
 
            memset(&pack->src, 0, sizeof(struct nxffs_packstream_s));
            memcpy(&pack->src.entry, &wrfile->ofile.entry, sizeof(struct nxffs_entry_s));
@@ -1248,18 +1370,70 @@ static inline int nxffs_packwriter(FAR struct nxffs_volume_s *volume,
 }
 
 /****************************************************************************
- * Public Functions
+ * Name: nxffs_packfill
+ *
+ * Description:
+ *   An incremental packing step has stopped between two inodes.  Fill the
+ *   part of the current erase block between the last inode moved and the
+ *   first FLASH that must be kept with NXFFS_PACKFILL.  That region holds
+ *   only stale copies of the inodes that were moved.
+ *
+ * Input Parameters:
+ *   volume - The volume being packed
+ *   pack   - The volume packing state structure.
+ *   keep   - FLASH offset of the first byte that must be kept
+ *
+ * Returned Values:
+ *   None.
+ *
  ****************************************************************************/
 
+static void nxffs_packfill(FAR struct nxffs_volume_s *volume,
+                           FAR struct nxffs_pack_s *pack, off_t keep)
+{
+  off_t blkstart;
+  off_t block;
+  off_t end;
+  uint16_t start;
+
+  for (block = pack->ioblock;
+       block < pack->block0 + volume->blkper;
+       block++)
+    {
+      /* Get the range of the block to be filled */
+
+      blkstart = block * volume->geo.blocksize;
+      start    = (block == pack->ioblock) ? pack->iooffset : SIZEOF_NXFFS_BLOCK_HDR;
+      if (keep <= blkstart + start)
+        {
+          break;
+        }
+
+      end = MIN(keep - blkstart, volume->geo.blocksize);
+
+      /* Leave bad blocks alone */
+
+      pack->iobuffer = &volume->pack[(block - pack->block0) * volume->geo.blocksize];
+      if (nxffs_packvalid(pack))
+        {
+          memset(&pack->iobuffer[start], NXFFS_PACKFILL, end - start);
+        }
+    }
+}
+
 /****************************************************************************
- * Name: nxffs_pack
+ * Name: nxffs_packdelete
  *
  * Description:
- *   Pack and re-write the filesystem in order to free up memory at the end
- *   of FLASH.
+ *   An incremental packing step has stopped between two inodes.  The
+ *   original copies of moved inodes that lie beyond the current erase block
+ *   are still valid on FLASH.  Mark them as deleted just as
+ *   nxffs_rminode() would.
  *
  * Input Parameters:
- *   volume - The volume to be packed.
+ *   volume - The volume being packed
+ *   offset - FLASH offset at which to start searching
+ *   keep   - FLASH offset of the first inode that was not moved
  *
  * Returned Values:
  *   Zero on success; Otherwise, a negated errno value is returned to
@@ -1267,24 +1441,147 @@ static inline int nxffs_packwriter(FAR struct nxffs_volume_s *volume,
  *
  ****************************************************************************/
 
-int nxffs_pack(FAR struct nxffs_volume_s *volume)
+static int nxffs_packdelete(FAR struct nxffs_volume_s *volume, off_t offset,
+                            off_t keep)
+{
+  FAR struct nxffs_inode_s *inode;
+  struct nxffs_entry_s entry;
+  int ret;
+
+  while (offset < keep)
+    {
+      ret = nxffs_nextentry(volume, offset, &entry);
+      if (ret < 0)
+        {
+          /* No more valid inodes */
+
+          return OK;
+        }
+
+      if (entry.hoffset >= keep)
+        {
+          nxffs_freeentry(&entry);
+          break;
+        }
+
+      /* Change the inode state to deleted and re-write the block */
+
+      nxffs_ioseek(volume, entry.hoffset);
+      ret = nxffs_rdcache(volume, volume->ioblock);
+      if (ret == OK)
+        {
+          inode = (FAR struct nxffs_inode_s *)&volume->cache[volume->iooffset];
+          inode->state = INODE_STATE_DELETED;
+          ret = nxffs_wrcache(volume);
+        }
+
+      offset = entry.hoffset + SIZEOF_NXFFS_INODE_HDR;
+      nxffs_freeentry(&entry);
+
+      if (ret < 0)
+        {
+          fdbg("ERROR: Failed to delete moved inode: %d\n", -ret);
+          return ret;
+        }
+    }
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: nxffs_packvolume
+ *
+ * Description:
+ *   Pack and re-write the filesystem.  If a budget is provided, packing
+ *   stops between two inodes after that many inodes have been moved, and
+ *   no FLASH is freed at the end of the volume.
+ *
+ * Input Parameters:
+ *   volume - The volume to be packed.
+ *   budget - Maximum number of inodes to move.  Zero means no limit.
+ *
+ * Returned Values:
+ *   The number of inodes moved by an incremental step or zero for a full
+ *   pack on success; Otherwise, a negated errno value is returned to
+ *   indicate the nature of the failure.
+ *
+ ****************************************************************************/
+
+static int nxffs_packvolume(FAR struct nxffs_volume_s *volume,
+                            uint32_t budget)
 {
   struct nxffs_pack_s pack;
   FAR struct nxffs_wrfile_s *wrfile;
+  off_t froffset;
   off_t iooffset;
+  off_t destend;
   off_t eblock;
   off_t block;
+  off_t keep;
   bool packed;
   int i;
   int ret = OK;
 
   /* Get the offset to the first valid inode entry */
 
-  wrfile = NULL;
-  packed = false;
+  wrfile   = NULL;
+  packed   = false;
+  froffset = volume->froffset;
+  destend  = 0;
+  keep     = 0;
+
+  /* Packing may move the data of files that are open for reading */
 
-  iooffset = nxffs_mediacheck(volume, &pack);
-  if (iooffset == 0)
+  nxffs_rdinvalidate(volume);
+
+  /* An incremental step can resume where the last step stopped.  All inodes
+   * before that offset are already packed.
+   */
+
+  if (budget > 0 && volume->packoff > 0)
+    {
+      memset(&pack, 0, sizeof(struct nxffs_pack_s));
+      iooffset = volume->packoff;
+
+      /* A step that filled the last block that it used stopped at the
+       * beginning of the next block.  Resume after its block header.
+       */
+
+      nxffs_ioseek(volume, iooffset);
+      if (volume->iooffset < SIZEOF_NXFFS_BLOCK_HDR)
+        {
+          ret = nxffs_validblock(volume, &volume->ioblock);
+          if (ret < 0)
+            {
+              return 0;
+            }
+
+          volume->iooffset = SIZEOF_NXFFS_BLOCK_HDR;
+          iooffset         = nxffs_iotell(volume);
+        }
+
+      ret = nxffs_packentry(volume, iooffset, &pack.src.entry);
+      if (ret < 0)
+        {
+          /* There are no inodes after the packed region */
+
+          return 0;
+        }
+    }
+  else
+    {
+      iooffset = nxffs_mediacheck(volume, &pack);
+    }
+
+  pack.budget = budget;
+
+  if (iooffset == 0 && budget > 0)
+    {
+      /* There is nothing that an incremental step can move */
+
+      return 0;
+    }
+  else if (iooffset == 0)
     {
       /* Offset zero is only returned if no valid blocks were found on the
        * FLASH media or if there are no valid inode entries on the FLASH after
@@ -1345,9 +1642,19 @@ int nxffs_pack(FAR struct nxffs_volume_s *volume)
   ret = nxffs_startpos(volume, &pack, &iooffset);
   if (ret < 0)
     {
+      /* An incremental step never frees FLASH at the end of the volume.
+       * There are no more inodes to move, but remember where they end.
+       */
+
+      if (ret == -ENOSPC && budget > 0)
+        {
+          volume->packoff = iooffset;
+          return 0;
+        }
+
       /* This is a normal situation if the volume is full */
 
-      if (ret == -ENOSPC)
+      else if (ret == -ENOSPC)
         {
           /* In the case where the volume is full, nxffs_startpos() will
            * recalculate the free FLASH offset and store it in iooffset.  There
@@ -1452,6 +1759,7 @@ start_pack:
 
               fdbg("ERROR: Failed to read block %d: %d\n", block, ret);
               nxffs_blkinit(volume, pack.iobuffer, BLOCK_STATE_BAD);
+              volume->nbad++;
             }
         }
 #endif
@@ -1501,7 +1809,13 @@ start_pack:
                            * means that there is nothing further to be packed.
                            */
 
-                          if (ret == -ENOSPC)
+                          if (ret == -ENOSPC && budget > 0)
+                            {
+                              /* An incremental step stops here */
+
+                              pack.stop = true;
+                            }
+                          else if (ret == -ENOSPC)
                             {
                               packed = true;
 
@@ -1556,6 +1870,13 @@ start_pack:
                             }
                         }
                     }
+
+                  /* Stop if an incremental step has used up its budget */
+
+                  if (pack.stop)
+                    {
+                      break;
+                    }
                 }
 
               /* Set any unused portion at the end of the block to the
@@ -1577,10 +1898,48 @@ start_pack:
             }
         }
 
+      /* If an incremental step stopped in this erase block, then fill the
+       * stale space after the last inode moved.  Keep the next inode to be
+       * moved, the in-progress write, and the free FLASH region.
+       */
+
+      if (pack.stop)
+        {
+          destend = nxffs_packtell(volume, &pack);
+          keep    = froffset;
+
+          wrfile = nxffs_findwriter(volume);
+          if (wrfile && wrfile->ofile.entry.hoffset > 0)
+            {
+              keep = MIN(keep, wrfile->ofile.entry.hoffset);
+            }
+
+          if (wrfile && wrfile->ofile.entry.doffset > 0)
+            {
+              keep = MIN(keep, wrfile->ofile.entry.doffset);
+            }
+
+          /* The data blocks of an inode precede its header */
+
+          if (pack.src.entry.hoffset > 0)
+            {
+              keep = MIN(keep, pack.src.entry.hoffset);
+            }
+
+          if (pack.src.entry.doffset > 0)
+            {
+              keep = MIN(keep, pack.src.entry.doffset);
+            }
+
+          nxffs_packfill(volume, &pack, keep);
+        }
+
       /* We now have an in-memory image of how we want this erase block to
-       * appear. Now it is safe to erase the block.
+       * appear. Now it is safe to erase the block.  Any cached copies of its
+       * blocks will be stale after this.
        */
 
+      nxffs_invcache(volume, pack.block0, volume->blkper);
       ret = MTD_ERASE(volume->mtd, eblock, 1);
       if (ret < 0)
         {
@@ -1598,10 +1957,95 @@ start_pack:
                eblock, pack.block0, -ret);
           goto errout_with_pack;
         }
+
+      if (pack.stop)
+        {
+          break;
+        }
+    }
+
+  if (pack.stop)
+    {
+      /* Inodes moved out of later erase blocks are still valid there */
+
+      ret = nxffs_packdelete(volume,
+                             (pack.block0 + volume->blkper) * volume->geo.blocksize,
+                             keep);
+      if (ret == OK)
+        {
+          ret = pack.nmoved;
+        }
+
+      /* No FLASH was freed.  The next step starts after the inodes moved. */
+
+      volume->froffset = froffset;
+      volume->packoff  = destend;
+    }
+  else
+    {
+      volume->packoff  = 0;
     }
 
 errout_with_pack:
+  if (ret < 0)
+    {
+      /* Inodes may have been moved without the index being updated */
+
+      nxffs_idxinvalidate(volume);
+    }
+
   nxffs_freeentry(&pack.src.entry);
   nxffs_freeentry(&pack.dest.entry);
   return ret;
 }
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: nxffs_pack
+ *
+ * Description:
+ *   Pack and re-write the filesystem in order to free up memory at the end
+ *   of FLASH.
+ *
+ * Input Parameters:
+ *   volume - The volume to be packed.
+ *
+ * Returned Values:
+ *   Zero on success; Otherwise, a negated errno value is returned to
+ *   indicate the nature of the failure.
+ *
+ ****************************************************************************/
+
+int nxffs_pack(FAR struct nxffs_volume_s *volume)
+{
+  return nxffs_packvolume(volume, 0);
+}
+
+/****************************************************************************
+ * Name: nxffs_packstep
+ *
+ * Description:
+ *   Perform one bounded, incremental packing step.  At most 'budget' inodes
+ *   are moved toward the beginning of FLASH.  The volume is consistent when
+ *   this function returns, and the offset below which the volume is known
+ *   to be packed is remembered so that the next step resumes there.
+ *
+ * Input Parameters:
+ *   volume - The volume to be packed.
+ *   budget - Maximum number of inodes to move (must be non-zero).
+ *
+ * Returned Values:
+ *   The number of inodes moved on success.  Zero means that there is
+ *   nothing left to move.  Otherwise, a negated errno value is returned to
+ *   indicate the nature of the failure.
+ *
+ ****************************************************************************/
+
+int nxffs_packstep(FAR struct nxffs_volume_s *volume, uint32_t budget)
+{
+  DEBUGASSERT(budget > 0);
+  return nxffs_packvolume(volume, budget);
+}
@@ -48,6 +48,7 @@
 #include <errno.h>
 #include <debug.h>
 
+#include <nuttx/kmalloc.h>
 #include <nuttx/fs/fs.h>
 #include <nuttx/mtd/mtd.h>
 
@@ -69,50 +70,208 @@
  * Private Functions
  ****************************************************************************/
 
+/****************************************************************************
+ * Name: nxffs_rdskip
+ *
+ * Description:
+ *   Add the current data block of a file open for reading to its skip
+ *   index.  Failure to allocate memory is not an error:  the skip index
+ *   just stops growing.
+ *
+ * Input Parameters:
+ *   rdfile - Describes the file open for reading
+ *
+ ****************************************************************************/
+
+static void nxffs_rdskip(FAR struct nxffs_rdfile_s *rdfile)
+{
+  FAR struct nxffs_skip_s *skip;
+  uint16_t maxskip;
+
+  if (rdfile->nskip >= rdfile->maxskip)
+    {
+      maxskip = rdfile->maxskip ? 2 * rdfile->maxskip : 8;
+      if (maxskip <= rdfile->maxskip)
+        {
+          return;
+        }
+
+      skip = (FAR struct nxffs_skip_s *)
+        kmm_realloc(rdfile->skip, maxskip * sizeof(struct nxffs_skip_s));
+      if (!skip)
+        {
+          return;
+        }
+
+      rdfile->skip    = skip;
+      rdfile->maxskip = maxskip;
+    }
+
+  skip          = &rdfile->skip[rdfile->nskip];
+  skip->fpos    = rdfile->fpos;
+  skip->hoffset = rdfile->blkentry.hoffset;
+  skip->segend  = rdfile->segend;
+  rdfile->nskip++;
+}
+
+/****************************************************************************
+ * Name: nxffs_rdextent
+ *
+ * Description:
+ *   Find the first data block of the part of a file that begins at the
+ *   provided file position:  Either the data of the file inode itself or
+ *   one of the extents appended to the file.
+ *
+ * Input Parameters:
+ *   volume   - Describes the current volume
+ *   rdfile   - Describes the file open for reading
+ *   datstart - The file position of the first byte in the file part
+ *   offset   - Location to return the FLASH offset of the first data block
+ *   segend   - Location to return the file position at the end of the part
+ *
+ ****************************************************************************/
+
+static int nxffs_rdextent(FAR struct nxffs_volume_s *volume,
+                          FAR struct nxffs_rdfile_s *rdfile, off_t datstart,
+                          FAR off_t *offset, FAR off_t *segend)
+{
+  FAR struct nxffs_entry_s *entry = &rdfile->ofile.entry;
+  struct nxffs_entry_s extent;
+  int ret;
+
+  if (datstart < entry->datlen)
+    {
+      *offset = entry->doffset;
+      *segend = entry->datlen;
+      return OK;
+    }
+
+  ret = nxffs_findextent(volume, entry->name, entry->hoffset, datstart,
+                         &extent);
+  if (ret < 0)
+    {
+      fdbg("ERROR: No extent at file position %d: %d\n", datstart, -ret);
+      return ret;
+    }
+
+  *offset = extent.doffset;
+  *segend = datstart + extent.datlen;
+  nxffs_freeentry(&extent);
+  return OK;
+}
+
 /****************************************************************************
  * Name: nxffs_rdseek
  *
  * Description:
- *   Seek to the file position before read or write access.  Note that the
+ *   Seek to the file position before read access.  Note that the
  *   simplier nxffs_ioseek() cannot be used for this purpose.  File offsets
  *   are not easily mapped to FLASH offsets due to intervening block and
  *   data headers.
  *
+ *   The data block found is remembered in the open file structure.  The
+ *   search for the data block starts with the remembered data block, the
+ *   nearest preceding entry in the skip index, or, failing that, the first
+ *   data block of the file.  At the end of the data of the file inode or
+ *   of an extent, the search continues with the next extent of the file.
+ *
  * Input Parameters:
- *   volume   - Describes the current volume
- *   entry    - Describes the open inode
- *   fpos     - The desired file position
- *   blkentry - Describes the block entry that we are positioned in
+ *   volume - Describes the current volume
+ *   rdfile - Describes the file open for reading
+ *   fpos   - The desired file position
  *
  ****************************************************************************/
 
-static ssize_t nxffs_rdseek(FAR struct nxffs_volume_s *volume,
-                            FAR struct nxffs_entry_s *entry,
-                            off_t fpos,
-                            FAR struct nxffs_blkentry_s *blkentry)
+static int nxffs_rdseek(FAR struct nxffs_volume_s *volume,
+                        FAR struct nxffs_rdfile_s *rdfile, off_t fpos)
 {
-  size_t datstart;
-  size_t datend;
+  FAR struct nxffs_blkentry_s *blkentry = &rdfile->blkentry;
+  off_t datstart;
+  off_t segend;
   off_t offset;
+  uint32_t blkno;
+  int lower;
+  int upper;
+  int mid;
   int ret;
 
-  /* The initial FLASH offset will be the offset to first data block of
-   * the inode
-   */
+  /* Is the position in the data block that we already know about? */
 
-  offset = entry->doffset;
-  if (offset == 0)
+  if (rdfile->valid && fpos >= rdfile->fpos)
     {
-      /* Zero length files will have no data blocks */
+      if (fpos < rdfile->fpos + blkentry->datlen)
+        {
+          goto found;
+        }
+
+      /* No.. but it is somewhere after it */
+
+      datstart = rdfile->fpos + blkentry->datlen;
+      segend   = rdfile->segend;
+      blkno    = rdfile->blkno + 1;
+      offset   = blkentry->hoffset + SIZEOF_NXFFS_DATA_HDR + blkentry->datlen;
+    }
+
+  /* Is the position after some data block in the skip index? */
+
+  else if (rdfile->nskip > 0 && fpos >= rdfile->skip[0].fpos)
+    {
+      /* Find the last skip index entry at or before the position */
+
+      lower = 0;
+      upper = rdfile->nskip - 1;
+      while (lower < upper)
+        {
+          mid = (lower + upper + 1) >> 1;
+          if (rdfile->skip[mid].fpos <= fpos)
+            {
+              lower = mid;
+            }
+          else
+            {
+              upper = mid - 1;
+            }
+        }
+
+      datstart = rdfile->skip[lower].fpos;
+      segend   = rdfile->skip[lower].segend;
+      blkno    = lower * NXFFS_SKIP_INTERVAL;
+      offset   = rdfile->skip[lower].hoffset;
+    }
+
+  /* No.. start with the first data block of the file */
+
+  else
+    {
+      if (rdfile->ofile.entry.datlen + rdfile->ofile.entry.extlen == 0)
+        {
+          /* Zero length files will have no data blocks */
+
+          return -ENOSPC;
+        }
 
-      return -ENOSPC;
+      datstart = 0;
+      segend   = 0;
+      blkno    = 0;
+      offset   = 0;
     }
 
   /* Loop until we read the data block containing the desired position */
 
-  datend = 0;
-  do
+  rdfile->valid = false;
+  for (; ; )
     {
+      /* Continue with the next extent at the end of the current one */
+
+      if (datstart >= segend)
+        {
+          ret = nxffs_rdextent(volume, rdfile, datstart, &offset, &segend);
+          if (ret < 0)
+            {
+              return ret;
+            }
+        }
+
       /* Check if the next data block contains the sought after file position */
 
       ret = nxffs_nextblock(volume, offset, blkentry);
@@ -122,22 +281,42 @@ static ssize_t nxffs_rdseek(FAR struct nxffs_volume_s *volume,
           return ret;
         }
 
-      /* Get the range of data offsets for this data block */
+      /* Remember every NXFFS_SKIP_INTERVAL'th data block */
+
+      rdfile->fpos   = datstart;
+      rdfile->segend = segend;
+      rdfile->blkno  = blkno;
+
+      if (blkno == (uint32_t)rdfile->nskip * NXFFS_SKIP_INTERVAL)
+        {
+          nxffs_rdskip(rdfile);
+        }
+
+      /* Does this data block contain the position? */
 
-      datstart  = datend;
-      datend   += blkentry->datlen;
+      if (fpos < datstart + blkentry->datlen)
+        {
+          break;
+        }
 
       /* Offset to search for the next data block */
 
-      offset = blkentry->hoffset + SIZEOF_NXFFS_DATA_HDR + blkentry->datlen;
+      datstart += blkentry->datlen;
+      blkno++;
+      offset    = blkentry->hoffset + SIZEOF_NXFFS_DATA_HDR + blkentry->datlen;
     }
-  while (datend <= fpos);
 
-  /* Return the offset to the data within the current data block */
+  rdfile->valid = true;
+
+found:
+
+  /* Return the offset to the data within the current data block and make
+   * sure that the data block is in the cache.
+   */
 
-  blkentry->foffset = fpos - datstart;
+  blkentry->foffset = fpos - rdfile->fpos;
   nxffs_ioseek(volume, blkentry->hoffset + SIZEOF_NXFFS_DATA_HDR + blkentry->foffset);
-  return OK;
+  return nxffs_rdcache(volume, volume->ioblock);
 }
 
 /****************************************************************************
@@ -155,11 +334,11 @@ static ssize_t nxffs_rdseek(FAR struct nxffs_volume_s *volume,
 ssize_t nxffs_read(FAR struct file *filep, FAR char *buffer, size_t buflen)
 {
   FAR struct nxffs_volume_s *volume;
-  FAR struct nxffs_ofile_s *ofile;
-  struct nxffs_blkentry_s blkentry;
+  FAR struct nxffs_rdfile_s *rdfile;
   ssize_t total;
   size_t available;
   size_t readsize;
+  off_t filelen;
   int ret;
 
   fvdbg("Read %d bytes from offset %d\n", buflen, filep->f_pos);
@@ -170,7 +349,7 @@ ssize_t nxffs_read(FAR struct file *filep, FAR char *buffer, size_t buflen)
 
   /* Recover the open file state from the struct file instance */
 
-  ofile = (FAR struct nxffs_ofile_s *)filep->f_priv;
+  rdfile = (FAR struct nxffs_rdfile_s *)filep->f_priv;
 
   /* Recover the volume state from the open file */
 
@@ -191,7 +370,7 @@ ssize_t nxffs_read(FAR struct file *filep, FAR char *buffer, size_t buflen)
 
   /* Check if the file was opened with read access */
 
-  if ((ofile->oflags & O_RDOK) == 0)
+  if ((rdfile->ofile.oflags & O_RDOK) == 0)
     {
       fdbg("ERROR: File not open for read access\n");
       ret = -EACCES;
@@ -200,21 +379,22 @@ ssize_t nxffs_read(FAR struct file *filep, FAR char *buffer, size_t buflen)
 
   /* Loop until all bytes have been read */
 
+  filelen = rdfile->ofile.entry.datlen + rdfile->ofile.entry.extlen;
   for (total = 0; total < buflen; )
     {
       /* Don't seek past the end of the file */
 
-      if (filep->f_pos >= ofile->entry.datlen)
+      if (filep->f_pos >= filelen)
         {
           /* Return the partial read */
 
-          filep->f_pos = ofile->entry.datlen;
+          filep->f_pos = filelen;
           break;
         }
 
       /* Seek to the current file offset */
 
-      ret = nxffs_rdseek(volume, &ofile->entry, filep->f_pos, &blkentry);
+      ret = nxffs_rdseek(volume, rdfile, filep->f_pos);
       if (ret < 0)
         {
           fdbg("ERROR: nxffs_rdseek failed: %d\n", -ret);
@@ -224,7 +404,7 @@ ssize_t nxffs_read(FAR struct file *filep, FAR char *buffer, size_t buflen)
 
       /* How many bytes are available at this offset */
 
-      available = blkentry.datlen - blkentry.foffset;
+      available = rdfile->blkentry.datlen - rdfile->blkentry.foffset;
 
       /* Don't read more than we need to */
 
@@ -253,6 +433,37 @@ errout:
   return (ssize_t)ret;
 }
 
+/****************************************************************************
+ * Name: nxffs_rdinvalidate
+ *
+ * Description:
+ *   Forget the remembered read positions of all files open for reading.
+ *   This must be called whenever file data may have been moved on FLASH.
+ *
+ * Input Parameters:
+ *   volume - Describes the current volume.
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void nxffs_rdinvalidate(FAR struct nxffs_volume_s *volume)
+{
+  FAR struct nxffs_rdfile_s *rdfile;
+  FAR struct nxffs_ofile_s *ofile;
+
+  for (ofile = volume->ofiles; ofile; ofile = ofile->flink)
+    {
+      if ((ofile->oflags & O_WROK) == 0)
+        {
+          rdfile         = (FAR struct nxffs_rdfile_s *)ofile;
+          rdfile->valid  = false;
+          rdfile->nskip  = 0;
+        }
+    }
+}
+
 /****************************************************************************
  * Name: nxffs_nextblock
  *
@@ -273,116 +484,55 @@ errout:
 int nxffs_nextblock(FAR struct nxffs_volume_s *volume, off_t offset,
                     FAR struct nxffs_blkentry_s *blkentry)
 {
-  int nmagic;
-  int ch;
-  int nerased;
   int ret;
 
-  /* Seek to the first FLASH offset provided by the caller. */
+  /* Seek to the first FLASH offset provided by the caller.  The block
+   * header is skipped by nxffs_scan().
+   */
 
   nxffs_ioseek(volume, offset);
 
-  /* Skip the block header */
-
-  if (volume->iooffset < SIZEOF_NXFFS_BLOCK_HDR)
-    {
-      volume->iooffset = SIZEOF_NXFFS_BLOCK_HDR;
-    }
-
   /* Then begin searching */
 
-  nerased = 0;
-  nmagic  = 0;
-
   for (; ; )
     {
-      /* Read the next character */
-
-      ch = nxffs_getc(volume, SIZEOF_NXFFS_DATA_HDR - nmagic);
-      if (ch < 0)
-        {
-          fdbg("ERROR: nxffs_getc failed: %d\n", -ch);
-          return ch;
-        }
-
-      /* Check for another erased byte */
-
-      else if (ch == CONFIG_NXFFS_ERASEDSTATE)
+      /* Find the next magic sequence indicating the start of an NXFFS data
+       * block.  There is the possibility of this magic sequnce occurring in
+       * FLASH data.  However, the data block CRC should distinguish between
+       * real NXFFS data blocks headers and such false alarms.
+       */
+
+      ret = nxffs_scan(volume, g_datamagic, SIZEOF_NXFFS_DATA_HDR,
+                       &blkentry->hoffset);
+      if (ret < 0)
         {
-          /* If we have encountered NXFFS_NERASED number of consecutive
-           * erased bytes, then presume we have reached the end of valid
-           * data.
-           */
-
-          if (++nerased >= NXFFS_NERASED)
+          if (ret == -ENOENT)
             {
               fvdbg("No entry found\n");
-              return -ENOENT;
             }
-        }
-      else
-        {
-          nerased = 0;
-
-          /* Check for the magic sequence indicating the start of an NXFFS
-           * data block or start of the next inode. There is the possibility
-           * of this magic sequnce occurring in FLASH data.  However, the
-           * data block CRC should distinguish between real NXFFS data blocks
-           * headers and such false alarms.
-           */
-
-          if (ch != g_datamagic[nmagic])
-            {
-              /* Ooops... this is the not the right character for the magic
-               * Sequence.  Check if we need to restart or to cancel the sequence:
-               */
-
-              if (ch == g_datamagic[0])
-                {
-                  nmagic = 1;
-                }
-              else
-                {
-                  nmagic = 0;
-                }
-            }
-          else if (nmagic < NXFFS_MAGICSIZE - 1)
-            {
-              /* We have one more character in the magic sequence */
-
-              nmagic++;
-            }
-
-          /* We have found the magic sequence in the FLASH data that may
-           * indicate the beginning of an NXFFS data block.
-           */
-
           else
             {
-              /* The offset to the header must be 4 bytes before the current
-               * FLASH seek location.
-               */
+              fdbg("ERROR: nxffs_scan failed: %d\n", -ret);
+            }
 
-              blkentry->hoffset = nxffs_iotell(volume) - NXFFS_MAGICSIZE;
+          return ret;
+        }
 
-              /* Read the block header and verify the block at that address */
+      /* Read the block header and verify the block at that address */
 
-              ret = nxffs_rdblkhdr(volume, blkentry->hoffset, &blkentry->datlen);
-              if (ret == OK)
-                {
-                  fvdbg("Found a valid data block, offset: %d datlen: %d\n",
-                        blkentry->hoffset, blkentry->datlen);
-                  return OK;
-                }
+      ret = nxffs_rdblkhdr(volume, blkentry->hoffset, &blkentry->datlen);
+      if (ret == OK)
+        {
+          fvdbg("Found a valid data block, offset: %d datlen: %d\n",
+                blkentry->hoffset, blkentry->datlen);
+          return OK;
+        }
 
-              /* False alarm.. Restore the volume cache position (that was
-               * destroyed by nxfs_rdblkhdr()) and keep looking.
-               */
+      /* False alarm.. Restore the volume cache position (that was
+       * destroyed by nxfs_rdblkhdr()) and keep looking.
+       */
 
-              nxffs_ioseek(volume, blkentry->hoffset + NXFFS_MAGICSIZE);
-              nmagic = 0;
-            }
-        }
+      nxffs_ioseek(volume, blkentry->hoffset + NXFFS_MAGICSIZE);
     }
 
   /* We won't get here, but to keep some compilers happy: */
@@ -155,8 +155,9 @@ static int nxffs_badblocks(FAR struct nxffs_volume_s *volume)
   bool modified;         /* TRUE: The erase block has been modified */
   int i;
 
-  /* Read and verify each erase block */
+  /* Read and verify each erase block, counting the bad blocks found */
 
+  volume->nbad = 0;
   for (eblock = 0; eblock < volume->geo.neraseblocks; eblock++)
     {
       /* Get the logical block number of the erase block */
@@ -245,6 +246,7 @@ static int nxffs_badblocks(FAR struct nxffs_volume_s *volume)
           if (!good)
             {
               nxffs_blkinit(volume, blkptr, BLOCK_STATE_BAD);
+              volume->nbad++;
               modified = true;
             }
         }
@@ -290,8 +292,11 @@ int nxffs_reformat(FAR struct nxffs_volume_s *volume)
 {
   int ret;
 
-  /* Erase and reformat the entire volume */
+  /* Erase and reformat the entire volume.  Nothing in the block cache will
+   * be valid afterward.
+   */
 
+  nxffs_invcache(volume, 0, volume->nblocks);
   ret = nxffs_format(volume);
   if (ret < 0)
     {
@@ -299,6 +304,13 @@ int nxffs_reformat(FAR struct nxffs_volume_s *volume)
       return ret;
     }
 
+  /* There are no inodes on the freshly formatted volume */
+
+  nxffs_idxreset(volume);
+  volume->packoff   = 0;
+  volume->ninodes   = 0;
+  volume->livebytes = 0;
+
   /* Check for bad blocks */
 
   ret = nxffs_badblocks(volume);
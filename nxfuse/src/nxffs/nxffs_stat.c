@@ -84,6 +84,11 @@
 int nxffs_statfs(FAR struct inode *mountpt, FAR struct statfs *buf)
 {
   FAR struct nxffs_volume_s *volume;
+  off_t payload;
+  off_t capacity;
+  off_t used;
+  off_t avail;
+  off_t reclaim;
   int ret;
 
   fvdbg("Entry\n");
@@ -101,15 +106,32 @@ int nxffs_statfs(FAR struct inode *mountpt, FAR struct statfs *buf)
       goto errout;
     }
 
-  /* Fill in the statfs info
-   *
-   * REVISIT: Need f_bfree, f_bavail, f_files, f_ffree calculation
+  /* Everything below is computed from the volume space accounting; no
+   * FLASH is accessed.  The usable payload of each block excludes the block
+   * header.  All FLASH below the free FLASH region that is not held by a
+   * valid inode is reclaimable by packing.  Bad blocks are assumed to be
+   * beyond the free FLASH region.
+   */
+
+  payload  = volume->geo.blocksize - SIZEOF_NXFFS_BLOCK_HDR;
+  capacity = (volume->nblocks - volume->nbad) * payload;
+  used     = (volume->froffset / volume->geo.blocksize) * payload +
+             MAX(volume->froffset % volume->geo.blocksize - SIZEOF_NXFFS_BLOCK_HDR, 0);
+  avail    = MAX(capacity - used, 0);
+  reclaim  = MAX(used - volume->livebytes, 0);
+
+  /* Fill in the statfs info.  f_bavail is the FLASH available now; f_bfree
+   * also includes the FLASH that would be recovered by packing the volume.
    */
 
   memset(buf, 0, sizeof(struct statfs));
   buf->f_type    = NXFFS_MAGIC;
   buf->f_bsize   = volume->geo.blocksize;
   buf->f_blocks  = volume->nblocks;
+  buf->f_bfree   = (avail + reclaim) / payload;
+  buf->f_bavail  = avail / payload;
+  buf->f_ffree   = (avail + reclaim) / (SIZEOF_NXFFS_INODE_HDR + 1);
+  buf->f_files   = volume->ninodes + buf->f_ffree;
   buf->f_namelen = volume->geo.blocksize - SIZEOF_NXFFS_BLOCK_HDR - SIZEOF_NXFFS_INODE_HDR;
   ret            = OK;
 
@@ -162,13 +184,15 @@ int nxffs_stat(FAR struct inode *mountpt, FAR const char *relpath,
       pofile = volume->ofiles;
       while (pofile != NULL)
         {
-          if (strcmp(relpath, pofile->entry.name) == 0)
+          /* A file open for appending is described by the file on FLASH */
+
+          if (strcmp(relpath, pofile->entry.name) == 0 && !pofile->entry.extent)
             {
               /* The file being stat'ed is an open file.  */
 
-              buf->st_blocks  = pofile->entry.datlen / (volume->geo.blocksize - SIZEOF_NXFFS_BLOCK_HDR);
+              buf->st_size    = pofile->entry.datlen + pofile->entry.extlen;
+              buf->st_blocks  = buf->st_size / (volume->geo.blocksize - SIZEOF_NXFFS_BLOCK_HDR);
               buf->st_mode    = S_IFREG | S_IXOTH | S_IXGRP | S_IXUSR;
-              buf->st_size    = pofile->entry.datlen;
               buf->st_atime   = pofile->entry.utc;
               buf->st_mtime   = pofile->entry.utc;
               buf->st_ctime   = pofile->entry.utc;
@@ -189,9 +213,9 @@ int nxffs_stat(FAR struct inode *mountpt, FAR const char *relpath,
           goto errout_with_semaphore;
         }
 
-      buf->st_blocks  = entry.datlen / (volume->geo.blocksize - SIZEOF_NXFFS_BLOCK_HDR);
+      buf->st_size    = entry.datlen + entry.extlen;
+      buf->st_blocks  = buf->st_size / (volume->geo.blocksize - SIZEOF_NXFFS_BLOCK_HDR);
       buf->st_mode    = S_IFREG | S_IXOTH | S_IXGRP | S_IXUSR;
-      buf->st_size    = entry.datlen;
       buf->st_atime   = entry.utc;
       buf->st_mtime   = entry.utc;
       buf->st_ctime   = entry.utc;
@@ -67,6 +67,101 @@
  * Private Functions
  ****************************************************************************/
 
+/****************************************************************************
+ * Name: nxffs_rmentry
+ *
+ * Description:
+ *   Mark the inode or file extent with the header at the provided FLASH
+ *   offset as deleted.
+ *
+ * Input Parameters:
+ *   volume  - Describes the NXFFS volume.
+ *   hoffset - FLASH offset to the inode header.
+ *
+ * Returned Value:
+ *   Zero is returned on success.  Otherwise, a negated errno value is
+ *   returned indicating the nature of the failure.
+ *
+ ****************************************************************************/
+
+static int nxffs_rmentry(FAR struct nxffs_volume_s *volume, off_t hoffset)
+{
+  FAR struct nxffs_inode_s *inode;
+  int ret;
+
+  /* Set the position to the FLASH offset of the inode header and make sure
+   * that the block is in the cache.
+   */
+
+  nxffs_ioseek(volume, hoffset);
+  ret = nxffs_rdcache(volume, volume->ioblock);
+  if (ret < 0)
+    {
+      fdbg("ERROR: Failed to read block %d into cache: %d\n",
+           volume->ioblock, ret);
+      return ret;
+    }
+
+  /* Change the inode state and write the cached block back to FLASH */
+
+  inode = (FAR struct nxffs_inode_s *)&volume->cache[volume->iooffset];
+  inode->state = INODE_STATE_DELETED;
+
+  ret = nxffs_wrcache(volume);
+  if (ret < 0)
+    {
+      fdbg("ERROR: Failed to write block %d: %d\n",
+           volume->ioblock, ret);
+    }
+
+  return ret;
+}
+
+/****************************************************************************
+ * Name: nxffs_rmextents
+ *
+ * Description:
+ *   Mark all extents of a file as deleted.  The file inode itself has
+ *   already been deleted.  Failures are not reported:  Any extents left
+ *   behind no longer belong to a file and are discarded when the volume is
+ *   re-packed.
+ *
+ * Input Parameters:
+ *   volume - Describes the NXFFS volume.
+ *   name   - The name of the file.
+ *   entry  - Describes the deleted file inode.
+ *
+ ****************************************************************************/
+
+static void nxffs_rmextents(FAR struct nxffs_volume_s *volume,
+                            FAR const char *name,
+                            FAR struct nxffs_entry_s *entry)
+{
+  struct nxffs_entry_s extent;
+  uint32_t filelen = entry->datlen + entry->extlen;
+  uint32_t fpos    = entry->datlen;
+  off_t offset     = entry->hoffset;
+
+  while (fpos < filelen)
+    {
+      if (nxffs_findextent(volume, name, offset, fpos, &extent) < 0)
+        {
+          break;
+        }
+
+      if (nxffs_rmentry(volume, extent.hoffset) < 0)
+        {
+          nxffs_freeentry(&extent);
+          break;
+        }
+
+      volume->livebytes -= nxffs_inodesize(volume, &extent);
+      fpos              += extent.datlen;
+      offset             = extent.hoffset;
+      nxffs_freeentry(&extent);
+    }
+}
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -91,7 +186,6 @@
 int nxffs_rminode(FAR struct nxffs_volume_s *volume, FAR const char *name)
 {
   FAR struct nxffs_ofile_s *ofile;
-  FAR struct nxffs_inode_s *inode;
   struct nxffs_entry_s entry;
   int ret;
 
@@ -116,37 +210,33 @@ int nxffs_rminode(FAR struct nxffs_volume_s *volume, FAR const char *name)
       goto errout;
     }
 
-  /* Set the position to the FLASH offset of the file header (nxffs_findinode
-   * should have left the block in the cache).
-   */
-
-  nxffs_ioseek(volume, entry.hoffset);
-
-  /* Make sure that the block is in the cache */
+  /* Change the file status... it is no longer valid */
 
-  ret = nxffs_rdcache(volume, volume->ioblock);
-  if (ret < 0)
+  ret = nxffs_rmentry(volume, entry.hoffset);
+  if (ret == OK)
     {
-      fdbg("ERROR: Failed to read block %d into cache: %d\n",
-           volume->ioblock, ret);
-      goto errout_with_entry;
-    }
+      /* The FLASH used by the inode is now reclaimable.  Account for it
+       * before the index entry (which may own the entry name) is removed.
+       */
 
-  /* Change the file status... it is no longer valid */
+      volume->ninodes--;
+      volume->livebytes -= nxffs_inodesize(volume, &entry);
 
-  inode = (FAR struct nxffs_inode_s *)&volume->cache[volume->iooffset];
-  inode->state = INODE_STATE_DELETED;
+      /* Then remove the extents that were appended to the file.  They
+       * must still be found in the index.
+       */
 
-  /* Then write the cached block back to FLASH */
+      nxffs_rmextents(volume, name, &entry);
+      nxffs_idxremove(volume, name);
 
-  ret = nxffs_wrcache(volume);
-  if (ret < 0)
-    {
-      fdbg("ERROR: Failed to write block %d: %d\n",
-           volume->ioblock, ret);
+      /* The volume is no longer packed from this inode onward */
+
+      if (entry.hoffset < volume->packoff)
+        {
+          volume->packoff = entry.hoffset;
+        }
     }
 
-errout_with_entry:
   nxffs_freeentry(&entry);
 errout:
   return ret;
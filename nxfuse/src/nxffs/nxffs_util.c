@@ -166,8 +166,25 @@ void nxffs_wrle32(uint8_t *dest, uint32_t val)
 
 size_t nxffs_erased(FAR const uint8_t *buffer, size_t buflen)
 {
+  const uintptr_t erasedword = (~(uintptr_t)0 / 0xff) * CONFIG_NXFFS_ERASEDSTATE;
+  uintptr_t word;
   size_t nerased = 0;
 
+  /* Compare a word at a time while there are whole words left */
+
+  for (; nerased + sizeof(uintptr_t) <= buflen; nerased += sizeof(uintptr_t))
+    {
+      memcpy(&word, buffer, sizeof(uintptr_t));
+      if (word != erasedword)
+        {
+          break;
+        }
+
+      buffer += sizeof(uintptr_t);
+    }
+
+  /* Then finish the remainder (or locate the non-erased byte) */
+
   for (; nerased < buflen; nerased++)
     {
       if (*buffer != CONFIG_NXFFS_ERASEDSTATE)
@@ -48,6 +48,7 @@
 #include <errno.h>
 #include <debug.h>
 
+#include <nuttx/kmalloc.h>
 #include <nuttx/fs/fs.h>
 #include <nuttx/mtd/mtd.h>
 
@@ -430,6 +431,115 @@ static inline ssize_t nxffs_wrappend(FAR struct nxffs_volume_s *volume,
   return nbytestowrite;
 }
 
+/****************************************************************************
+ * Name: nxffs_wrstgreserve
+ *
+ * Description:
+ *   Reserve the FLASH needed to commit the data staged for a file, plus
+ *   buflen more bytes.  The file is not committed until it is closed, so
+ *   running out of FLASH must be detected here for the error to reach the
+ *   writer.
+ *
+ *   The estimate is conservative:  It allows for the inode header and name
+ *   and every data block header being pushed past the end of an erase
+ *   block.  It is checked against the FLASH that a full pack would leave
+ *   once the valid inodes and the reservations of the other writers are
+ *   accounted for.  A file being truncated still counts, since the old
+ *   file is not removed until the new one is written.
+ *
+ * Input Parameters:
+ *   volume - Describes the NXFFS volume
+ *   wrfile - Describes the open file to be written.
+ *   buflen - The number of bytes to be added to the staged data
+ *
+ * Returned Value:
+ *   Zero is returned on success.  -ENOSPC is returned if the data would
+ *   not fit on the volume.
+ *
+ ****************************************************************************/
+
+static int nxffs_wrstgreserve(FAR struct nxffs_volume_s *volume,
+                              FAR struct nxffs_wrfile_s *wrfile,
+                              size_t buflen)
+{
+  uint16_t maxsize = volume->geo.blocksize - SIZEOF_NXFFS_BLOCK_HDR - SIZEOF_NXFFS_DATA_HDR;
+  off_t capacity;
+  off_t datlen;
+  off_t needed;
+
+  datlen   = wrfile->stglen + buflen;
+  needed   = 2 * (SIZEOF_NXFFS_INODE_HDR + strlen(wrfile->ofile.entry.name)) +
+             datlen + ((datlen + maxsize - 1) / maxsize + 1) *
+             (2 * SIZEOF_NXFFS_DATA_HDR + NXFFS_MINDATA);
+
+  capacity = (volume->nblocks - volume->nbad) *
+             (volume->geo.blocksize - SIZEOF_NXFFS_BLOCK_HDR);
+
+  if (volume->livebytes + volume->reserved - wrfile->reserved + needed >
+      capacity)
+    {
+      fdbg("ERROR: No FLASH for %ld staged bytes\n", (long)datlen);
+      return -ENOSPC;
+    }
+
+  volume->reserved += needed - wrfile->reserved;
+  wrfile->reserved  = needed;
+  return OK;
+}
+
+/****************************************************************************
+ * Name: nxffs_wrstage
+ *
+ * Description:
+ *   Append data to the in-memory staging buffer of a file opened for
+ *   writing.  The buffer grows geometrically in units of the FLASH block
+ *   size.
+ *
+ * Input Parameters:
+ *   volume - Describes the NXFFS volume
+ *   wrfile - Describes the open file to be written.
+ *   buffer - Address of buffer of data to be written.
+ *   buflen - The number of bytes to be written
+ *
+ * Returned Value:
+ *   Zero is returned on success.  Otherwise, a negated errno value is
+ *   returned indicating the nature of the failure.
+ *
+ ****************************************************************************/
+
+static inline int nxffs_wrstage(FAR struct nxffs_volume_s *volume,
+                                FAR struct nxffs_wrfile_s *wrfile,
+                                FAR const char *buffer, size_t buflen)
+{
+  FAR uint8_t *stage;
+  size_t stgsize;
+
+  /* Is there room in the staging buffer? */
+
+  if (wrfile->stglen + buflen > wrfile->stgsize)
+    {
+      /* No.. double its size, but by at least enough to hold the new data */
+
+      stgsize = MAX(2 * wrfile->stgsize, wrfile->stglen + buflen);
+      stgsize = (stgsize + volume->geo.blocksize - 1) / volume->geo.blocksize;
+      stgsize *= volume->geo.blocksize;
+
+      stage = (FAR uint8_t *)kmm_realloc(wrfile->stage, stgsize);
+      if (!stage)
+        {
+          fdbg("ERROR: Failed to allocate %d byte staging buffer\n", stgsize);
+          return -ENOMEM;
+        }
+
+      wrfile->stage   = stage;
+      wrfile->stgsize = stgsize;
+    }
+
+  memcpy(&wrfile->stage[wrfile->stglen], buffer, buflen);
+  wrfile->stglen += buflen;
+  return OK;
+}
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -439,7 +549,9 @@ static inline ssize_t nxffs_wrappend(FAR struct nxffs_volume_s *volume,
  *
  * Description:
  *   This is an implementation of the NuttX standard file system write
- *   method.
+ *   method.  Nothing is written to FLASH here:  The data is staged in
+ *   memory and committed to FLASH when the file is closed.  That permits
+ *   any number of files to be open for writing at the same time.
  *
  ****************************************************************************/
 
@@ -447,10 +559,7 @@ ssize_t nxffs_write(FAR struct file *filep, FAR const char *buffer, size_t bufle
 {
   FAR struct nxffs_volume_s *volume;
   FAR struct nxffs_wrfile_s *wrfile;
-  ssize_t remaining;
-  ssize_t nwritten;
-  ssize_t total;
-  int ret;
+  ssize_t ret;
 
   fvdbg("Write %d bytes to offset %d\n", buflen, filep->f_pos);
 
@@ -488,6 +597,115 @@ ssize_t nxffs_write(FAR struct file *filep, FAR const char *buffer, size_t bufle
       goto errout_with_semaphore;
     }
 
+  /* Reserve FLASH for the data, then append it to the staging buffer */
+
+  ret = nxffs_wrstgreserve(volume, wrfile, buflen);
+  if (ret < 0)
+    {
+      goto errout_with_semaphore;
+    }
+
+  ret = nxffs_wrstage(volume, wrfile, buffer, buflen);
+  if (ret < 0)
+    {
+      goto errout_with_semaphore;
+    }
+
+  /* Success.. return the number of bytes written */
+
+  ret           = buflen;
+  filep->f_pos  = wrfile->stglen;
+
+  /* Data appended to a file follows the data already in the file */
+
+  if (wrfile->ofile.entry.extent)
+    {
+      filep->f_pos += wrfile->ofile.entry.utc;
+    }
+
+errout_with_semaphore:
+  sem_post(&volume->exclsem);
+errout:
+  return ret;
+}
+
+/****************************************************************************
+ * Name: nxffs_sync
+ *
+ * Description:
+ *   This is the standard mountpoint sync method.  The staged data of a
+ *   file open for writing is not committed until the file is closed, but
+ *   its FLASH was reserved as it was written.  Check that the reservation
+ *   still holds so that a flush before the close reports a commit that
+ *   cannot succeed.
+ *
+ ****************************************************************************/
+
+int nxffs_sync(FAR struct file *filep)
+{
+  FAR struct nxffs_volume_s *volume;
+  FAR struct nxffs_wrfile_s *wrfile;
+  int ret;
+
+  /* Sanity checks */
+
+  DEBUGASSERT(filep->f_priv != NULL && filep->f_inode != NULL);
+
+  /* Recover the open file state and the volume state */
+
+  wrfile = (FAR struct nxffs_wrfile_s *)filep->f_priv;
+  volume = (FAR struct nxffs_volume_s *)filep->f_inode->i_private;
+  DEBUGASSERT(volume != NULL);
+
+  /* Nothing is buffered for a file open for reading */
+
+  if ((wrfile->ofile.oflags & O_WROK) == 0)
+    {
+      return OK;
+    }
+
+  ret = sem_wait(&volume->exclsem);
+  if (ret != OK)
+    {
+      ret = -get_errno();
+      fdbg("ERROR: sem_wait failed: %d\n", ret);
+      return ret;
+    }
+
+  ret = nxffs_wrstgreserve(volume, wrfile, 0);
+  sem_post(&volume->exclsem);
+  return ret;
+}
+
+/****************************************************************************
+ * Name: nxffs_wrdata
+ *
+ * Description:
+ *   Write all of the data staged for a file to FLASH as a contiguous
+ *   sequence of data blocks, re-packing the volume if necessary.  The
+ *   final, partial data block is not finished; that is done by
+ *   nxffs_wrblkhdr() when the file is closed.
+ *
+ * Input Parameters:
+ *   volume - Describes the state of the NXFFS volume
+ *   wrfile - Describes the state of the open file
+ *
+ * Returned Value:
+ *   Zero is returned on success; Otherwise, a negated errno value is
+ *   returned to indicate the nature of the failure.
+ *
+ ****************************************************************************/
+
+int nxffs_wrdata(FAR struct nxffs_volume_s *volume,
+                 FAR struct nxffs_wrfile_s *wrfile)
+{
+  FAR const char *buffer = (FAR const char *)wrfile->stage;
+  size_t buflen = wrfile->stglen;
+  ssize_t remaining;
+  ssize_t nwritten;
+  size_t total;
+  int ret;
+
   /* Loop until we successfully appended all of the data to the file (or an
    * error occurs)
    */
@@ -507,13 +725,21 @@ ssize_t nxffs_write(FAR struct file *filep, FAR const char *buffer, size_t bufle
           if (ret < 0)
             {
               fdbg("ERROR: Failed to allocate a data block: %d\n", -ret);
-              goto errout_with_semaphore;
+              return ret;
             }
         }
 
-      /* Seek to the FLASH block containing the data block */
+      /* Seek to the FLASH block containing the data block and make sure
+       * that it is in the cache.  Packing may have moved it.
+       */
 
       nxffs_ioseek(volume, wrfile->doffset);
+      ret = nxffs_rdcache(volume, volume->ioblock);
+      if (ret < 0)
+        {
+          fdbg("ERROR: Failed to read data block: %d\n", -ret);
+          return ret;
+        }
 
       /* Verify that the FLASH data that was previously written is still intact */
 
@@ -521,7 +747,7 @@ ssize_t nxffs_write(FAR struct file *filep, FAR const char *buffer, size_t bufle
       if (ret < 0)
         {
           fdbg("ERROR: Failed to verify FLASH data block: %d\n", -ret);
-          goto errout_with_semaphore;
+          return ret;
         }
 
       /* Append the data to the end of the data block and write the updated
@@ -531,8 +757,9 @@ ssize_t nxffs_write(FAR struct file *filep, FAR const char *buffer, size_t bufle
       nwritten = nxffs_wrappend(volume, wrfile, &buffer[total], remaining);
       if (nwritten < 0)
         {
-          fdbg("ERROR: Failed to append to FLASH to a data block: %d\n", -ret);
-          goto errout_with_semaphore;
+          fdbg("ERROR: Failed to append to FLASH to a data block: %d\n",
+               -nwritten);
+          return (int)nwritten;
         }
 
       /* Decrement the number of bytes remaining to be written */
@@ -540,15 +767,7 @@ ssize_t nxffs_write(FAR struct file *filep, FAR const char *buffer, size_t bufle
       total += nwritten;
     }
 
-  /* Success.. return the number of bytes written */
-
-  ret           = total;
-  filep->f_pos  = wrfile->datlen;
-
-errout_with_semaphore:
-  sem_post(&volume->exclsem);
-errout:
-  return ret;
+  return OK;
 }
 
 /****************************************************************************
@@ -813,6 +1032,13 @@ int nxffs_wrblkhdr(FAR struct nxffs_volume_s *volume,
   /* Write the data block header to memory */
 
   nxffs_ioseek(volume, wrfile->doffset);
+  ret = nxffs_rdcache(volume, volume->ioblock);
+  if (ret < 0)
+    {
+      fdbg("ERROR: Failed to read data block: %d\n", -ret);
+      goto errout;
+    }
+
   dathdr = (FAR struct nxffs_data_s *)&volume->cache[volume->iooffset];
   memcpy(dathdr->magic, g_datamagic, NXFFS_MAGICSIZE);
   nxffs_wrle32(dathdr->crc, 0);
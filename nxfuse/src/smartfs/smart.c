@@ -51,6 +51,7 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <string.h>
+#include <pthread.h>
 #include <debug.h>
 #include <errno.h>
 
@@ -234,6 +235,7 @@ struct smart_struct_s
   FAR uint8_t          *releasecount;     /* Count of released sectors per erase block */
   FAR uint8_t          *freecount;        /* Count of free sectors per erase block */
   FAR char             *rwbuffer;         /* Our sector read/write buffer */
+  pthread_rwlock_t      lock;             /* Serializes ioctl requests */
   char                  partname[SMART_PARTNAME_SIZE]; /* Optional partition name */
   uint8_t               formatversion;    /* Format version on the device */
   uint8_t               formatstatus;     /* Indicates the status of the device format */
@@ -370,12 +372,16 @@ static ssize_t smart_write(FAR struct inode *inode, const unsigned char *buffer,
 static int     smart_geometry(FAR struct inode *inode, struct geometry *geometry);
 static int     smart_ioctl(FAR struct inode *inode, int cmd, unsigned long arg);
 
+static int smart_isfreephyssector(FAR struct smart_struct_s *dev,
+                 uint16_t physicalsector);
 static int smart_findfreephyssector(FAR struct smart_struct_s *dev, uint8_t canrelocate);
 
 #ifdef CONFIG_FS_WRITABLE
 static int smart_writesector(FAR struct smart_struct_s *dev, unsigned long arg);
-static inline int smart_allocsector(FAR struct smart_struct_s *dev,
-                 unsigned long requested);
+static int smart_allocsector(FAR struct smart_struct_s *dev,
+                 unsigned long requested, FAR uint16_t *physical);
+static int smart_bulkalloc(FAR struct smart_struct_s *dev, unsigned long arg);
+static int smart_freesects(FAR struct smart_struct_s *dev, unsigned long arg);
 #endif
 static int smart_readsector(FAR struct smart_struct_s *dev, unsigned long arg);
 
@@ -3422,6 +3428,68 @@ errout:
   return ret;
 }
 
+/****************************************************************************
+ * Name: smart_isfreephyssector
+ *
+ * Description:  Tests if the given physical sector is available for a new
+ *               allocation, i.e. it has no temporary alloc assigned and its
+ *               header on the media is still in the erased state.  Returns
+ *               1 if the sector is free, 0 if it isn't or -EIO on a read
+ *               error.
+ *
+ ****************************************************************************/
+
+static int smart_isfreephyssector(FAR struct smart_struct_s *dev,
+    uint16_t physicalsector)
+{
+  uint32_t  readaddr;
+  struct    smart_sect_header_s header;
+  int       ret;
+#ifdef CONFIG_MTD_SMART_ENABLE_CRC
+  FAR struct smart_allocsector_s *allocsect;
+
+  /* First check if there is a temporary alloc in place.  If there is,
+   * then this physical sector has already been handed out.
+   */
+
+  allocsect = dev->allocsector;
+  while (allocsect)
+    {
+      if (allocsect->physical == physicalsector)
+        {
+          return 0;
+        }
+
+      allocsect = allocsect->next;
+    }
+#endif
+
+  /* Now check on the physical media */
+
+  readaddr = physicalsector * dev->mtdBlksPerSector * dev->geo.blocksize;
+  ret = MTD_READ(dev->mtd, readaddr, sizeof(struct smart_sect_header_s),
+          (FAR uint8_t *) &header);
+  if (ret != sizeof(struct smart_sect_header_s))
+    {
+      fdbg("Error reading phys sector %d\n", physicalsector);
+      return -EIO;
+    }
+
+  if ((*((FAR uint16_t *) header.logicalsector) == 0xFFFF) &&
+#if SMART_STATUS_VERSION == 1
+      (*((FAR uint16_t *) &header.seq) == 0xFFFF) &&
+#else
+      (header.seq == CONFIG_SMARTFS_ERASEDSTATE) &&
+#endif
+      ((header.status & SMART_STATUS_COMMITTED) ==
+       (CONFIG_SMARTFS_ERASEDSTATE & SMART_STATUS_COMMITTED)))
+    {
+      return 1;
+    }
+
+  return 0;
+}
+
 /****************************************************************************
  * Name: smart_findfreephyssector
  *
@@ -3441,8 +3509,6 @@ static int smart_findfreephyssector(FAR struct smart_struct_s *dev,
 #endif
   uint16_t  physicalsector;
   uint16_t  x, block;
-  uint32_t  readaddr;
-  struct    smart_sect_header_s header;
   int       ret;
 
   /* Determine which erase block we should allocate the new
@@ -3599,52 +3665,13 @@ retry:
     {
       /* Check if this physical sector is available. */
 
-#ifdef CONFIG_MTD_SMART_ENABLE_CRC
-      /* First check if there is a temporary alloc in place */
-
-      FAR struct smart_allocsector_s *allocsect;
-      allocsect = dev->allocsector;
-
-      while (allocsect)
-        {
-          if (allocsect->physical == x)
-            {
-              break;
-            }
-
-          allocsect = allocsect->next;
-        }
-
-      /* If we found this physical sector above, then continue on
-       * to the next physical sector in this block ... this one has
-       * a temporary allocation assigned.
-       */
-
-      if (allocsect)
-        {
-          continue;
-        }
-#endif
-
-      /* Now check on the physical media */
-
-      readaddr = x * dev->mtdBlksPerSector * dev->geo.blocksize;
-      ret = MTD_READ(dev->mtd, readaddr, sizeof(struct smart_sect_header_s),
-              (FAR uint8_t *) &header);
-      if (ret != sizeof(struct smart_sect_header_s))
+      ret = smart_isfreephyssector(dev, x);
+      if (ret < 0)
         {
-          fdbg("Error reading phys sector %d\n", physicalsector);
           return -1;
         }
 
-      if ((*((FAR uint16_t *) header.logicalsector) == 0xFFFF) &&
-#if SMART_STATUS_VERSION == 1
-          (*((FAR uint16_t *) &header.seq) == 0xFFFF) &&
-#else
-          (header.seq == CONFIG_SMARTFS_ERASEDSTATE) &&
-#endif
-          ((header.status & SMART_STATUS_COMMITTED) ==
-           (CONFIG_SMARTFS_ERASEDSTATE & SMART_STATUS_COMMITTED)))
+      if (ret)
         {
           physicalsector = x;
           dev->lastallocblock = allocblock;
@@ -3997,7 +4024,7 @@ static inline int smart_read_wearstatus(FAR struct smart_struct_s *dev)
 
           /* This logical sector does not exist yet.  We must allocate it */
 
-          ret = smart_allocsector(dev, sector);
+          ret = smart_allocsector(dev, sector, NULL);
           if (ret != sector)
             {
               fdbg("Unable to allocate wear level status sector %d\n", sector);
@@ -4734,12 +4761,16 @@ errout:
  *
  * Description:  Allocates a new logical sector.  If an argument is given,
  *               then it tries to allocate the specified sector number.
+ *               If physical is non-NULL and points to a valid physical
+ *               sector number, that physical sector is used when it is
+ *               still free.  The physical sector actually selected is
+ *               returned through the same pointer.
  *
  ****************************************************************************/
 
 #ifdef CONFIG_FS_WRITABLE
-static inline int smart_allocsector(FAR struct smart_struct_s *dev,
-                    unsigned long requested)
+static int smart_allocsector(FAR struct smart_struct_s *dev,
+                    unsigned long requested, FAR uint16_t *physical)
 {
   uint16_t  logsector = 0xFFFF; /* Logical sector number selected */
   uint16_t  physicalsector;     /* The selected physical sector */
@@ -4901,9 +4932,22 @@ static inline int smart_allocsector(FAR struct smart_struct_s *dev,
 
   smart_garbagecollect(dev);
 
-  /* Find a free physical sector */
+  /* Find a free physical sector.  Use the caller's preferred physical
+   * sector if one was given and it is still available.
+   */
+
+  physicalsector = 0xFFFF;
+  if (physical != NULL && *physical < dev->totalsectors &&
+      smart_isfreephyssector(dev, *physical) == 1)
+    {
+      physicalsector = *physical;
+    }
+
+  if (physicalsector == 0xFFFF)
+    {
+      physicalsector = smart_findfreephyssector(dev, FALSE);
+    }
 
-  physicalsector = smart_findfreephyssector(dev, FALSE);
   fvdbg("Alloc: log=%d, phys=%d, erase block=%d, free=%d, released=%d\n",
           logsector, physicalsector, physicalsector /
           dev->sectorsPerBlk, dev->freesectors, dev->releasecount);
@@ -4963,6 +5007,11 @@ static inline int smart_allocsector(FAR struct smart_struct_s *dev,
 #endif
   dev->freesectors--;
 
+  if (physical != NULL)
+    {
+      *physical = physicalsector;
+    }
+
   /* Return the logical sector number */
 
   return logsector;
@@ -4970,67 +5019,102 @@ static inline int smart_allocsector(FAR struct smart_struct_s *dev,
 #endif /* CONFIG_FS_WRITABLE */
 
 /****************************************************************************
- * Name: smart_freesector
+ * Name: smart_bulkalloc
  *
- * Description:  Frees a logical sector from the device.  Freeing (also
- *               called releasing) is performed by programming the released
- *               bit in the sector header's status byte.
+ * Description:  Allocates a run of logical sectors with a single request.
+ *               Each new sector is placed in the physical sector following
+ *               the previous one whenever that sector is free and in the
+ *               same erase block, so a long sequential file ends up
+ *               physically contiguous.  If the device runs out of space
+ *               part way through, the sectors allocated so far are
+ *               returned and the count is updated accordingly.
  *
  ****************************************************************************/
 
 #ifdef CONFIG_FS_WRITABLE
-static inline int smart_freesector(FAR struct smart_struct_s *dev,
-                    unsigned long logicalsector)
+static int smart_bulkalloc(FAR struct smart_struct_s *dev, unsigned long arg)
 {
+  FAR struct smart_bulkalloc_s *req;
+  uint16_t  physical;
+  uint16_t  x;
   int       ret;
-  int       readaddr;
-  uint16_t  physsector;
-  uint16_t  block;
-  struct    smart_sect_header_s  header;
-  size_t    offset;
 
-  /* Check if the logical sector is within bounds */
+  req = (FAR struct smart_bulkalloc_s *) arg;
+  if (req == NULL || req->sectors == NULL || req->count == 0)
+    {
+      return -EINVAL;
+    }
 
-  if ((logicalsector > 2) && (logicalsector < dev->totalsectors))
+  physical = 0xFFFF;
+  for (x = 0; x < req->count; x++)
     {
-      /* Validate the sector is actually allocated */
+      /* Prefer the next physical sector within the same erase block */
 
-#ifndef CONFIG_MTD_SMART_MINIMIZE_RAM
-      if (dev->sMap[logicalsector] == (uint16_t) -1)
-#else
-      if (!(dev->sBitMap[logicalsector >> 3] & (1 << (logicalsector & 0x07))))
-#endif
+      if (physical != 0xFFFF)
         {
-          fdbg("Invalid release - sector %d not allocated\n", logicalsector);
-          ret = -EINVAL;
-          goto errout;
+          physical++;
+          if (physical % dev->sectorsPerBlk >= dev->availSectPerBlk)
+            {
+              physical = 0xFFFF;
+            }
+        }
+
+      ret = smart_allocsector(dev, 0xFFFF, &physical);
+      if (ret < 0)
+        {
+          if (x == 0)
+            {
+              return ret;
+            }
+
+          /* Report the partial allocation */
+
+          break;
         }
+
+      req->sectors[x] = (uint16_t) ret;
     }
 
-  /* Okay to release the sector.  Read the sector header info */
+  req->count = x;
+  return OK;
+}
+#endif /* CONFIG_FS_WRITABLE */
+
+/****************************************************************************
+ * Name: smart_markreleased
+ *
+ * Description:  Programs the released bit in the status byte of the
+ *               physical sector holding the given logical sector.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_FS_WRITABLE
+static int smart_markreleased(FAR struct smart_struct_s *dev,
+                    uint16_t logicalsector, uint16_t physsector)
+{
+  int       ret;
+  int       readaddr;
+  struct    smart_sect_header_s  header;
+  size_t    offset;
+
+  /* Read the sector header info */
 
-#ifndef CONFIG_MTD_SMART_MINIMIZE_RAM
-  physsector = dev->sMap[logicalsector];
-#else
-  physsector = smart_cache_lookup(dev, logicalsector);
-#endif
   readaddr = physsector * dev->mtdBlksPerSector * dev->geo.blocksize;
   ret = MTD_READ(dev->mtd, readaddr, sizeof(struct smart_sect_header_s),
                  (FAR uint8_t *) &header);
   if (ret != sizeof(struct smart_sect_header_s))
     {
-      goto errout;
+      return -EIO;
     }
 
   /* Do a sanity check on the logical sector number */
 
-  if (*((FAR uint16_t *) header.logicalsector) != (uint16_t) logicalsector)
+  if (*((FAR uint16_t *) header.logicalsector) != logicalsector)
     {
       /* Hmmm... something is wrong.  This should always match!  Bug in our code? */
 
       fdbg("Sector %d logical sector in header doesn't match\n", logicalsector);
-      ret = -EINVAL;
-      goto errout;
+      return -EINVAL;
     }
 
   /* Mark the sector as released */
@@ -5048,7 +5132,140 @@ static inline int smart_freesector(FAR struct smart_struct_s *dev,
   if (ret != 1)
     {
       fdbg("Error updating physical sector %d status\n", physsector);
-      goto errout;
+      return -EIO;
+    }
+
+  return OK;
+}
+#endif /* CONFIG_FS_WRITABLE */
+
+/****************************************************************************
+ * Name: smart_lookupsector
+ *
+ * Description:  Validates that a logical sector being freed is allocated
+ *               and returns the physical sector it is mapped to.  With CRC
+ *               enabled, a sector that was allocated but never written is
+ *               dropped from the temporary alloc list here and 0xFFFF is
+ *               returned, as nothing is on the device yet.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_FS_WRITABLE
+static int smart_lookupsector(FAR struct smart_struct_s *dev,
+                    unsigned long logicalsector)
+{
+  uint16_t  physsector;
+#ifdef CONFIG_MTD_SMART_ENABLE_CRC
+  FAR struct smart_allocsector_s *allocsect;
+  FAR struct smart_allocsector_s *prev;
+#endif
+
+  /* Check if the logical sector is within bounds */
+
+  if ((logicalsector > 2) && (logicalsector < dev->totalsectors))
+    {
+      /* Validate the sector is actually allocated */
+
+#ifndef CONFIG_MTD_SMART_MINIMIZE_RAM
+      if (dev->sMap[logicalsector] == (uint16_t) -1)
+#else
+      if (!(dev->sBitMap[logicalsector >> 3] & (1 << (logicalsector & 0x07))))
+#endif
+        {
+          fdbg("Invalid release - sector %d not allocated\n", logicalsector);
+          return -EINVAL;
+        }
+    }
+
+#ifdef CONFIG_MTD_SMART_ENABLE_CRC
+  /* A sector that was allocated but never written only has an in-memory
+   * temporary alloc.  Nothing is on the device yet, so just drop the
+   * alloc and give the physical sector back to the free pool.
+   */
+
+  prev = NULL;
+  allocsect = dev->allocsector;
+  while (allocsect && allocsect->logical != (uint16_t) logicalsector)
+    {
+      prev = allocsect;
+      allocsect = allocsect->next;
+    }
+
+  if (allocsect != NULL)
+    {
+      if (prev == NULL)
+        {
+          dev->allocsector = allocsect->next;
+        }
+      else
+        {
+          prev->next = allocsect->next;
+        }
+
+      physsector = allocsect->physical;
+      kmm_free(allocsect);
+
+#ifdef CONFIG_MTD_SMART_PACK_COUNTS
+      smart_add_count(dev, dev->freecount, physsector / dev->sectorsPerBlk, 1);
+#else
+      dev->freecount[physsector / dev->sectorsPerBlk]++;
+#endif
+      dev->freesectors++;
+
+#ifndef CONFIG_MTD_SMART_MINIMIZE_RAM
+      dev->sMap[logicalsector] = (uint16_t) -1;
+#else
+      dev->sBitMap[logicalsector >> 3] &= ~(1 << (logicalsector & 0x07));
+      smart_update_cache(dev, logicalsector, 0xFFFF);
+#endif
+
+      return 0xFFFF;
+    }
+#endif
+
+#ifndef CONFIG_MTD_SMART_MINIMIZE_RAM
+  physsector = dev->sMap[logicalsector];
+#else
+  physsector = smart_cache_lookup(dev, logicalsector);
+#endif
+
+  return physsector;
+}
+#endif /* CONFIG_FS_WRITABLE */
+
+/****************************************************************************
+ * Name: smart_freesector
+ *
+ * Description:  Frees a logical sector from the device.  Freeing (also
+ *               called releasing) is performed by programming the released
+ *               bit in the sector header's status byte.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_FS_WRITABLE
+static inline int smart_freesector(FAR struct smart_struct_s *dev,
+                    unsigned long logicalsector)
+{
+  int       ret;
+  uint16_t  physsector;
+  uint16_t  block;
+
+  /* Validate the sector and find where it lives */
+
+  ret = smart_lookupsector(dev, logicalsector);
+  if (ret < 0 || ret == 0xFFFF)
+    {
+      return ret < 0 ? ret : OK;
+    }
+
+  physsector = (uint16_t) ret;
+
+  /* Okay to release the sector */
+
+  ret = smart_markreleased(dev, logicalsector, physsector);
+  if (ret < 0)
+    {
+      return ret;
     }
 
   /* Update the erase block's release count */
@@ -5073,10 +5290,176 @@ static inline int smart_freesector(FAR struct smart_struct_s *dev,
   /* If this block has only released blocks, then erase it */
 
   smart_erase_block_if_empty(dev, block, FALSE);
-  ret = OK;
+  return OK;
+}
+#endif /* CONFIG_FS_WRITABLE */
 
-errout:
-  return ret;
+/****************************************************************************
+ * Name: smart_cmpsects
+ *
+ * Description:  qsort compare function for the packed physical / logical
+ *               sector pairs built by smart_freesects.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_FS_WRITABLE
+static int smart_cmpsects(FAR const void *a, FAR const void *b)
+{
+  uint32_t  sa = *((FAR const uint32_t *) a);
+  uint32_t  sb = *((FAR const uint32_t *) b);
+
+  return sa < sb ? -1 : (sa > sb ? 1 : 0);
+}
+#endif /* CONFIG_FS_WRITABLE */
+
+/****************************************************************************
+ * Name: smart_freesects
+ *
+ * Description:  Frees a list of logical sectors with a single request.  The
+ *               sectors are grouped by erase block so each block's release
+ *               count is updated and tested for erase only once.  When the
+ *               release empties an erase block, the block is erased right
+ *               away without programming the status byte of each sector.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_FS_WRITABLE
+static int smart_freesects(FAR struct smart_struct_s *dev, unsigned long arg)
+{
+  FAR struct smart_freesects_s *req;
+  FAR uint32_t *list;
+  uint16_t  logical;
+  uint16_t  physical;
+  uint16_t  block;
+  uint16_t  freecount;
+  uint16_t  releasecount;
+  uint16_t  count;
+  uint16_t  start;
+  uint16_t  end;
+  uint16_t  x;
+  uint16_t  n;
+  bool      erasing;
+  int       result = OK;
+  int       ret;
+
+  req = (FAR struct smart_freesects_s *) arg;
+  if (req == NULL || req->sectors == NULL)
+    {
+      return -EINVAL;
+    }
+
+  if (req->count == 0)
+    {
+      return OK;
+    }
+
+  list = (FAR uint32_t *) kmm_malloc(req->count * sizeof(uint32_t));
+  if (list == NULL)
+    {
+      /* Fall back to releasing the sectors one at a time */
+
+      for (x = 0; x < req->count; x++)
+        {
+          ret = smart_freesector(dev, req->sectors[x]);
+          if (ret < 0)
+            {
+              result = ret;
+            }
+        }
+
+      return result;
+    }
+
+  /* Look up the physical sector of each logical sector and sort them by
+   * physical location so the sectors of each erase block are adjacent.
+   */
+
+  n = 0;
+  for (x = 0; x < req->count; x++)
+    {
+      ret = smart_lookupsector(dev, req->sectors[x]);
+      if (ret < 0)
+        {
+          result = ret;
+          continue;
+        }
+
+      if (ret != 0xFFFF)
+        {
+          list[n++] = ((uint32_t) ret << 16) | req->sectors[x];
+        }
+    }
+
+  qsort(list, n, sizeof(uint32_t), smart_cmpsects);
+
+  /* Now release the sectors one erase block at a time */
+
+  for (start = 0; start < n; start = end)
+    {
+      block = (list[start] >> 16) / dev->sectorsPerBlk;
+      for (end = start + 1; end < n &&
+           (list[end] >> 16) / dev->sectorsPerBlk == block; end++)
+        {
+        }
+
+#ifdef CONFIG_MTD_SMART_PACK_COUNTS
+      releasecount = smart_get_count(dev, dev->releasecount, block);
+      freecount = smart_get_count(dev, dev->freecount, block);
+#else
+      releasecount = dev->releasecount[block];
+      freecount = dev->freecount[block];
+#endif
+
+      /* If this release leaves no live sectors in the block, then it is
+       * about to be erased and the status bytes don't need programming.
+       */
+
+      count = end - start;
+      erasing = freecount == 0 &&
+        releasecount + count == dev->availSectPerBlk;
+
+      for (x = start; x < end; x++)
+        {
+          logical = (uint16_t) (list[x] & 0xFFFF);
+          physical = (uint16_t) (list[x] >> 16);
+
+          if (!erasing)
+            {
+              ret = smart_markreleased(dev, logical, physical);
+              if (ret < 0)
+                {
+                  result = ret;
+                  count--;
+                  continue;
+                }
+            }
+
+          /* Unmap this logical sector */
+
+#ifndef CONFIG_MTD_SMART_MINIMIZE_RAM
+          dev->sMap[logical] = (uint16_t) -1;
+#else
+          dev->sBitMap[logical >> 3] &= ~(1 << (logical & 0x07));
+          smart_update_cache(dev, logical, 0xFFFF);
+#endif
+        }
+
+      /* Update the erase block's release count once for the whole group */
+
+      dev->releasesectors += count;
+#ifdef CONFIG_MTD_SMART_PACK_COUNTS
+      smart_add_count(dev, dev->releasecount, block, count);
+#else
+      dev->releasecount[block] += count;
+#endif
+
+      /* If this block has only released blocks, then erase it */
+
+      smart_erase_block_if_empty(dev, block, FALSE);
+    }
+
+  kmm_free(list);
+  return result;
 }
 #endif /* CONFIG_FS_WRITABLE */
 
@@ -5105,6 +5488,23 @@ static int smart_ioctl(FAR struct inode *inode, int cmd, unsigned long arg)
   dev = (FAR struct smart_struct_s *)inode->i_private;
 #endif
 
+  /* Requests are serialized on the device lock since they share the sector
+   * map, the per-block counts and rwbuffer.  Without CRC or the sector
+   * cache, a sector read only looks up the map and reads straight into the
+   * caller's buffer, so reads take the lock shared and may run in parallel.
+   */
+
+#if !defined(CONFIG_MTD_SMART_ENABLE_CRC) && !defined(CONFIG_MTD_SMART_MINIMIZE_RAM)
+  if (cmd == BIOC_READSECT)
+    {
+      pthread_rwlock_rdlock(&dev->lock);
+    }
+  else
+#endif
+    {
+      pthread_rwlock_wrlock(&dev->lock);
+    }
+
   /* Process the ioctl's we care about first, pass any we don't respond
    * to directly to the underlying MTD device.
    */
@@ -5121,7 +5521,8 @@ static int smart_ioctl(FAR struct inode *inode, int cmd, unsigned long arg)
       if (arg == 0)
         {
           fdbg("ERROR: BIOC_XIPBASE argument is NULL\n");
-          return -EINVAL;
+          ret = -EINVAL;
+          goto ok_out;
         }
 #endif
 
@@ -5167,7 +5568,14 @@ static int smart_ioctl(FAR struct inode *inode, int cmd, unsigned long arg)
 
       /* Allocate a logical sector for the upper layer file system */
 
-      ret = smart_allocsector(dev, arg);
+      ret = smart_allocsector(dev, arg, NULL);
+      goto ok_out;
+
+    case BIOC_BULKALLOC:
+
+      /* Allocate several logical sectors in one request */
+
+      ret = smart_bulkalloc(dev, arg);
       goto ok_out;
 
     case BIOC_FREESECT:
@@ -5177,6 +5585,13 @@ static int smart_ioctl(FAR struct inode *inode, int cmd, unsigned long arg)
       ret = smart_freesector(dev, arg);
       goto ok_out;
 
+    case BIOC_FREESECTS:
+
+      /* Free a list of logical sectors in one request */
+
+      ret = smart_freesects(dev, arg);
+      goto ok_out;
+
     case BIOC_WRITESECT:
 
       /* Write to the sector */
@@ -5263,6 +5678,7 @@ static int smart_ioctl(FAR struct inode *inode, int cmd, unsigned long arg)
     }
 
 ok_out:
+  pthread_rwlock_unlock(&dev->lock);
   return ret;
 }
 
@@ -5309,6 +5725,7 @@ int smart_initialize(int minor, FAR struct mtd_dev_s *mtd, FAR const char *partn
       /* Initialize the SMART device structure */
 
       dev->mtd = mtd;
+      pthread_rwlock_init(&dev->lock, NULL);
 #ifdef CONFIG_MTD_SMART_ALLOC_DEBUG
       dev->bytesalloc = 0;
       for (totalsectors = 0; totalsectors < SMART_MAX_ALLOCS; totalsectors++)
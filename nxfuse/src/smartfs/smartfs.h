@@ -46,6 +46,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <semaphore.h>
+#include <pthread.h>
 
 #include <nuttx/mtd/mtd.h>
 #include <nuttx/fs/smart.h>
@@ -201,6 +202,14 @@
 #  define CONFIG_SMARTFS_DIRDEPTH 8
 #endif
 
+/* Maximum number of sectors reserved with a single BIOC_BULKALLOC request
+ * when appending a large write to the end of a file.
+ */
+
+#ifndef CONFIG_SMARTFS_BULKALLOC
+#  define CONFIG_SMARTFS_BULKALLOC 16
+#endif
+
 /* Buffer flags (when CRC enabled) */
 
 #define SMARTFS_BFLAG_DIRTY       0x01    /* Set if data changed in the sector */
@@ -296,6 +305,7 @@ struct smartfs_ofile_s
   uint8_t                   bflags;     /* Buffer flags */
 #endif
   int16_t                   crefs;      /* Reference count */
+  pthread_mutex_t           lock;       /* Serializes readers of this file */
   mode_t                    oflags;     /* Open mode */
   struct smartfs_entry_s    entry;      /* Describes the SMARTFS inode entry */
   size_t                    filepos;    /* Current file position */
@@ -320,8 +330,10 @@ struct smartfs_mountpt_s
   struct smartfs_mountpt_s   *fs_next;      /* Pointer to next SMART filesystem */
 #endif
   FAR struct inode           *fs_blkdriver; /* Our underlying block device */
-  sem_t                      *fs_sem;       /* Used to assure thread-safe access */
+  pthread_rwlock_t           *fs_lock;      /* Shared for readers, exclusive for
+                                             * anything that modifies the volume */
   FAR struct smartfs_ofile_s *fs_head;      /* A singly-linked list of open files */
+  uint16_t                    fs_opendirs;  /* Directories open for reading */
   bool                        fs_mounted;   /* true: The file system is ready */
   struct smart_format_s       fs_llformat;  /* Low level device format info */
   char                       *fs_rwbuffer;  /* Read/Write working buffer */
@@ -337,10 +349,15 @@ struct smartfs_mountpt_s
  * Internal function prototypes
  ****************************************************************************/
 
-/* Semaphore access for internal use */
+/* Semaphore access for internal use.  smartfs_semtake() takes the mount
+ * lock exclusively; smartfs_rdlock() takes it shared for operations that
+ * only read sectors into a per-thread scratch buffer.
+ */
 
 void smartfs_semtake(struct smartfs_mountpt_s *fs);
+void smartfs_rdlock(struct smartfs_mountpt_s *fs);
 void smartfs_semgive(struct smartfs_mountpt_s *fs);
+FAR char *smartfs_scratchbuffer(struct smartfs_mountpt_s *fs);
 
 /* Forward references for utility functions */
 
@@ -356,6 +373,10 @@ int smartfs_finddirentry(struct smartfs_mountpt_s *fs,
         struct smartfs_entry_s *direntry, const char *relpath,
         uint16_t *parentdirsector, const char **filename);
 
+int smartfs_lookupentry(struct smartfs_mountpt_s *fs,
+        struct smartfs_entry_s *direntry, const char *relpath,
+        uint16_t *parentdirsector, const char **filename, bool getlength);
+
 int smartfs_createentry(struct smartfs_mountpt_s *fs,
         uint16_t parentdirsector, const char* filename,
         uint16_t type, mode_t mode, uint32_t utc,
@@ -365,6 +386,9 @@ int smartfs_createentry(struct smartfs_mountpt_s *fs,
 int smartfs_deleteentry(struct smartfs_mountpt_s *fs,
         struct smartfs_entry_s *entry);
 
+int smartfs_compactdir(struct smartfs_mountpt_s *fs, uint16_t dirsector,
+        bool lazy);
+
 int smartfs_countdirentries(struct smartfs_mountpt_s *fs,
         struct smartfs_entry_s *entry);
 
@@ -267,9 +267,9 @@ int smartfs_ioctl(FAR struct file *filep, int cmd, unsigned long arg)
   struct smartfs_ofile_s   *sf;
   struct smartfs_entry_s    entry;
 
-  /* We onlty handle the UTIME and CHMOD ioctl commands */
+  /* We onlty handle the OPTIMIZE, UTIME and CHMOD ioctl commands */
 
-  if (cmd != FIOUTIME && cmd != FIOCHMOD)
+  if (cmd != FIOC_OPTIMIZE && cmd != FIOUTIME && cmd != FIOCHMOD)
     return ret;
 
   /* Sanity checks */
@@ -286,6 +286,15 @@ int smartfs_ioctl(FAR struct file *filep, int cmd, unsigned long arg)
 
   smartfs_semtake(fs);
 
+  /* OPTIMIZE packs the directory holding the file */
+
+  if (cmd == FIOC_OPTIMIZE)
+    {
+      ret = smartfs_compactdir(fs, sf->entry.dfirst, false);
+      smartfs_semgive(fs);
+      return ret < 0 ? ret : OK;
+    }
+
   /* Handle the UTIME and CHMOD ioctl commands */
 
   switch (cmd)
@@ -47,6 +47,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <semaphore.h>
+#include <pthread.h>
 #include <assert.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -69,6 +70,15 @@
  * Private Types
  ****************************************************************************/
 
+/* Logical sectors reserved with BIOC_BULKALLOC while appending data */
+
+struct smartfs_reserve_s
+{
+  uint16_t  sectors[CONFIG_SMARTFS_BULKALLOC]; /* Reserved logical sectors */
+  uint16_t  count;                  /* Number of sectors reserved */
+  uint16_t  next;                   /* Index of the next sector to use */
+};
+
 /****************************************************************************
  * Private Function Prototypes
  ****************************************************************************/
@@ -88,6 +98,8 @@ static int     smartfs_dup(FAR const struct file *oldp, FAR struct file *newp);
 static int     smartfs_opendir(struct inode *mountpt, const char *relpath,
                         struct fs_dirent_s *dir);
 static int     smartfs_readdir(struct inode *mountpt, struct fs_dirent_s *dir);
+static int     smartfs_closedir(struct inode *mountpt,
+                                struct fs_dirent_s *dir);
 static int     smartfs_rewinddir(struct inode *mountpt, struct fs_dirent_s *dir);
 
 static int     smartfs_bind(FAR struct inode *blkdriver, const void *data,
@@ -107,13 +119,20 @@ static int     smartfs_stat(struct inode *mountpt, const char *relpath, struct s
 static off_t smartfs_seek_internal(struct smartfs_mountpt_s *fs,
                         struct smartfs_ofile_s *sf,
                         off_t offset, int whence);
+static int     smartfs_nextsector(struct smartfs_mountpt_s *fs,
+                        struct smartfs_reserve_s *reserve, size_t remaining);
+static void    smartfs_releasereserve(struct smartfs_mountpt_s *fs,
+                        struct smartfs_reserve_s *reserve);
 
 /****************************************************************************
  * Private Variables
  ****************************************************************************/
 
-static uint8_t  g_seminitialized = FALSE;
-static sem_t    g_sem;
+/* The mount lock is shared by all SMARTFS mounts since, with
+ * CONFIG_SMARTFS_MULTI_ROOT_DIRS, they share one set of working buffers.
+ */
+
+static pthread_rwlock_t g_lock = PTHREAD_RWLOCK_INITIALIZER;
 
 /****************************************************************************
  * Public Data
@@ -137,7 +156,7 @@ const struct mountpt_operations smartfs_operations =
   smartfs_dup,           /* dup */
 
   smartfs_opendir,       /* opendir */
-  NULL,                  /* closedir */
+  smartfs_closedir,      /* closedir */
   smartfs_readdir,       /* readdir */
   smartfs_rewinddir,     /* rewinddir */
 
@@ -309,6 +328,7 @@ static int smartfs_open(FAR struct file *filep, const char *relpath,
 
   sf->oflags = oflags;
   sf->crefs = 1;
+  pthread_mutex_init(&sf->lock, NULL);
   sf->filepos = 0;
   sf->curroffset = sizeof(struct smartfs_chain_header_s);
   sf->currsector = sf->entry.firstsector;
@@ -452,6 +472,7 @@ static int smartfs_close(FAR struct file *filep)
     }
 #endif
 
+  pthread_mutex_destroy(&sf->lock);
   kmm_free(sf);
 
 okout:
@@ -470,6 +491,7 @@ static ssize_t smartfs_read(FAR struct file *filep, char *buffer, size_t buflen)
   struct smartfs_ofile_s   *sf;
   struct smart_read_write_s readwrite;
   struct smartfs_chain_header_s *header;
+  char                     *sector;
   int                       ret = OK;
   uint32_t                  bytesread;
   uint16_t                  bytestoread;
@@ -487,9 +509,20 @@ static ssize_t smartfs_read(FAR struct file *filep, char *buffer, size_t buflen)
 
   DEBUGASSERT(fs != NULL);
 
-  /* Take the semaphore */
+  /* Reads only need the mount lock shared.  The per-file lock keeps
+   * threads sharing this open file from racing on its position, and the
+   * sector data is staged in this thread's scratch buffer.
+   */
 
-  smartfs_semtake(fs);
+  smartfs_rdlock(fs);
+  pthread_mutex_lock(&sf->lock);
+
+  sector = smartfs_scratchbuffer(fs);
+  if (sector == NULL)
+    {
+      ret = -ENOMEM;
+      goto errout_with_semaphore;
+    }
 
   /* Loop until all byte read or error */
 
@@ -509,7 +542,7 @@ static ssize_t smartfs_read(FAR struct file *filep, char *buffer, size_t buflen)
 
       readwrite.logsector = sf->currsector;
       readwrite.offset = 0;
-      readwrite.buffer = (uint8_t *) fs->fs_rwbuffer;
+      readwrite.buffer = (uint8_t *) sector;
       readwrite.count = fs->fs_llformat.availbytes;
       ret = FS_IOCTL(fs, BIOC_READSECT, (unsigned long) &readwrite);
       if (ret < 0)
@@ -520,7 +553,7 @@ static ssize_t smartfs_read(FAR struct file *filep, char *buffer, size_t buflen)
 
       /* Point header to the read data to get used byte count */
 
-      header = (struct smartfs_chain_header_s *) fs->fs_rwbuffer;
+      header = (struct smartfs_chain_header_s *) sector;
 
       /* Get number of used bytes in this sector */
 
@@ -549,7 +582,7 @@ static ssize_t smartfs_read(FAR struct file *filep, char *buffer, size_t buflen)
         {
           /* Do incremental copy from this sector */
 
-          memcpy(&buffer[bytesread], &fs->fs_rwbuffer[sf->curroffset], bytestoread);
+          memcpy(&buffer[bytesread], &sector[sf->curroffset], bytestoread);
           bytesread += bytestoread;
           sf->filepos += bytestoread;
           sf->curroffset += bytestoread;
@@ -580,6 +613,7 @@ static ssize_t smartfs_read(FAR struct file *filep, char *buffer, size_t buflen)
   ret = bytesread;
 
 errout_with_semaphore:
+  pthread_mutex_unlock(&sf->lock);
   smartfs_semgive(fs);
   return ret;
 }
@@ -682,6 +716,73 @@ errout:
   return ret;
 }
 
+/****************************************************************************
+ * Name: smartfs_nextsector
+ *
+ * Description: Returns the next reserved logical sector to chain onto the
+ *   end of a file.  When the reservation is used up, a new run of sectors
+ *   large enough to hold the remaining bytes of the write (up to
+ *   CONFIG_SMARTFS_BULKALLOC) is reserved with a single BIOC_BULKALLOC.
+ *
+ ****************************************************************************/
+
+static int smartfs_nextsector(struct smartfs_mountpt_s *fs,
+                              struct smartfs_reserve_s *reserve,
+                              size_t remaining)
+{
+  struct smart_bulkalloc_s bulk;
+  size_t                   datasize;
+  size_t                   count;
+  int                      ret;
+
+  if (reserve->next == reserve->count)
+    {
+      /* Calculate the number of sectors needed for the remaining data */
+
+      datasize = fs->fs_llformat.availbytes -
+        sizeof(struct smartfs_chain_header_s);
+      count = (remaining + datasize - 1) / datasize;
+      if (count > CONFIG_SMARTFS_BULKALLOC)
+        {
+          count = CONFIG_SMARTFS_BULKALLOC;
+        }
+      else if (count == 0)
+        {
+          count = 1;
+        }
+
+      bulk.count = count;
+      bulk.sectors = reserve->sectors;
+      ret = FS_IOCTL(fs, BIOC_BULKALLOC, (unsigned long) &bulk);
+      if (ret < 0)
+        {
+          fdbg("Error %d allocating new sectors\n", ret);
+          return ret;
+        }
+
+      reserve->count = bulk.count;
+      reserve->next = 0;
+    }
+
+  return reserve->sectors[reserve->next++];
+}
+
+/****************************************************************************
+ * Name: smartfs_releasereserve
+ *
+ * Description: Frees any reserved sectors that were not used by the write.
+ *
+ ****************************************************************************/
+
+static void smartfs_releasereserve(struct smartfs_mountpt_s *fs,
+                                   struct smartfs_reserve_s *reserve)
+{
+  while (reserve->next < reserve->count)
+    {
+      FS_IOCTL(fs, BIOC_FREESECT, reserve->sectors[reserve->next++]);
+    }
+}
+
 /****************************************************************************
  * Name: smartfs_write
  ****************************************************************************/
@@ -694,8 +795,13 @@ static ssize_t smartfs_write(FAR struct file *filep, const char *buffer,
   struct smartfs_ofile_s   *sf;
   struct smart_read_write_s readwrite;
   struct smartfs_chain_header_s *header;
+  struct smartfs_reserve_s  reserve;
   size_t                    byteswritten;
   int                       ret;
+#ifndef CONFIG_SMARTFS_USE_SECTOR_BUFFER
+  uint16_t                  datasize;
+  uint16_t                  nextsector;
+#endif
 
   /* Sanity checks.  I have seen the following assertion misfire if
    * CONFIG_DEBUG_MM is enabled while re-directing output to a
@@ -724,6 +830,8 @@ static ssize_t smartfs_write(FAR struct file *filep, const char *buffer,
   /* Take the semaphore */
 
   smartfs_semtake(fs);
+  reserve.count = 0;
+  reserve.next = 0;
 
   /* Test the permissions.  Only allow write if the file was opened with
    * write flags.
@@ -813,7 +921,10 @@ static ssize_t smartfs_write(FAR struct file *filep, const char *buffer,
         }
     }
 
-  /* Now append data to end of the file. */
+  /* Now append data to end of the file.  New sectors are taken from a
+   * run reserved up front so the chain link to the next sector is known
+   * before the data for the current sector is written.
+   */
 
   while (buflen > 0)
     {
@@ -832,6 +943,65 @@ static ssize_t smartfs_write(FAR struct file *filep, const char *buffer,
       sf->bflags |= SMARTFS_BFLAG_DIRTY;
 
 #else  /* CONFIG_SMARTFS_USE_SECTOR_BUFFER */
+      datasize = fs->fs_llformat.availbytes -
+        sizeof(struct smartfs_chain_header_s);
+
+      /* If this is an empty sector that will be completely filled with
+       * more data still to follow, then write the chain link, the used
+       * byte count and the data with a single sector write.
+       */
+
+      if (sf->curroffset == sizeof(struct smartfs_chain_header_s) &&
+          sf->byteswritten == 0 && buflen > datasize)
+        {
+          readwrite.logsector = sf->currsector;
+          readwrite.offset = 0;
+          readwrite.count = sizeof(struct smartfs_chain_header_s);
+          readwrite.buffer = (uint8_t *) fs->fs_rwbuffer;
+          ret = FS_IOCTL(fs, BIOC_READSECT, (unsigned long) &readwrite);
+          if (ret < 0)
+            {
+              fdbg("Error %d reading sector %d header\n", ret, sf->currsector);
+              goto errout_with_semaphore;
+            }
+
+          header = (struct smartfs_chain_header_s *) fs->fs_rwbuffer;
+          if (SMARTFS_NEXTSECTOR(header) == SMARTFS_ERASEDSTATE_16BIT &&
+              SMARTFS_USED(header) == SMARTFS_ERASEDSTATE_16BIT)
+            {
+              ret = smartfs_nextsector(fs, &reserve, buflen - datasize);
+              if (ret < 0)
+                {
+                  goto errout_with_semaphore;
+                }
+
+              *((uint16_t *) header->nextsector) = (uint16_t) ret;
+              *((uint16_t *) header->used) = datasize;
+              memcpy(&fs->fs_rwbuffer[sizeof(struct smartfs_chain_header_s)],
+                     &buffer[byteswritten], datasize);
+
+              readwrite.offset = offsetof(struct smartfs_chain_header_s,
+                nextsector);
+              readwrite.count = fs->fs_llformat.availbytes - readwrite.offset;
+              readwrite.buffer = (uint8_t *) &fs->fs_rwbuffer[readwrite.offset];
+              ret = FS_IOCTL(fs, BIOC_WRITESECT, (unsigned long) &readwrite);
+              if (ret < 0)
+                {
+                  fdbg("Error %d writing sector %d data\n", ret, sf->currsector);
+                  goto errout_with_semaphore;
+                }
+
+              /* Update our control variables and move to the next sector */
+
+              sf->entry.datlen += datasize;
+              sf->filepos += datasize;
+              buflen -= datasize;
+              byteswritten += datasize;
+              sf->currsector = SMARTFS_NEXTSECTOR(header);
+              continue;
+            }
+        }
+
       readwrite.offset = sf->curroffset;
       readwrite.logsector = sf->currsector;
       readwrite.buffer = (uint8_t *) &buffer[byteswritten];
@@ -873,10 +1043,9 @@ static ssize_t smartfs_write(FAR struct file *filep, const char *buffer,
         {
           /* First get a new chained sector */
 
-          ret = FS_IOCTL(fs, BIOC_ALLOCSECT, 0xFFFF);
+          ret = smartfs_nextsector(fs, &reserve, buflen);
           if (ret < 0)
             {
-              fdbg("Error %d allocating new sector\n", ret);
               goto errout_with_semaphore;
             }
 
@@ -912,7 +1081,7 @@ static ssize_t smartfs_write(FAR struct file *filep, const char *buffer,
         }
 #else  /* CONFIG_SMARTFS_USE_SECTOR_BUFFER */
 
-      if (sf->curroffset == fs->fs_llformat.availbytes)
+      if (sf->curroffset == fs->fs_llformat.availbytes && buflen == 0)
         {
           /* Sync the file to write this sector out */
 
@@ -921,49 +1090,74 @@ static ssize_t smartfs_write(FAR struct file *filep, const char *buffer,
             {
               goto errout_with_semaphore;
             }
+        }
+      else if (sf->curroffset == fs->fs_llformat.availbytes)
+        {
+          /* Get the next sector to chain to this one */
+
+          ret = smartfs_nextsector(fs, &reserve, buflen);
+          if (ret < 0)
+            {
+              goto errout_with_semaphore;
+            }
+
+          nextsector = (uint16_t) ret;
 
-          /* Allocate a new sector if needed */
+          /* Read the existing sector header */
 
-          if (buflen > 0)
+          readwrite.logsector = sf->currsector;
+          readwrite.offset = 0;
+          readwrite.buffer = (uint8_t *) fs->fs_rwbuffer;
+          readwrite.count = sizeof(struct smartfs_chain_header_s);
+          header = (struct smartfs_chain_header_s *) fs->fs_rwbuffer;
+          ret = FS_IOCTL(fs, BIOC_READSECT, (unsigned long) &readwrite);
+          if (ret < 0)
             {
-              /* Allocate a new sector */
+              fdbg("Error %d reading sector %d data\n", ret, sf->currsector);
+              goto errout_with_semaphore;
+            }
 
-              ret = FS_IOCTL(fs, BIOC_ALLOCSECT, 0xFFFF);
-              if (ret < 0)
-                {
-                  fdbg("Error %d allocating new sector\n", ret);
-                  goto errout_with_semaphore;
-                }
+          /* Record the used bytes and the chained sector together with
+           * a single write.
+           */
 
-              /* Copy the new sector to the old one and chain it */
+          *((uint16_t *) header->nextsector) = nextsector;
+          if (SMARTFS_USED(header) == SMARTFS_ERASEDSTATE_16BIT)
+            {
+              *((uint16_t *) header->used) = sf->byteswritten;
+            }
+          else
+            {
+              *((uint16_t *) header->used) += sf->byteswritten;
+            }
 
-              header = (struct smartfs_chain_header_s *) fs->fs_rwbuffer;
-              *((uint16_t *) header->nextsector) = (uint16_t) ret;
-              readwrite.offset = offsetof(struct smartfs_chain_header_s,
-                nextsector);
-              readwrite.buffer = (uint8_t *) header->nextsector;
-              readwrite.count = sizeof(uint16_t);
-              ret = FS_IOCTL(fs, BIOC_WRITESECT, (unsigned long) &readwrite);
-              if (ret < 0)
-                {
-                  fdbg("Error %d writing next sector\n", ret);
-                  goto errout_with_semaphore;
-                }
+          readwrite.offset = offsetof(struct smartfs_chain_header_s,
+            nextsector);
+          readwrite.count = offsetof(struct smartfs_chain_header_s, used) +
+            sizeof(header->used) - readwrite.offset;
+          readwrite.buffer = (uint8_t *) &fs->fs_rwbuffer[readwrite.offset];
+          ret = FS_IOCTL(fs, BIOC_WRITESECT, (unsigned long) &readwrite);
+          if (ret < 0)
+            {
+              fdbg("Error %d writing next sector\n", ret);
+              goto errout_with_semaphore;
+            }
 
-              /* Record the new sector in our tracking variables and
-               * reset the offset to "zero".
-               */
+          sf->byteswritten = 0;
 
-              if (sf->currsector == SMARTFS_NEXTSECTOR(header))
-                {
-                  /* Error allocating logical sector! */
+          /* Record the new sector in our tracking variables and
+           * reset the offset to "zero".
+           */
 
-                  fdbg("Error - duplicate logical sector %d\n", sf->currsector);
-                }
+          if (sf->currsector == nextsector)
+            {
+              /* Error allocating logical sector! */
 
-              sf->currsector = SMARTFS_NEXTSECTOR(header);
-              sf->curroffset = sizeof(struct smartfs_chain_header_s);
+              fdbg("Error - duplicate logical sector %d\n", sf->currsector);
             }
+
+          sf->currsector = nextsector;
+          sf->curroffset = sizeof(struct smartfs_chain_header_s);
         }
 #endif  /* CONFIG_SMARTFS_USE_SECTOR_BUFFER */
     }
@@ -971,6 +1165,7 @@ static ssize_t smartfs_write(FAR struct file *filep, const char *buffer,
   ret = byteswritten;
 
 errout_with_semaphore:
+  smartfs_releasereserve(fs, &reserve);
   smartfs_semgive(fs);
   return ret;
 }
@@ -1261,7 +1456,9 @@ static int smartfs_opendir(struct inode *mountpt, const char *relpath, struct fs
 
   fs = mountpt->i_private;
 
-  /* Take the semaphore */
+  /* Take the semaphore.  It is taken exclusively since the count of open
+   * directories is updated.
+   */
 
   smartfs_semtake(fs);
 
@@ -1281,6 +1478,9 @@ static int smartfs_opendir(struct inode *mountpt, const char *relpath, struct fs
   dir->u.smartfs.fs_currsector = entry.firstsector;
   dir->u.smartfs.fs_curroffset = sizeof(struct smartfs_chain_header_s);
 
+  /* Directories are not compacted while this is open */
+
+  fs->fs_opendirs++;
   ret = OK;
 
 errout_with_semaphore:
@@ -1296,6 +1496,33 @@ errout_with_semaphore:
   return ret;
 }
 
+/****************************************************************************
+ * Name: smartfs_closedir
+ *
+ * Description: Close a directory opened with smartfs_opendir
+ *
+ ****************************************************************************/
+
+static int smartfs_closedir(struct inode *mountpt, struct fs_dirent_s *dir)
+{
+  struct smartfs_mountpt_s *fs;
+
+  /* Sanity checks */
+
+  DEBUGASSERT(mountpt != NULL && mountpt->i_private != NULL);
+
+  /* Recover our private data from the inode instance */
+
+  fs = mountpt->i_private;
+
+  smartfs_semtake(fs);
+  DEBUGASSERT(fs->fs_opendirs > 0);
+  fs->fs_opendirs--;
+  smartfs_semgive(fs);
+
+  return OK;
+}
+
 /****************************************************************************
  * Name: smartfs_readdir
  *
@@ -1312,6 +1539,7 @@ static int smartfs_readdir(struct inode *mountpt, struct fs_dirent_s *dir)
   struct                smartfs_chain_header_s *header;
   struct                smart_read_write_s readwrite;
   struct                smartfs_entry_header_s *entry;
+  char                 *buffer;
 
   /* Sanity checks */
 
@@ -1321,9 +1549,16 @@ static int smartfs_readdir(struct inode *mountpt, struct fs_dirent_s *dir)
 
   fs = mountpt->i_private;
 
-  /* Take the semaphore */
+  /* Take the semaphore shared */
 
-  smartfs_semtake(fs);
+  smartfs_rdlock(fs);
+
+  buffer = smartfs_scratchbuffer(fs);
+  if (buffer == NULL)
+    {
+      ret = -ENOMEM;
+      goto errout_with_semaphore;
+    }
 
   /* Read sectors and search entries until one found or no more */
 
@@ -1335,7 +1570,7 @@ static int smartfs_readdir(struct inode *mountpt, struct fs_dirent_s *dir)
 
       readwrite.logsector = dir->u.smartfs.fs_currsector;
       readwrite.count = fs->fs_llformat.availbytes;
-      readwrite.buffer = (uint8_t *)fs->fs_rwbuffer;
+      readwrite.buffer = (uint8_t *)buffer;
       readwrite.offset = 0;
       ret = FS_IOCTL(fs, BIOC_READSECT, (unsigned long) &readwrite);
       if (ret < 0)
@@ -1349,7 +1584,7 @@ static int smartfs_readdir(struct inode *mountpt, struct fs_dirent_s *dir)
         {
           /* Point to next entry */
 
-          entry = (struct smartfs_entry_header_s *) &fs->fs_rwbuffer[
+          entry = (struct smartfs_entry_header_s *) &buffer[
             dir->u.smartfs.fs_curroffset];
 
           /* Test if this entry is valid and active */
@@ -1363,7 +1598,7 @@ static int smartfs_readdir(struct inode *mountpt, struct fs_dirent_s *dir)
 
               dir->u.smartfs.fs_curroffset += entrysize;
               entry = (struct smartfs_entry_header_s *)
-                &fs->fs_rwbuffer[dir->u.smartfs.fs_curroffset];
+                &buffer[dir->u.smartfs.fs_curroffset];
 
               continue;
             }
@@ -1398,7 +1633,7 @@ static int smartfs_readdir(struct inode *mountpt, struct fs_dirent_s *dir)
               /* We advanced past the end of the sector.  Go to next sector */
 
               dir->u.smartfs.fs_curroffset = sizeof(struct smartfs_chain_header_s);
-              header = (struct smartfs_chain_header_s *) fs->fs_rwbuffer;
+              header = (struct smartfs_chain_header_s *) buffer;
               dir->u.smartfs.fs_currsector = SMARTFS_NEXTSECTOR(header);
             }
 
@@ -1413,7 +1648,7 @@ static int smartfs_readdir(struct inode *mountpt, struct fs_dirent_s *dir)
        * done and will report ENOENT.
        */
 
-      header = (struct smartfs_chain_header_s *) fs->fs_rwbuffer;
+      header = (struct smartfs_chain_header_s *) buffer;
       dir->u.smartfs.fs_curroffset = sizeof(struct smartfs_chain_header_s);
       dir->u.smartfs.fs_currsector = SMARTFS_NEXTSECTOR(header);
     }
@@ -1488,21 +1723,10 @@ static int smartfs_bind(FAR struct inode *blkdriver, const void *data,
       return -ENOMEM;
     }
 
-  /* If the global semaphore hasn't been initialized, then
-   * initialized it now. */
-
-  fs->fs_sem = &g_sem;
-  if (!g_seminitialized)
-    {
-      sem_init(&g_sem, 0, 0);   /* Initialize the semaphore that controls access */
-      g_seminitialized = TRUE;
-    }
-  else
-    {
-      /* Take the semaphore for the mount */
+  /* Take the lock for the mount */
 
-      smartfs_semtake(fs);
-    }
+  fs->fs_lock = &g_lock;
+  smartfs_semtake(fs);
 
   /* Initialize the allocated mountpt state structure.  The filesystem is
    * responsible for one reference ont the blkdriver inode and does not
@@ -1517,8 +1741,8 @@ static int smartfs_bind(FAR struct inode *blkdriver, const void *data,
   ret = smartfs_mount(fs, true);
   if (ret != 0)
     {
-      kmm_free(fs);
       smartfs_semgive(fs);
+      kmm_free(fs);
       return ret;
     }
 
@@ -1874,6 +2098,7 @@ int smartfs_rename(struct inode *mountpt, const char *oldrelpath,
   uint16_t                  entrysize;
   struct smartfs_entry_header_s *direntry;
   struct smart_read_write_s readwrite;
+  struct smartfs_ofile_s   *sf;
 
   /* Sanity checks */
 
@@ -1889,8 +2114,8 @@ int smartfs_rename(struct inode *mountpt, const char *oldrelpath,
 
   oldentry.name = NULL;
   newentry.name = NULL;
-  ret = smartfs_finddirentry(fs, &oldentry, oldrelpath, &oldparentdirsector,
-          &oldfilename);
+  ret = smartfs_lookupentry(fs, &oldentry, oldrelpath, &oldparentdirsector,
+          &oldfilename, false);
   if (ret < 0)
     {
       goto errout_with_semaphore;
@@ -1905,8 +2130,8 @@ int smartfs_rename(struct inode *mountpt, const char *oldrelpath,
    * doens't exsit.
    */
 
-  ret = smartfs_finddirentry(fs, &newentry, newrelpath, &newparentdirsector,
-          &newfilename);
+  ret = smartfs_lookupentry(fs, &newentry, newrelpath, &newparentdirsector,
+          &newfilename, false);
   if (ret == OK)
     {
       /* Test if it's a file.  If it is, then it's an error */
@@ -1981,14 +2206,57 @@ int smartfs_rename(struct inode *mountpt, const char *oldrelpath,
 
   /* Test if the new parent directory is valid */
 
-  if (newparentdirsector != 0xFFFF)
+  if (newparentdirsector == oldparentdirsector)
+    {
+      /* Renaming within the same directory.  Just replace the name in the
+       * existing entry, which the SMART layer does with a single sector
+       * write, so the entry is never missing or duplicated.
+       */
+
+      if (strlen(newfilename) > fs->fs_llformat.namesize)
+        {
+          ret = -ENAMETOOLONG;
+          goto errout_with_semaphore;
+        }
+
+      readwrite.logsector = oldentry.dsector;
+      readwrite.offset = 0;
+      readwrite.count = fs->fs_llformat.availbytes;
+      readwrite.buffer = (uint8_t *) fs->fs_rwbuffer;
+      ret = FS_IOCTL(fs, BIOC_READSECT, (unsigned long) &readwrite);
+      if (ret < 0)
+        {
+          fdbg("Error %d reading sector %d data\n", ret, oldentry.dsector);
+          goto errout_with_semaphore;
+        }
+
+      direntry = (struct smartfs_entry_header_s *) &fs->fs_rwbuffer[oldentry.doffset];
+      memset(direntry->name, 0, fs->fs_llformat.namesize);
+      strncpy(direntry->name, newfilename, fs->fs_llformat.namesize);
+
+      readwrite.offset = oldentry.doffset +
+        offsetof(struct smartfs_entry_header_s, name);
+      readwrite.count = fs->fs_llformat.namesize;
+      readwrite.buffer = (uint8_t *) direntry->name;
+      ret = FS_IOCTL(fs, BIOC_WRITESECT, (unsigned long) &readwrite);
+      if (ret < 0)
+        {
+          fdbg("Error %d writing name for sector %d\n", ret, oldentry.dsector);
+          goto errout_with_semaphore;
+        }
+
+      newentry.dsector = oldentry.dsector;
+      newentry.doffset = oldentry.doffset;
+    }
+  else if (newparentdirsector != 0xFFFF)
     {
       /* We can move to the given parent directory */
 
       mode = oldentry.flags & SMARTFS_DIRENT_MODE;
       type = oldentry.flags & SMARTFS_DIRENT_TYPE;
       ret = smartfs_createentry(fs, newparentdirsector, newfilename, type,
-                                mode, 0, &newentry, oldentry.firstsector, NULL);
+                                mode, oldentry.utc, &newentry,
+                                oldentry.firstsector, NULL);
       if (ret != OK)
         {
           goto errout_with_semaphore;
@@ -1997,8 +2265,8 @@ int smartfs_rename(struct inode *mountpt, const char *oldrelpath,
       /* Now mark the old entry as inactive */
 
       readwrite.logsector = oldentry.dsector;
-      readwrite.offset = 0;
-      readwrite.count = fs->fs_llformat.availbytes;
+      readwrite.offset = oldentry.doffset;
+      readwrite.count = sizeof(direntry->flags);
       readwrite.buffer = (uint8_t *) fs->fs_rwbuffer;
       ret = FS_IOCTL(fs, BIOC_READSECT, (unsigned long) &readwrite);
       if (ret < 0)
@@ -2007,7 +2275,7 @@ int smartfs_rename(struct inode *mountpt, const char *oldrelpath,
           goto errout_with_semaphore;
         }
 
-      direntry = (struct smartfs_entry_header_s *) &fs->fs_rwbuffer[oldentry.doffset];
+      direntry = (struct smartfs_entry_header_s *) fs->fs_rwbuffer;
 #if CONFIG_SMARTFS_ERASEDSTATE == 0xFF
       direntry->flags &= ~SMARTFS_DIRENT_ACTIVE;
 #else
@@ -2016,9 +2284,6 @@ int smartfs_rename(struct inode *mountpt, const char *oldrelpath,
 
       /* Now write the updated flags back to the device */
 
-      readwrite.offset = oldentry.doffset;
-      readwrite.count = sizeof(direntry->flags);
-      readwrite.buffer = (uint8_t *) &direntry->flags;
       ret = FS_IOCTL(fs, BIOC_WRITESECT, (unsigned long) &readwrite);
       if (ret < 0)
         {
@@ -2034,6 +2299,23 @@ int smartfs_rename(struct inode *mountpt, const char *oldrelpath,
       goto errout_with_semaphore;
     }
 
+  /* Any open files for the entry now have a new name and location */
+
+  for (sf = fs->fs_head; sf != NULL; sf = sf->fnext)
+    {
+      if (sf->entry.firstsector == oldentry.firstsector)
+        {
+          sf->entry.dsector = newentry.dsector;
+          sf->entry.doffset = newentry.doffset;
+          sf->entry.dfirst = newparentdirsector;
+          if (sf->entry.name != NULL)
+            {
+              memset(sf->entry.name, 0, fs->fs_llformat.namesize + 1);
+              strncpy(sf->entry.name, newfilename, fs->fs_llformat.namesize);
+            }
+        }
+    }
+
   ret = OK;
 
 errout_with_semaphore:
@@ -2076,7 +2358,7 @@ static int smartfs_stat(struct inode *mountpt, const char *relpath, struct stat
 
   fs = mountpt->i_private;
 
-  smartfs_semtake(fs);
+  smartfs_rdlock(fs);
 
   /* Find the directory entry corresponding to relpath */
 
@@ -46,6 +46,7 @@
 #include <string.h>
 #include <time.h>
 #include <semaphore.h>
+#include <pthread.h>
 #include <assert.h>
 #include <errno.h>
 #include <debug.h>
@@ -60,14 +61,36 @@
  * Pre-processor Definitions
  ****************************************************************************/
 
+/* Number of chain sectors collected before they are released together */
+
+#define SMARTFS_RELEASE_BATCH   64
+
 /****************************************************************************
  * Private Types
  ****************************************************************************/
 
+/* Per-thread sector buffer used by operations running under the shared
+ * mount lock, where the mount's fs_rwbuffer cannot be used.
+ */
+
+struct smartfs_scratch_s
+{
+  uint16_t                  size;       /* Usable bytes in buffer */
+  char                      buffer[1];  /* Sector data */
+};
+
 /****************************************************************************
  * Private Function Prototypes
  ****************************************************************************/
 
+static void smartfs_scratchfree(FAR void *scratch);
+static void smartfs_scratchinit(void);
+static int smartfs_releasechain(struct smartfs_mountpt_s *fs,
+        uint16_t sector);
+static int smartfs_scandir(struct smartfs_mountpt_s *fs,
+        uint16_t dirsector, uint16_t *nsectors, uint16_t *nentries,
+        uint16_t *sectors, uint8_t *entries);
+
 /****************************************************************************
  * Private Variables
  ****************************************************************************/
@@ -77,6 +100,9 @@
 static struct smartfs_mountpt_s *g_mounthead = NULL;
 #endif
 
+static pthread_key_t  g_scratchkey;
+static pthread_once_t g_scratchonce = PTHREAD_ONCE_INIT;
+
 /****************************************************************************
  * Public Data
  ****************************************************************************/
@@ -85,6 +111,186 @@ static struct smartfs_mountpt_s *g_mounthead = NULL;
  * Private Functions
  ****************************************************************************/
 
+/****************************************************************************
+ * Name: smartfs_scratchfree
+ *
+ * Description: Thread-specific key destructor.  Frees the scratch buffer
+ *              of a thread when it exits.
+ *
+ ****************************************************************************/
+
+static void smartfs_scratchfree(FAR void *scratch)
+{
+  kmm_free(scratch);
+}
+
+/****************************************************************************
+ * Name: smartfs_scratchinit
+ *
+ * Description: Creates the thread-specific key for the scratch buffers.
+ *
+ ****************************************************************************/
+
+static void smartfs_scratchinit(void)
+{
+  (void)pthread_key_create(&g_scratchkey, smartfs_scratchfree);
+}
+
+/****************************************************************************
+ * Name: smartfs_releasechain
+ *
+ * Description: Releases every sector in the chain starting at the given
+ *              sector.  The chain is walked collecting sector numbers which
+ *              are handed to the SMART layer in batches with BIOC_FREESECTS
+ *              so sectors sharing an erase block are released together.
+ *
+ ****************************************************************************/
+
+static int smartfs_releasechain(struct smartfs_mountpt_s *fs,
+        uint16_t sector)
+{
+  struct smartfs_chain_header_s  *header;
+  struct smart_read_write_s       readwrite;
+  struct smart_freesects_s        release;
+  uint16_t                        sectors[SMARTFS_RELEASE_BATCH];
+  int                             ret = OK;
+  int                             result;
+
+  header = (struct smartfs_chain_header_s *) fs->fs_rwbuffer;
+  readwrite.offset = 0;
+  readwrite.count = sizeof(struct smartfs_chain_header_s);
+  readwrite.buffer = (uint8_t *) fs->fs_rwbuffer;
+  release.count = 0;
+  release.sectors = sectors;
+
+  while (sector != SMARTFS_ERASEDSTATE_16BIT)
+    {
+      /* Read the sector header to find the next sector in the chain */
+
+      readwrite.logsector = sector;
+      ret = FS_IOCTL(fs, BIOC_READSECT, (unsigned long) &readwrite);
+      if (ret < 0)
+        {
+          fdbg("Error reading sector %d header\n", sector);
+          break;
+        }
+
+      sectors[release.count++] = sector;
+      sector = SMARTFS_NEXTSECTOR(header);
+
+      /* Release the batch once it is full */
+
+      if (release.count == SMARTFS_RELEASE_BATCH)
+        {
+          result = FS_IOCTL(fs, BIOC_FREESECTS, (unsigned long) &release);
+          if (result < 0)
+            {
+              fdbg("Error %d freeing sectors\n", result);
+              ret = result;
+            }
+
+          release.count = 0;
+        }
+    }
+
+  /* Release whatever is left over */
+
+  if (release.count > 0)
+    {
+      result = FS_IOCTL(fs, BIOC_FREESECTS, (unsigned long) &release);
+      if (result < 0)
+        {
+          fdbg("Error %d freeing sectors\n", result);
+          ret = result;
+        }
+    }
+
+  return ret < 0 ? ret : OK;
+}
+
+/****************************************************************************
+ * Name: smartfs_scandir
+ *
+ * Description: Walks a directory's sector chain counting its sectors and
+ *              active entries.  If the sectors and entries buffers are
+ *              given, the chain's sector numbers and a copy of each active
+ *              entry are saved as well.
+ *
+ ****************************************************************************/
+
+static int smartfs_scandir(struct smartfs_mountpt_s *fs,
+        uint16_t dirsector, uint16_t *nsectors, uint16_t *nentries,
+        uint16_t *sectors, uint8_t *entries)
+{
+  struct smartfs_chain_header_s  *header;
+  struct smartfs_entry_header_s  *direntry;
+  struct smart_read_write_s       readwrite;
+  uint16_t                        entrysize;
+  uint16_t                        offset;
+  int                             ret;
+
+  *nsectors = 0;
+  *nentries = 0;
+  entrysize = sizeof(struct smartfs_entry_header_s) + fs->fs_llformat.namesize;
+  header = (struct smartfs_chain_header_s *) fs->fs_rwbuffer;
+
+  while (dirsector != SMARTFS_ERASEDSTATE_16BIT)
+    {
+      /* Read the next sector of the directory */
+
+      readwrite.logsector = dirsector;
+      readwrite.offset = 0;
+      readwrite.count = fs->fs_llformat.availbytes;
+      readwrite.buffer = (uint8_t *) fs->fs_rwbuffer;
+      ret = FS_IOCTL(fs, BIOC_READSECT, (unsigned long) &readwrite);
+      if (ret < 0)
+        {
+          fdbg("Error reading sector %d\n", dirsector);
+          return ret;
+        }
+
+      if (sectors != NULL)
+        {
+          sectors[*nsectors] = dirsector;
+        }
+
+      (*nsectors)++;
+
+      /* Find the active entries in this sector */
+
+      offset = sizeof(struct smartfs_chain_header_s);
+      while (offset + entrysize < fs->fs_llformat.availbytes)
+        {
+          direntry = (struct smartfs_entry_header_s *) &fs->fs_rwbuffer[offset];
+#ifdef CONFIG_SMARTFS_ALIGNED_ACCESS
+          if (((smartfs_rdle16(&direntry->flags) & SMARTFS_DIRENT_EMPTY) !=
+              (SMARTFS_ERASEDSTATE_16BIT & SMARTFS_DIRENT_EMPTY)) &&
+              ((smartfs_rdle16(&direntry->flags) & SMARTFS_DIRENT_ACTIVE) ==
+              (SMARTFS_ERASEDSTATE_16BIT & SMARTFS_DIRENT_ACTIVE)))
+#else
+          if (((direntry->flags & SMARTFS_DIRENT_EMPTY) !=
+              (SMARTFS_ERASEDSTATE_16BIT & SMARTFS_DIRENT_EMPTY)) &&
+              ((direntry->flags & SMARTFS_DIRENT_ACTIVE) ==
+              (SMARTFS_ERASEDSTATE_16BIT & SMARTFS_DIRENT_ACTIVE)))
+#endif
+            {
+              if (entries != NULL)
+                {
+                  memcpy(&entries[*nentries * entrysize], direntry, entrysize);
+                }
+
+              (*nentries)++;
+            }
+
+          offset += entrysize;
+        }
+
+      dirsector = SMARTFS_NEXTSECTOR(header);
+    }
+
+  return OK;
+}
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -95,16 +301,23 @@ static struct smartfs_mountpt_s *g_mounthead = NULL;
 
 void smartfs_semtake(struct smartfs_mountpt_s *fs)
 {
-  /* Take the semaphore (perhaps waiting) */
+  /* Take the mount lock exclusively (perhaps waiting) */
 
-  while (sem_wait(fs->fs_sem) != 0)
-    {
-      /* The only case that an error should occur here is if
-       * the wait was awakened by a signal.
-       */
+  (void)pthread_rwlock_wrlock(fs->fs_lock);
+}
 
-      DEBUGASSERT(*get_errno_ptr() == EINTR);
-    }
+/****************************************************************************
+ * Name: smartfs_rdlock
+ *
+ * Description: Take the mount lock shared.  Any number of readers may hold
+ *   it at once; the caller must not touch fs_rwbuffer or fs_workbuffer and
+ *   must use smartfs_scratchbuffer() instead.
+ *
+ ****************************************************************************/
+
+void smartfs_rdlock(struct smartfs_mountpt_s *fs)
+{
+  (void)pthread_rwlock_rdlock(fs->fs_lock);
 }
 
 /****************************************************************************
@@ -113,7 +326,42 @@ void smartfs_semtake(struct smartfs_mountpt_s *fs)
 
 void smartfs_semgive(struct smartfs_mountpt_s *fs)
 {
-   sem_post(fs->fs_sem);
+  (void)pthread_rwlock_unlock(fs->fs_lock);
+}
+
+/****************************************************************************
+ * Name: smartfs_scratchbuffer
+ *
+ * Description: Returns the calling thread's sector buffer, large enough to
+ *   hold one sector of the given mount.  The buffer is allocated on first
+ *   use and grown if a mount with larger sectors is accessed.  Returns NULL
+ *   if the allocation fails.
+ *
+ ****************************************************************************/
+
+FAR char *smartfs_scratchbuffer(struct smartfs_mountpt_s *fs)
+{
+  struct smartfs_scratch_s *scratch;
+
+  (void)pthread_once(&g_scratchonce, smartfs_scratchinit);
+
+  scratch = (struct smartfs_scratch_s *) pthread_getspecific(g_scratchkey);
+  if (scratch == NULL || scratch->size < fs->fs_llformat.availbytes)
+    {
+      kmm_free(scratch);
+      scratch = (struct smartfs_scratch_s *) kmm_malloc(
+          sizeof(struct smartfs_scratch_s) + fs->fs_llformat.availbytes);
+      if (scratch == NULL)
+        {
+          (void)pthread_setspecific(g_scratchkey, NULL);
+          return NULL;
+        }
+
+      scratch->size = fs->fs_llformat.availbytes;
+      (void)pthread_setspecific(g_scratchkey, scratch);
+    }
+
+  return scratch->buffer;
 }
 
 /****************************************************************************
@@ -501,6 +749,23 @@ int smartfs_unmount(struct smartfs_mountpt_s *fs)
 int smartfs_finddirentry(struct smartfs_mountpt_s *fs,
         struct smartfs_entry_s *direntry, const char *relpath,
         uint16_t *parentdirsector, const char **filename)
+{
+  return smartfs_lookupentry(fs, direntry, relpath, parentdirsector,
+                             filename, true);
+}
+
+/****************************************************************************
+ * Name: smartfs_lookupentry
+ *
+ * Description: Same as smartfs_finddirentry, except the walk of a file's
+ *              sector chain to calculate its length is only done if
+ *              getlength is true.  Otherwise datlen is reported as zero.
+ *
+ ****************************************************************************/
+
+int smartfs_lookupentry(struct smartfs_mountpt_s *fs,
+        struct smartfs_entry_s *direntry, const char *relpath,
+        uint16_t *parentdirsector, const char **filename, bool getlength)
 {
   int ret = -ENOENT;
   const char *segment;
@@ -514,6 +779,7 @@ int smartfs_finddirentry(struct smartfs_mountpt_s *fs,
   struct      smartfs_chain_header_s *header;
   struct      smart_read_write_s readwrite;
   struct      smartfs_entry_header_s *entry;
+  char       *buffer;
 
   /* Initialize directory level zero as the root sector */
 
@@ -537,6 +803,16 @@ int smartfs_finddirentry(struct smartfs_mountpt_s *fs,
       return OK;
     }
 
+  /* Directory sectors are read into the per-thread scratch buffer so that
+   * lookups may run concurrently under the shared mount lock.
+   */
+
+  buffer = smartfs_scratchbuffer(fs);
+  if (buffer == NULL)
+    {
+      return -ENOMEM;
+    }
+
   /* Parse through each segment of relpath */
 
   segment = relpath;
@@ -552,12 +828,9 @@ int smartfs_finddirentry(struct smartfs_mountpt_s *fs,
           ptr++;
         }
 
-      strncpy(fs->fs_workbuffer, segment, seglen);
-      fs->fs_workbuffer[seglen] = '\0';
-
       /* Search for "." and ".." as segment names */
 
-      if (strcmp(fs->fs_workbuffer, ".") == 0)
+      if (seglen == 1 && segment[0] == '.')
         {
           /* Just ignore this segment.  Advance ptr if not on NULL */
 
@@ -569,7 +842,7 @@ int smartfs_finddirentry(struct smartfs_mountpt_s *fs,
           segment = ptr;
           continue;
         }
-      else if (strcmp(fs->fs_workbuffer, "..") == 0)
+      else if (seglen == 2 && segment[0] == '.' && segment[1] == '.')
         {
           /* Up one level */
 
@@ -611,7 +884,7 @@ int smartfs_finddirentry(struct smartfs_mountpt_s *fs,
 
               readwrite.logsector = dirsector;
               readwrite.count = fs->fs_llformat.availbytes;
-              readwrite.buffer = (uint8_t *)fs->fs_rwbuffer;
+              readwrite.buffer = (uint8_t *)buffer;
               readwrite.offset = 0;
               ret = FS_IOCTL(fs, BIOC_READSECT, (unsigned long) &readwrite);
               if (ret < 0)
@@ -621,13 +894,13 @@ int smartfs_finddirentry(struct smartfs_mountpt_s *fs,
 
               /* Point to next sector in chain */
 
-              header = (struct smartfs_chain_header_s *) fs->fs_rwbuffer;
+              header = (struct smartfs_chain_header_s *) buffer;
               dirsector = SMARTFS_NEXTSECTOR(header);
 
               /* Search for the entry */
 
               offset = sizeof(struct smartfs_chain_header_s);
-              entry = (struct smartfs_entry_header_s *) &fs->fs_rwbuffer[offset];
+              entry = (struct smartfs_entry_header_s *) &buffer[offset];
               while (offset < readwrite.count)
                 {
                   /* Test if this entry is valid and active */
@@ -648,15 +921,20 @@ int smartfs_finddirentry(struct smartfs_mountpt_s *fs,
 
                       offset += entrysize;
                       entry = (struct smartfs_entry_header_s *)
-                        &fs->fs_rwbuffer[offset];
+                        &buffer[offset];
 
                       continue;
                     }
 
-                  /* Test if the name matches */
+                  /* Test if the name matches.  Segments longer than the
+                   * name field match on the stored prefix.
+                   */
 
-                  if (strncmp(entry->name, fs->fs_workbuffer,
-                      fs->fs_llformat.namesize) == 0)
+                  if (seglen >= fs->fs_llformat.namesize ?
+                      strncmp(entry->name, segment,
+                              fs->fs_llformat.namesize) == 0 :
+                      strncmp(entry->name, segment, seglen) == 0 &&
+                      entry->name[seglen] == '\0')
                     {
                       /* We found it!  If this is the last segment entry,
                        * then report the entry.  If it isn't the last
@@ -696,18 +974,20 @@ int smartfs_finddirentry(struct smartfs_mountpt_s *fs,
                            */
 
 #ifdef CONFIG_SMARTFS_ALIGNED_ACCESS
-                          if ((smartfs_rdle16(&entry->flags) & SMARTFS_DIRENT_TYPE) ==
+                          if (getlength &&
+                              (smartfs_rdle16(&entry->flags) & SMARTFS_DIRENT_TYPE) ==
                               SMARTFS_DIRENT_TYPE_FILE)
                             {
                               dirsector = smartfs_rdle16(&entry->firstsector);
 #else
-                          if ((entry->flags & SMARTFS_DIRENT_TYPE) ==
+                          if (getlength &&
+                              (entry->flags & SMARTFS_DIRENT_TYPE) ==
                               SMARTFS_DIRENT_TYPE_FILE)
                             {
                               dirsector = entry->firstsector;
 #endif
                               readwrite.count = sizeof(struct smartfs_chain_header_s);
-                              readwrite.buffer = (uint8_t *)fs->fs_rwbuffer;
+                              readwrite.buffer = (uint8_t *)buffer;
                               readwrite.offset = 0;
 
                               while (dirsector != SMARTFS_ERASEDSTATE_16BIT)
@@ -780,7 +1060,7 @@ int smartfs_finddirentry(struct smartfs_mountpt_s *fs,
 
                   offset += entrysize;
                   entry = (struct smartfs_entry_header_s *)
-                    &fs->fs_rwbuffer[offset];
+                    &buffer[offset];
                 }
 
               /* Test if a directory entry was found and break if it was */
@@ -1082,6 +1362,7 @@ int smartfs_createentry(FAR struct smartfs_mountpt_s *fs,
   direntry->firstsector = nextsector;
   direntry->dsector = psector;
   direntry->doffset = offset;
+  direntry->dfirst = parentdirsector;
 #ifdef CONFIG_SMARTFS_ALIGNED_ACCESS
   direntry->flags = smartfs_rdle16(&entry->flags);
   direntry->utc = smartfs_rdle32(&entry->utc);
@@ -1122,6 +1403,7 @@ int smartfs_deleteentry(struct smartfs_mountpt_s *fs,
   uint16_t                        nextsector;
   uint16_t                        sector;
   uint16_t                        count;
+  uint16_t                        slots;
   uint16_t                        entrysize;
   uint16_t                        offset;
   struct smartfs_entry_header_s  *direntry;
@@ -1141,28 +1423,11 @@ int smartfs_deleteentry(struct smartfs_mountpt_s *fs,
    *        bytes of the buffer to read in header info.
    */
 
-  nextsector = entry->firstsector;
-  header = (struct smartfs_chain_header_s *) fs->fs_rwbuffer;
-  readwrite.offset = 0;
-  readwrite.count = sizeof(struct smartfs_chain_header_s);
-  readwrite.buffer = (uint8_t *) fs->fs_rwbuffer;
-  while (nextsector != SMARTFS_ERASEDSTATE_16BIT)
+  ret = smartfs_releasechain(fs, entry->firstsector);
+  if (ret < 0)
     {
-      /* Read the next sector into our buffer */
-
-      sector = nextsector;
-      readwrite.logsector = sector;
-      ret = FS_IOCTL(fs, BIOC_READSECT, (unsigned long) &readwrite);
-      if (ret < 0)
-        {
-          fdbg("Error reading sector %d\n", nextsector);
-          break;
-        }
-
-      /* Release this sector */
-
-      nextsector = SMARTFS_NEXTSECTOR(header);
-      ret = FS_IOCTL(fs, BIOC_FREESECT, sector);
+      fdbg("Error %d releasing sectors from %d\n", ret, entry->firstsector);
+      goto errout;
     }
 
   /* Remove the entry from the directory tree */
@@ -1178,6 +1443,8 @@ int smartfs_deleteentry(struct smartfs_mountpt_s *fs,
       goto errout;
     }
 
+  header = (struct smartfs_chain_header_s *) fs->fs_rwbuffer;
+
   /* Mark this entry as inactive */
 
   direntry = (struct smartfs_entry_header_s *) &fs->fs_rwbuffer[entry->doffset];
@@ -1215,10 +1482,13 @@ int smartfs_deleteentry(struct smartfs_mountpt_s *fs,
       /* Scan the sector and count used entries */
 
       count = 0;
+      slots = 0;
       offset = sizeof(struct smartfs_chain_header_s);
       entrysize = sizeof(struct smartfs_entry_header_s) + fs->fs_llformat.namesize;
       while (offset + entrysize < fs->fs_llformat.availbytes)
         {
+          slots++;
+
           /* Test the next entry */
 
           direntry = (struct smartfs_entry_header_s *) &fs->fs_rwbuffer[offset];
@@ -1308,6 +1578,21 @@ int smartfs_deleteentry(struct smartfs_mountpt_s *fs,
               sector = SMARTFS_NEXTSECTOR(header);
             }
         }
+      else if (count * 2 < slots && (count + 1) * 2 >= slots)
+        {
+          /* This delete left the sector mostly dead entries.  Try packing
+           * the directory to release sectors.  Only the delete crossing
+           * the half way mark tries, and the directory is only rewritten
+           * if that releases half its sectors, so a run of deletes does
+           * not rewrite it again and again.
+           */
+
+          ret = smartfs_compactdir(fs, entry->dfirst, true);
+          if (ret < 0 && ret != -EBUSY)
+            {
+              fdbg("Error %d compacting directory %d\n", ret, entry->dfirst);
+            }
+        }
     }
 
   ret = OK;
@@ -1316,6 +1601,263 @@ errout:
   return ret;
 }
 
+/****************************************************************************
+ * Name: smartfs_compactdir
+ *
+ * Description: Packs the active entries of a directory into as few sectors
+ *              as possible and releases the sectors left empty.  Nothing
+ *              is written unless at least one sector can be released, or
+ *              with lazy set, at least half of the directory's sectors.
+ *              The directory keeps its first sector, and open files with
+ *              entries in the directory are updated with their new entry
+ *              location.  With CONFIG_SMARTFS_SORTED_DIRS the entries are
+ *              written in name order.  Returns the number of sectors
+ *              released, or -EBUSY if a directory is open for reading.
+ *
+ *              The packed entries past the first sector's share are
+ *              written to newly allocated sectors.  The first sector is
+ *              then rewritten to point at them and only after that is the
+ *              old chain released, so a power loss leaves either the old
+ *              or the new directory, at worst with some lost sectors.
+ *
+ ****************************************************************************/
+
+int smartfs_compactdir(struct smartfs_mountpt_s *fs, uint16_t dirsector,
+        bool lazy)
+{
+  struct smartfs_chain_header_s  *header;
+  struct smartfs_entry_header_s  *direntry;
+  struct smart_read_write_s       readwrite;
+  struct smartfs_ofile_s         *sf;
+  uint16_t                       *sectors = NULL;
+  uint16_t                       *order = NULL;
+  uint8_t                        *entries = NULL;
+  uint16_t                        nsectors;
+  uint16_t                        nentries;
+  uint16_t                        entrysize;
+  uint16_t                        slots;
+  uint16_t                        needed;
+  uint16_t                        offset;
+  uint16_t                        firstsector;
+  uint16_t                        oldnext;
+  uint16_t                        nextsector;
+  uint16_t                        x;
+  uint16_t                        y;
+  int                             ret;
+
+  /* Entries are moved without fixing up open directories, so a readdir
+   * in progress would skip or repeat entries.
+   */
+
+  if (fs->fs_opendirs > 0)
+    {
+      return -EBUSY;
+    }
+
+  /* Calculate the number of entries that fit in a sector */
+
+  entrysize = sizeof(struct smartfs_entry_header_s) + fs->fs_llformat.namesize;
+  slots = 0;
+  for (offset = sizeof(struct smartfs_chain_header_s);
+       offset + entrysize < fs->fs_llformat.availbytes; offset += entrysize)
+    {
+      slots++;
+    }
+
+  /* Count the directory's sectors and entries and test if packing it
+   * would release enough.
+   */
+
+  ret = smartfs_scandir(fs, dirsector, &nsectors, &nentries, NULL, NULL);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  needed = (nentries + slots - 1) / slots;
+  if (needed == 0)
+    {
+      needed = 1;
+    }
+
+  if (needed >= nsectors || (lazy && needed * 2 > nsectors))
+    {
+      return 0;
+    }
+
+  /* Gather the chain and a copy of all active entries */
+
+  sectors = (uint16_t *) kmm_malloc(nsectors * sizeof(uint16_t));
+  order = (uint16_t *) kmm_malloc((nentries + 1) * sizeof(uint16_t));
+  entries = (uint8_t *) kmm_malloc(nentries * entrysize + 1);
+  if (sectors == NULL || order == NULL || entries == NULL)
+    {
+      ret = -ENOMEM;
+      goto errout;
+    }
+
+  ret = smartfs_scandir(fs, dirsector, &nsectors, &nentries, sectors, entries);
+  if (ret < 0)
+    {
+      goto errout;
+    }
+
+  /* Decide the order the entries are written in */
+
+  for (x = 0; x < nentries; x++)
+    {
+      order[x] = x;
+
+#ifdef CONFIG_SMARTFS_SORTED_DIRS
+      /* Insertion sort by name */
+
+      for (y = x; y > 0; y--)
+        {
+          if (strncmp(((struct smartfs_entry_header_s *)
+                       &entries[order[y - 1] * entrysize])->name,
+                      ((struct smartfs_entry_header_s *)
+                       &entries[order[y] * entrysize])->name,
+                      fs->fs_llformat.namesize) <= 0)
+            {
+              break;
+            }
+
+          order[y] = order[y - 1];
+          order[y - 1] = x;
+        }
+#endif
+    }
+
+  /* Write the new sectors last one first, so each is written complete
+   * with its chain pointer.  The slots of sectors[] past the first one
+   * are reused for the new sector numbers.
+   */
+
+  oldnext = sectors[1];
+  nextsector = SMARTFS_ERASEDSTATE_16BIT;
+  header = (struct smartfs_chain_header_s *) fs->fs_rwbuffer;
+  readwrite.offset = 0;
+  readwrite.buffer = (uint8_t *) fs->fs_rwbuffer;
+
+  for (x = needed; x-- > 0; )
+    {
+      memset(fs->fs_rwbuffer, CONFIG_SMARTFS_ERASEDSTATE, fs->fs_llformat.availbytes);
+
+      if (x == 0)
+        {
+          /* Keep the first sector's header, only its chain changes */
+
+          readwrite.logsector = dirsector;
+          readwrite.count = sizeof(struct smartfs_chain_header_s);
+          ret = FS_IOCTL(fs, BIOC_READSECT, (unsigned long) &readwrite);
+          if (ret < 0)
+            {
+              fdbg("Error reading sector %d header\n", dirsector);
+              goto errout_with_new;
+            }
+        }
+      else
+        {
+          ret = FS_IOCTL(fs, BIOC_ALLOCSECT, 0xFFFF);
+          if (ret < 0)
+            {
+              goto errout_with_new;
+            }
+
+          sectors[x] = (uint16_t) ret;
+          readwrite.logsector = sectors[x];
+          header->type = SMARTFS_SECTOR_TYPE_DIR;
+        }
+
+      *((uint16_t *) header->nextsector) = nextsector;
+
+      offset = sizeof(struct smartfs_chain_header_s);
+      for (y = x * slots; y < nentries && y < (x + 1) * slots; y++)
+        {
+          memcpy(&fs->fs_rwbuffer[offset], &entries[order[y] * entrysize],
+                 entrysize);
+          offset += entrysize;
+        }
+
+      readwrite.count = fs->fs_llformat.availbytes;
+      ret = FS_IOCTL(fs, BIOC_WRITESECT, (unsigned long) &readwrite);
+      if (ret < 0)
+        {
+          fdbg("Error writing sector %d\n", readwrite.logsector);
+          if (x > 0)
+            {
+              (void)FS_IOCTL(fs, BIOC_FREESECT, sectors[x]);
+            }
+
+          goto errout_with_new;
+        }
+
+      nextsector = readwrite.logsector;
+    }
+
+  /* The directory now uses the new chain.  Update any open file with an
+   * entry in it to the entry's new location.  sectors[0] is the first
+   * sector, which was kept.
+   */
+
+  for (y = 0; y < nentries; y++)
+    {
+      direntry = (struct smartfs_entry_header_s *) &entries[order[y] * entrysize];
+#ifdef CONFIG_SMARTFS_ALIGNED_ACCESS
+      firstsector = smartfs_rdle16(&direntry->firstsector);
+#else
+      firstsector = direntry->firstsector;
+#endif
+      for (sf = fs->fs_head; sf != NULL; sf = sf->fnext)
+        {
+          if (sf->entry.dfirst == dirsector &&
+              sf->entry.firstsector == firstsector)
+            {
+              sf->entry.dsector = sectors[y / slots];
+              sf->entry.doffset = sizeof(struct smartfs_chain_header_s) +
+                                  (y % slots) * entrysize;
+            }
+        }
+    }
+
+  /* Release the old chain past the first sector.  Its headers are intact. */
+
+  ret = smartfs_releasechain(fs, oldnext);
+  if (ret == OK)
+    {
+      ret = nsectors - needed;
+    }
+
+  goto errout;
+
+errout_with_new:
+
+  /* The old chain is still in use, drop the new sectors written so far */
+
+  for (x++; x < needed; x++)
+    {
+      (void)FS_IOCTL(fs, BIOC_FREESECT, sectors[x]);
+    }
+
+errout:
+  if (entries != NULL)
+    {
+      kmm_free(entries);
+    }
+
+  if (order != NULL)
+    {
+      kmm_free(order);
+    }
+
+  if (sectors != NULL)
+    {
+      kmm_free(sectors);
+    }
+
+  return ret;
+}
+
 /****************************************************************************
  * Name: smartfs_countdirentries
  *
@@ -1417,86 +1959,57 @@ int smartfs_truncatefile(struct smartfs_mountpt_s *fs,
 {
   int                             ret;
   uint16_t                        nextsector;
-  uint16_t                        sector;
   struct smartfs_chain_header_s  *header;
   struct smart_read_write_s       readwrite;
 
-  /* Walk through the directory's sectors and count entries */
+  /* Read the first sector's header to find the rest of the chain */
 
-  nextsector = entry->firstsector;
   header = (struct smartfs_chain_header_s *) fs->fs_rwbuffer;
-
-  while (nextsector != SMARTFS_ERASEDSTATE_16BIT)
+  readwrite.logsector = entry->firstsector;
+  readwrite.offset = 0;
+  readwrite.count = sizeof(struct smartfs_chain_header_s);
+  readwrite.buffer = (uint8_t *) fs->fs_rwbuffer;
+  ret = FS_IOCTL(fs, BIOC_READSECT, (unsigned long) &readwrite);
+  if (ret < 0)
     {
-      /* Read the next sector's header into our buffer */
-
-      readwrite.logsector = nextsector;
-      readwrite.offset = 0;
-      readwrite.count = sizeof(struct smartfs_chain_header_s);
-      readwrite.buffer = (uint8_t *) fs->fs_rwbuffer;
-      ret = FS_IOCTL(fs, BIOC_READSECT, (unsigned long) &readwrite);
-      if (ret < 0)
-        {
-          fdbg("Error reading sector %d header\n", nextsector);
-          goto errout;
-        }
-
-      /* Get the next chained sector */
-
-      sector = SMARTFS_NEXTSECTOR(header);
-
-      /* If this is the 1st sector of the file, then just overwrite
-       * the sector data with the erased state value.  The underlying
-       * SMART block driver will detect this and release the old
-       * sector and create a new one with the new (blank) data.
-       */
-
-      if (nextsector == entry->firstsector)
-        {
-#ifdef CONFIG_SMARTFS_USE_SECTOR_BUFFER
-
-          /* When we have a sector buffer in use, simply skip the first sector */
-
-          nextsector = sector;
-          continue;
+      fdbg("Error reading sector %d header\n", entry->firstsector);
+      goto errout;
+    }
 
-#else
+  nextsector = SMARTFS_NEXTSECTOR(header);
 
-          /* Fill our buffer with erased data */
+#ifndef CONFIG_SMARTFS_USE_SECTOR_BUFFER
+  /* This is the 1st sector of the file, so just overwrite the sector
+   * data with the erased state value.  The underlying SMART block driver
+   * will detect this and release the old sector and create a new one with
+   * the new (blank) data.  When we have a sector buffer in use, the first
+   * sector is dealt with below instead.
+   */
 
-          memset(fs->fs_rwbuffer, CONFIG_SMARTFS_ERASEDSTATE, fs->fs_llformat.availbytes);
-          header->type = SMARTFS_SECTOR_TYPE_FILE;
+  memset(fs->fs_rwbuffer, CONFIG_SMARTFS_ERASEDSTATE, fs->fs_llformat.availbytes);
+  header->type = SMARTFS_SECTOR_TYPE_FILE;
 
-          /* Now write the new sector data */
+  /* Now write the new sector data */
 
-          readwrite.count = fs->fs_llformat.availbytes;
-          ret = FS_IOCTL(fs, BIOC_WRITESECT, (unsigned long) &readwrite);
-          if (ret < 0)
-            {
-              fdbg("Error blanking 1st sector (%d) of file\n", nextsector);
-              goto errout;
-            }
+  readwrite.count = fs->fs_llformat.availbytes;
+  ret = FS_IOCTL(fs, BIOC_WRITESECT, (unsigned long) &readwrite);
+  if (ret < 0)
+    {
+      fdbg("Error blanking 1st sector (%d) of file\n", entry->firstsector);
+      goto errout;
+    }
 
-          /* Set the entry's data length to zero ... we just truncated */
+  /* Set the entry's data length to zero ... we just truncated */
 
-          entry->datlen = 0;
+  entry->datlen = 0;
 #endif  /* CONFIG_SMARTFS_USE_SECTOR_BUFFER */
-        }
-      else
-        {
-          /* Not the 1st sector -- release it */
-
-          ret = FS_IOCTL(fs, BIOC_FREESECT, (unsigned long) nextsector);
-          if (ret < 0)
-            {
-              fdbg("Error freeing sector %d\n", nextsector);
-              goto errout;
-            }
-        }
 
-      /* Now move on to the next sector */
+  /* Release the rest of the chain */
 
-      nextsector = sector;
+  ret = smartfs_releasechain(fs, nextsector);
+  if (ret < 0)
+    {
+      goto errout;
     }
 
   /* Now deal with the first sector in the event we are using a sector buffer
@@ -0,0 +1,161 @@
+/****************************************************************************
+ * test/nxffs_fulltest.c
+ *
+ * Regression test for NXFFS running out of FLASH.  File data is staged in
+ * memory and committed when the file is closed, so the space for it must
+ * be reserved as it is written:  Writes past the end of the volume fail
+ * with ENOSPC, while sync and close of the data accepted succeed.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <nuttx/fs/fs.h>
+#include <nuttx/fs/ioctl.h>
+
+#include "nxffs_testutil.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define TEST_IMAGE      "nxffs_fulltest.img"
+#define TEST_IMAGESIZE  (256 * 1024)
+#define TEST_ERASESIZE  4096
+#define TEST_NWRITERS   3
+#define TEST_CHUNK      700
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+  struct file file[TEST_NWRITERS];
+  char relpath[TEST_NWRITERS][8];
+  size_t length[TEST_NWRITERS];
+  uint8_t buffer[TEST_CHUNK];
+  ssize_t nwritten;
+  bool full;
+  long i;
+  int j;
+
+  if (test_mount(TEST_IMAGE, TEST_IMAGESIZE, TEST_ERASESIZE) != OK)
+    {
+      return 1;
+    }
+
+  /* Several writers fill the volume together.  None of their data is on
+   * FLASH until they are closed.
+   */
+
+  for (j = 0; j < TEST_NWRITERS; j++)
+    {
+      sprintf(relpath[j], "file%d", j);
+      length[j] = 0;
+      if (test_open(&file[j], relpath[j], O_WROK | O_CREAT) != OK)
+        {
+          printf("FAIL: open %s\n", relpath[j]);
+          return 1;
+        }
+    }
+
+  for (full = false; !full; )
+    {
+      for (j = 0; j < TEST_NWRITERS; j++)
+        {
+          for (i = 0; i < TEST_CHUNK; i++)
+            {
+              buffer[i] = test_byte(length[j] + i, j);
+            }
+
+          nwritten = OPS->write(&file[j], (FAR const char *)buffer,
+                                TEST_CHUNK);
+          if (nwritten == -ENOSPC)
+            {
+              full = true;
+            }
+          else if (nwritten != TEST_CHUNK)
+            {
+              printf("FAIL: write returned %zd\n", nwritten);
+              return 1;
+            }
+          else
+            {
+              length[j] += TEST_CHUNK;
+            }
+
+          if (length[j] > TEST_IMAGESIZE)
+            {
+              printf("FAIL: wrote past the end of the volume\n");
+              return 1;
+            }
+        }
+    }
+
+  /* Everything that was accepted must commit */
+
+  for (j = 0; j < TEST_NWRITERS; j++)
+    {
+      if (OPS->sync(&file[j]) != OK || OPS->close(&file[j]) != OK)
+        {
+          printf("FAIL: commit %s\n", relpath[j]);
+          return 1;
+        }
+    }
+
+  for (j = 0; j < TEST_NWRITERS; j++)
+    {
+      if (test_open(&file[j], relpath[j], O_RDOK) != OK ||
+          test_read(&file[j], 0, length[j], j) != OK)
+        {
+          printf("FAIL: read %s\n", relpath[j]);
+          return 1;
+        }
+
+      OPS->close(&file[j]);
+    }
+
+  unlink(TEST_IMAGE);
+
+  printf("PASS: nxffs_fulltest\n");
+  return 0;
+}
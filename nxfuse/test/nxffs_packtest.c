@@ -0,0 +1,165 @@
+/****************************************************************************
+ * test/nxffs_packtest.c
+ *
+ * Regression test for NXFFS packing under an open reader.  A file larger
+ * than an erase block is moved by an incremental pack step while it is
+ * open for reading.  Its inode header is finished after the pack has
+ * flushed the block holding it, and the reader must still follow the
+ * file to its new location.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <debug.h>
+
+#include <nuttx/fs/fs.h>
+#include <nuttx/fs/ioctl.h>
+
+#include "nxffs_testutil.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define TEST_IMAGE      "nxffs_packtest.img"
+#define TEST_IMAGESIZE  (256 * 1024)
+#define TEST_ERASESIZE  4096
+#define TEST_SMALLSIZE  300
+#define TEST_BIGSIZE    (3 * TEST_ERASESIZE + 1000)
+#define TEST_FIRSTREAD  1000
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static int test_write(FAR const char *relpath, size_t len, int seed)
+{
+  struct file file;
+  uint8_t buffer[256];
+  size_t offset;
+  size_t n;
+  size_t i;
+
+  if (test_open(&file, relpath, O_WROK | O_CREAT | O_TRUNC) != OK)
+    {
+      return -1;
+    }
+
+  for (offset = 0; offset < len; offset += n)
+    {
+      n = len - offset < sizeof(buffer) ? len - offset : sizeof(buffer);
+      for (i = 0; i < n; i++)
+        {
+          buffer[i] = test_byte(offset + i, seed);
+        }
+
+      if (OPS->write(&file, (FAR const char *)buffer, n) != (ssize_t)n)
+        {
+          OPS->close(&file);
+          return -1;
+        }
+    }
+
+  return OPS->close(&file);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+  struct file file;
+  int ret;
+
+  if (test_mount(TEST_IMAGE, TEST_IMAGESIZE, TEST_ERASESIZE) != OK)
+    {
+      return 1;
+    }
+
+  /* A small file ahead of a large one.  Deleting the small file leaves a
+   * hole that the pack closes by moving the large file down.
+   */
+
+  if (test_write("small", TEST_SMALLSIZE, 1) != OK ||
+      test_write("big", TEST_BIGSIZE, 2) != OK ||
+      OPS->unlink(g_inode, "small") != OK)
+    {
+      printf("FAIL: setup\n");
+      return 1;
+    }
+
+  /* Open the large file and read part of it before packing */
+
+  if (test_open(&file, "big", O_RDOK) != OK ||
+      test_read(&file, 0, TEST_FIRSTREAD, 2) != OK)
+    {
+      printf("FAIL: first read\n");
+      return 1;
+    }
+
+  /* One pack step moves the large file */
+
+  ret = OPS->ioctl(&file, FIOC_OPTIMIZE, 1);
+  if (ret != 1)
+    {
+      printf("FAIL: pack step returned %d\n", ret);
+      return 1;
+    }
+
+  /* The reader continues, then reads the file again from the start */
+
+  if (test_read(&file, TEST_FIRSTREAD, TEST_BIGSIZE - TEST_FIRSTREAD, 2) != OK)
+    {
+      printf("FAIL: read after pack\n");
+      return 1;
+    }
+
+  file.f_pos = 0;
+  if (test_read(&file, 0, TEST_BIGSIZE, 2) != OK)
+    {
+      printf("FAIL: reread after pack\n");
+      return 1;
+    }
+
+  OPS->close(&file);
+  unlink(TEST_IMAGE);
+
+  printf("PASS: nxffs_packtest\n");
+  return 0;
+}
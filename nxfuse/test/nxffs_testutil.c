@@ -0,0 +1,150 @@
+/****************************************************************************
+ * test/nxffs_testutil.c
+ *
+ * Helpers shared by the NXFFS regression tests.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <debug.h>
+
+#include <nuttx/fs/fs.h>
+
+#include "nxfuse.h"
+#include "nxffs_testutil.h"
+
+/****************************************************************************
+ * Public Data
+ ****************************************************************************/
+
+struct inode *g_inode;
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: test_mount
+ ****************************************************************************/
+
+int test_mount(FAR const char *image, long imagesize, int erasesize)
+{
+  FILE *stream;
+  long i;
+
+  /* Start from an erased image */
+
+  stream = fopen(image, "w");
+  if (stream == NULL)
+    {
+      perror(image);
+      return -1;
+    }
+
+  for (i = 0; i < imagesize; i++)
+    {
+      fputc(CONFIG_NXFFS_ERASEDSTATE, stream);
+    }
+
+  fclose(stream);
+
+  g_inode = vmount(image, "/", "nxffs", erasesize, 512, 512, "");
+  if (g_inode == NULL)
+    {
+      printf("FAIL: mount\n");
+      return -1;
+    }
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: test_open
+ ****************************************************************************/
+
+int test_open(FAR struct file *filep, FAR const char *relpath, int oflags)
+{
+  memset(filep, 0, sizeof(struct file));
+  filep->f_inode  = g_inode;
+  filep->f_oflags = oflags;
+  return OPS->open(filep, relpath, oflags, 0666);
+}
+
+/****************************************************************************
+ * Name: test_byte
+ ****************************************************************************/
+
+uint8_t test_byte(size_t offset, int seed)
+{
+  return (uint8_t)(offset * 7 + seed);
+}
+
+/****************************************************************************
+ * Name: test_read
+ ****************************************************************************/
+
+int test_read(FAR struct file *filep, size_t offset, size_t len, int seed)
+{
+  uint8_t buffer[256];
+  ssize_t nread;
+  size_t i;
+
+  while (len > 0)
+    {
+      nread = OPS->read(filep, (FAR char *)buffer,
+                        len < sizeof(buffer) ? len : sizeof(buffer));
+      if (nread <= 0)
+        {
+          printf("read at %zu returned %zd\n", offset, nread);
+          return -1;
+        }
+
+      for (i = 0; i < (size_t)nread; i++)
+        {
+          if (buffer[i] != test_byte(offset + i, seed))
+            {
+              printf("data mismatch at %zu\n", offset + i);
+              return -1;
+            }
+        }
+
+      offset += nread;
+      len    -= nread;
+    }
+
+  return OK;
+}
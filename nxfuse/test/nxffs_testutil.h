@@ -0,0 +1,114 @@
+/****************************************************************************
+ * test/nxffs_testutil.h
+ *
+ * Helpers shared by the NXFFS regression tests:  Creating and mounting a
+ * scratch image, opening files on it, and checking the data read back.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef _TEST_NXFFS_TESTUTIL_H
+#define _TEST_NXFFS_TESTUTIL_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#include <nuttx/fs/fs.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* The operations of the mounted test volume */
+
+#define OPS             g_inode->u.i_mops
+
+/****************************************************************************
+ * Public Data
+ ****************************************************************************/
+
+/* The inode of the mounted test volume */
+
+extern struct inode *g_inode;
+
+/****************************************************************************
+ * Function Prototypes
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: test_mount
+ *
+ * Description:
+ *   Create an erased image file of the given size and mount it as an NXFFS
+ *   volume with the given erase block size.  On success, g_inode refers to
+ *   the volume.
+ *
+ ****************************************************************************/
+
+int test_mount(FAR const char *image, long imagesize, int erasesize);
+
+/****************************************************************************
+ * Name: test_open
+ *
+ * Description:
+ *   Open a file on the test volume.
+ *
+ ****************************************************************************/
+
+int test_open(FAR struct file *filep, FAR const char *relpath, int oflags);
+
+/****************************************************************************
+ * Name: test_byte
+ *
+ * Description:
+ *   Return the expected content of a test file at an offset.  'seed' makes
+ *   the content of different files differ.
+ *
+ ****************************************************************************/
+
+uint8_t test_byte(size_t offset, int seed);
+
+/****************************************************************************
+ * Name: test_read
+ *
+ * Description:
+ *   Read 'len' bytes from the current position of an open file, which is
+ *   at file offset 'offset', and compare them with test_byte().
+ *
+ ****************************************************************************/
+
+int test_read(FAR struct file *filep, size_t offset, size_t len, int seed);
+
+#endif /* _TEST_NXFFS_TESTUTIL_H */